@@ -0,0 +1,199 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "core/filesys/fs.h"
+
+namespace Core::FileSys {
+
+// Threads are spread over the free lists round-robin on first use
+static u32 ThreadShard() {
+    static std::atomic<u32> next_shard{0};
+    thread_local u32 shard =
+        next_shard.fetch_add(1, std::memory_order_relaxed) % HandleTable::FREE_SHARDS;
+    return shard;
+}
+
+FileRef::FileRef(const FileRef& other) : table{other.table}, index{other.index}, file{other.file} {
+    if (file) {
+        // The source reference keeps the slot alive, so no open check is needed
+        table->GetSlot(index)->control.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FileRef::FileRef(FileRef&& other) noexcept
+    : table{other.table}, index{other.index}, file{other.file} {
+    other.file = nullptr;
+}
+
+FileRef& FileRef::operator=(FileRef other) noexcept {
+    std::swap(table, other.table);
+    std::swap(index, other.index);
+    std::swap(file, other.file);
+    return *this;
+}
+
+FileRef::~FileRef() {
+    if (file) {
+        table->Release(index);
+    }
+}
+
+HandleTable::~HandleTable() {
+    for (auto& segment : segments) {
+        delete[] segment.load(std::memory_order_relaxed);
+    }
+}
+
+HandleTable::Slot* HandleTable::GetSlot(u32 index) const {
+    Slot* segment = segments[index >> SEGMENT_SHIFT].load(std::memory_order_acquire);
+    return segment ? &segment[index & (SEGMENT_SIZE - 1)] : nullptr;
+}
+
+HandleTable::Slot* HandleTable::GetOrCreateSlot(u32 index) {
+    std::atomic<Slot*>& entry = segments[index >> SEGMENT_SHIFT];
+    Slot* segment = entry.load(std::memory_order_acquire);
+    if (!segment) {
+        // Slots are never freed while the table lives, so stale lookups stay safe
+        Slot* created = new Slot[SEGMENT_SIZE];
+        if (entry.compare_exchange_strong(segment, created, std::memory_order_acq_rel)) {
+            segment = created;
+        } else {
+            delete[] created;
+        }
+    }
+    return &segment[index & (SEGMENT_SIZE - 1)];
+}
+
+bool HandleTable::Acquire(Slot* slot) {
+    // Only count a reference while the handle is open, a closed slot must reach zero
+    // exactly once
+    u64 control = slot->control.load(std::memory_order_acquire);
+    do {
+        if (!(control & SLOT_OPEN)) {
+            return false;
+        }
+    } while (!slot->control.compare_exchange_weak(control, control + 1,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_acquire));
+    return true;
+}
+
+void HandleTable::Release(u32 index) {
+    Slot* slot = GetSlot(index);
+    if (slot->control.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    // Last reference of a closed handle, nobody else can reach the file now
+    File& file = slot->file;
+    file.is_opened = false;
+    file.type = FileType::Regular;
+    file.m_host_name.clear();
+    file.m_guest_name.clear();
+    file.vfs_file = nullptr;
+    file.socket.reset();
+    file.epoll.reset();
+    PushFree(index);
+}
+
+void HandleTable::PushFree(u32 index) {
+    FreeShard& shard = free_shards[ThreadShard()];
+    Slot* slot = GetSlot(index);
+    u64 head = shard.head.load(std::memory_order_relaxed);
+    u64 next;
+    do {
+        slot->next_free.store(static_cast<u32>(head), std::memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | index;
+    } while (!shard.head.compare_exchange_weak(head, next, std::memory_order_release,
+                                               std::memory_order_relaxed));
+}
+
+bool HandleTable::PopFree(FreeShard& shard, u32* index) {
+    u64 head = shard.head.load(std::memory_order_acquire);
+    u64 next;
+    do {
+        u32 top = static_cast<u32>(head);
+        if (top == FREE_LIST_END) {
+            return false;
+        }
+        u32 after = GetSlot(top)->next_free.load(std::memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | after;
+    } while (!shard.head.compare_exchange_weak(head, next, std::memory_order_acquire,
+                                               std::memory_order_acquire));
+    *index = static_cast<u32>(head);
+    return true;
+}
+
+int HandleTable::CreateHandle() {
+    u32 index;
+    if (!PopFree(free_shards[ThreadShard()], &index)) {
+        u32 fresh = next_unused.load(std::memory_order_relaxed);
+        while (fresh < MAX_HANDLES &&
+               !next_unused.compare_exchange_weak(fresh, fresh + 1, std::memory_order_relaxed)) {
+        }
+        if (fresh < MAX_HANDLES) {
+            index = fresh;
+        } else {
+            // Never-used descriptors ran out, take one another thread freed
+            bool found = false;
+            for (auto& shard : free_shards) {
+                if (PopFree(shard, &index)) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                return -1;
+            }
+        }
+    }
+    Slot* slot = GetOrCreateSlot(index);
+    slot->control.store(SLOT_OPEN | 1, std::memory_order_release);
+    return static_cast<int>(index);
+}
+
+void HandleTable::DeleteHandle(int d) {
+    if (d < 0 || static_cast<u32>(d) >= MAX_HANDLES) {
+        return;
+    }
+    Slot* slot = GetSlot(static_cast<u32>(d));
+    if (!slot) {
+        return;
+    }
+    u64 control = slot->control.fetch_and(~SLOT_OPEN, std::memory_order_acq_rel);
+    if (control & SLOT_OPEN) {
+        // Drop the table's own reference
+        Release(static_cast<u32>(d));
+    }
+}
+
+FileRef HandleTable::GetFile(int d) {
+    if (d < 0 || static_cast<u32>(d) >= MAX_HANDLES) {
+        return {};
+    }
+    Slot* slot = GetSlot(static_cast<u32>(d));
+    if (!slot || !Acquire(slot)) {
+        return {};
+    }
+    return FileRef{this, static_cast<u32>(d), &slot->file};
+}
+
+FileRef HandleTable::GetSocket(int d) {
+    FileRef file = GetFile(d);
+    if (!file || file->type != FileType::Socket) {
+        return {};
+    }
+    return file;
+}
+
+void HandleTable::CreateStdHandles() {
+    static const char* const names[] = {"/dev/stdin", "/dev/stdout", "/dev/stderr"};
+    for (const char* name : names) {
+        int d = CreateHandle();
+        FileRef file = GetFile(d);
+        file->is_opened = true;
+        file->type = FileType::Device;
+        file->m_guest_name = name;
+    }
+}
+
+} // namespace Core::FileSys
@@ -0,0 +1,130 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "common/types.h"
+#include "core/vfs/layra_vfs.h"
+
+namespace Libraries::Net {
+struct Socket;
+struct Epoll;
+}
+
+namespace Core::FileSys {
+
+enum class FileType {
+    Regular,
+    Directory,
+    Device,
+    Socket,
+    Epoll,
+};
+
+struct File {
+    std::atomic_bool is_opened{};
+    std::atomic<FileType> type{FileType::Regular};
+    std::string m_host_name;
+    std::string m_guest_name;
+    layra_vfs_file_t* vfs_file = nullptr;
+    std::shared_ptr<Libraries::Net::Socket> socket;
+    std::shared_ptr<Libraries::Net::Epoll> epoll;
+    // Serializes operations that move the file position
+    std::mutex m_mutex;
+};
+
+class HandleTable;
+
+// Counted reference to an open handle's file. The file stays valid while any
+// reference is alive, even if the handle is closed meanwhile.
+class FileRef {
+public:
+    FileRef() = default;
+    FileRef(const FileRef& other);
+    FileRef(FileRef&& other) noexcept;
+    FileRef& operator=(FileRef other) noexcept;
+    ~FileRef();
+
+    File* get() const {
+        return file;
+    }
+    File* operator->() const {
+        return file;
+    }
+    File& operator*() const {
+        return *file;
+    }
+    explicit operator bool() const {
+        return file != nullptr;
+    }
+
+private:
+    friend class HandleTable;
+    FileRef(HandleTable* table, u32 index, File* file) : table{table}, index{index}, file{file} {}
+
+    HandleTable* table = nullptr;
+    u32 index = 0;
+    File* file = nullptr;
+};
+
+// Guest descriptor table shared by files and sockets. Lookups take no lock, handles
+// are allocated from per-thread shards of free descriptors, and a closed descriptor is
+// only reused once the last reference to its file is gone.
+class HandleTable {
+public:
+    static constexpr u32 SEGMENT_SHIFT = 10;
+    static constexpr u32 SEGMENT_SIZE = 1u << SEGMENT_SHIFT;
+    static constexpr u32 MAX_SEGMENTS = 64;
+    static constexpr u32 MAX_HANDLES = SEGMENT_SIZE * MAX_SEGMENTS;
+    static constexpr u32 FREE_SHARDS = 16;
+
+    HandleTable() = default;
+    ~HandleTable();
+
+    // Returns the new descriptor, or -1 when the table is full
+    int CreateHandle();
+    // Close a descriptor. Its file is reset once outstanding references are released.
+    void DeleteHandle(int d);
+    FileRef GetFile(int d);
+    // Same as GetFile, but only for descriptors holding a socket
+    FileRef GetSocket(int d);
+    // stdin, stdout and stderr take descriptors 0 to 2, call before anything else
+    void CreateStdHandles();
+
+private:
+    friend class FileRef;
+
+    static constexpr u64 SLOT_OPEN = 1ull << 63;
+    static constexpr u64 SLOT_REFS_MASK = 0xFFFFFFFFull;
+    static constexpr u32 FREE_LIST_END = 0xFFFFFFFF;
+
+    struct Slot {
+        // Open bit plus reference count; the table itself holds one while open
+        std::atomic<u64> control{0};
+        std::atomic<u32> next_free{FREE_LIST_END};
+        File file;
+    };
+
+    // Treiber stack of free descriptors, tagged against ABA
+    struct alignas(64) FreeShard {
+        std::atomic<u64> head{FREE_LIST_END};
+    };
+
+    Slot* GetSlot(u32 index) const;
+    Slot* GetOrCreateSlot(u32 index);
+    bool Acquire(Slot* slot);
+    void Release(u32 index);
+    void PushFree(u32 index);
+    bool PopFree(FreeShard& shard, u32* index);
+
+    std::atomic<Slot*> segments[MAX_SEGMENTS]{};
+    FreeShard free_shards[FREE_SHARDS];
+    // Descriptors below this have been handed out at least once
+    std::atomic<u32> next_unused{0};
+};
+
+} // namespace Core::FileSys
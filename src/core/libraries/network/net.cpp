@@ -20,7 +20,7 @@
 #include "core/ libraries/errorcodes.h"
 #include "core/libraries/libs.h"
 #include "core/libraries/network/net.h"
-#include "netepoll.h"
+#include "net_epoll.h"
 #include "neterror.h"
 #include "netresolver.h"
 #include "netutil.h"
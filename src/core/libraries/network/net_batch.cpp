@@ -0,0 +1,277 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <cstring>
+#include "common/singleton.h"
+#include "net_batch.h"
+
+namespace Libraries::Net {
+
+#ifdef WIN32
+constexpr int RECV_DONTWAIT = 0;
+
+static int LastHostError() {
+    return WSAGetLastError();
+}
+
+static void SetLastHostError(int error) {
+    WSASetLastError(error);
+}
+
+static bool IsWouldBlock(int error) {
+    return error == WSAEWOULDBLOCK;
+}
+#else
+constexpr int RECV_DONTWAIT = MSG_DONTWAIT;
+
+static int LastHostError() {
+    return errno;
+}
+
+static void SetLastHostError(int error) {
+    errno = error;
+}
+
+static bool IsWouldBlock(int error) {
+    return error == EAGAIN || error == EWOULDBLOCK;
+}
+#endif
+
+DatagramBatch::DatagramBatch(net_socket sock, size_t slot_size)
+    : sock{sock}, slot_size{slot_size}, ring_data(new u8[slot_size * MAX_BATCH]) {}
+
+DatagramBatch::~DatagramBatch() {
+    Flush();
+}
+
+int DatagramBatch::Send(const void* data, u32 len, const sockaddr* to, socklen_t tolen) {
+    std::unique_lock lock{send_mutex};
+    if (deferred_error) {
+        SetLastHostError(deferred_error);
+        deferred_error = 0;
+        return -1;
+    }
+    if (outgoing_count == MAX_BATCH) {
+        FlushLocked();
+        if (outgoing_count == MAX_BATCH) {
+            // The socket buffer is full, the caller sees the would-block
+            return -1;
+        }
+    }
+    Outgoing& out = outgoing[outgoing_count++];
+    const u8* bytes = static_cast<const u8*>(data);
+    out.data.assign(bytes, bytes + len);
+    out.tolen = to ? std::min<socklen_t>(tolen, sizeof(out.to)) : 0;
+    if (to) {
+        std::memcpy(&out.to, to, out.tolen);
+    }
+    bool first = outgoing_count == 1;
+    has_outgoing.store(true, std::memory_order_relaxed);
+    lock.unlock();
+    if (first) {
+        Common::Singleton<DatagramFlusher>::Instance()->Schedule(weak_from_this());
+    }
+    return static_cast<int>(len);
+}
+
+int DatagramBatch::Flush() {
+    std::scoped_lock lock{send_mutex};
+    return FlushLocked();
+}
+
+bool DatagramBatch::HasPendingSends() {
+    return has_outgoing.load(std::memory_order_relaxed);
+}
+
+int DatagramBatch::FlushLocked() {
+    size_t sent = 0;
+    int error = 0;
+#ifdef __linux__
+    mmsghdr msgs[MAX_BATCH]{};
+    iovec iov[MAX_BATCH];
+    for (size_t i = 0; i < outgoing_count; i++) {
+        iov[i] = {outgoing[i].data.data(), outgoing[i].data.size()};
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = outgoing[i].tolen ? &outgoing[i].to : nullptr;
+        msgs[i].msg_hdr.msg_namelen = outgoing[i].tolen;
+    }
+#endif
+    while (sent < outgoing_count) {
+#ifdef __linux__
+        int result = sendmmsg(sock, msgs + sent, static_cast<unsigned>(outgoing_count - sent), 0);
+#else
+        const Outgoing& out = outgoing[sent];
+        int result = sendto(sock, reinterpret_cast<const char*>(out.data.data()),
+                            static_cast<int>(out.data.size()), 0,
+                            out.tolen ? reinterpret_cast<const sockaddr*>(&out.to) : nullptr,
+                            out.tolen);
+        result = result >= 0 ? 1 : result;
+#endif
+        if (result >= 0) {
+            sent += result;
+            continue;
+        }
+        error = LastHostError();
+        if (error == EINTR) {
+            continue;
+        }
+        if (IsWouldBlock(error)) {
+            // Keep the rest queued for the next flush
+            break;
+        }
+        // The datagram at the head failed for good, report it on the next send and
+        // carry on with the rest like separate sendto calls would
+        deferred_error = error;
+        sent++;
+    }
+    // Move what is left to the front, swapping keeps every buffer's capacity
+    size_t left = outgoing_count - sent;
+    for (size_t i = 0; i < left; i++) {
+        std::swap(outgoing[i], outgoing[sent + i]);
+    }
+    outgoing_count = left;
+    has_outgoing.store(left != 0, std::memory_order_relaxed);
+    if (left) {
+        // Send only schedules the first datagram of a batch, so retry these from the
+        // flusher or they would wait for the next full batch or receive
+        Common::Singleton<DatagramFlusher>::Instance()->Schedule(weak_from_this());
+        SetLastHostError(error);
+        return -1;
+    }
+    return static_cast<int>(sent);
+}
+
+int DatagramBatch::FillRing() {
+    ring_head = 0;
+#ifdef __linux__
+    mmsghdr msgs[MAX_BATCH]{};
+    iovec iov[MAX_BATCH];
+    for (size_t i = 0; i < MAX_BATCH; i++) {
+        iov[i] = {ring_data.get() + i * slot_size, slot_size};
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &incoming[i].from;
+        msgs[i].msg_hdr.msg_namelen = sizeof(incoming[i].from);
+    }
+    int count;
+    do {
+        count = recvmmsg(sock, msgs, MAX_BATCH, MSG_DONTWAIT, nullptr);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        incoming[i].len = std::min<u32>(msgs[i].msg_len, static_cast<u32>(slot_size));
+        incoming[i].truncated = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+        incoming[i].fromlen = msgs[i].msg_hdr.msg_namelen;
+    }
+#else
+    int count = 0;
+    while (count < static_cast<int>(MAX_BATCH)) {
+        Incoming& in = incoming[count];
+        in.fromlen = sizeof(in.from);
+        int result = recvfrom(sock, reinterpret_cast<char*>(ring_data.get() + count * slot_size),
+                              static_cast<int>(slot_size), RECV_DONTWAIT,
+                              reinterpret_cast<sockaddr*>(&in.from), &in.fromlen);
+        if (result < 0) {
+            int error = LastHostError();
+#ifdef WIN32
+            if (error == WSAEMSGSIZE) {
+                in.len = static_cast<u32>(slot_size);
+                in.truncated = true;
+                count++;
+                continue;
+            }
+#endif
+            if (count == 0) {
+                return -1;
+            }
+            SetLastHostError(error);
+            break;
+        }
+        in.len = static_cast<u32>(result);
+        in.truncated = false;
+        count++;
+    }
+#endif
+    ring_count = count;
+    return count;
+}
+
+int DatagramBatch::Receive(void* buf, u32 len, bool peek, sockaddr* from, socklen_t* fromlen,
+                           bool* truncated) {
+    if (HasPendingSends()) {
+        Flush();
+    }
+    std::scoped_lock lock{recv_mutex};
+    if (ring_count == 0) {
+        if (len > slot_size) {
+            // Nothing buffered, so the whole datagram can go straight to the caller
+            *truncated = false;
+            return recvfrom(sock, static_cast<char*>(buf), static_cast<int>(len),
+                            RECV_DONTWAIT | (peek ? MSG_PEEK : 0), from, fromlen);
+        }
+        if (FillRing() <= 0) {
+            return -1;
+        }
+    }
+    const Incoming& in = incoming[ring_head];
+    u32 copied = std::min(len, in.len);
+    std::memcpy(buf, ring_data.get() + ring_head * slot_size, copied);
+    if (from && fromlen) {
+        socklen_t addr_len = std::min(*fromlen, in.fromlen);
+        std::memcpy(from, &in.from, addr_len);
+        *fromlen = in.fromlen;
+    }
+    *truncated = in.truncated || in.len > len;
+    if (!peek) {
+        ring_head++;
+        ring_count--;
+    }
+    return static_cast<int>(copied);
+}
+
+DatagramFlusher::DatagramFlusher() : thread{&DatagramFlusher::FlushThread, this} {}
+
+DatagramFlusher::~DatagramFlusher() {
+    {
+        std::scoped_lock lock{mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+void DatagramFlusher::Schedule(std::weak_ptr<DatagramBatch> batch) {
+    {
+        std::scoped_lock lock{mutex};
+        scheduled.push_back(std::move(batch));
+    }
+    wake.notify_one();
+}
+
+void DatagramFlusher::FlushThread() {
+    std::vector<std::weak_ptr<DatagramBatch>> flushing;
+    std::unique_lock lock{mutex};
+    for (;;) {
+        wake.wait(lock, [this] { return stopping || !scheduled.empty(); });
+        // Let the rest of the burst join before sending
+        wake.wait_for(lock, FLUSH_DELAY, [this] { return stopping; });
+        if (stopping) {
+            return;
+        }
+        flushing.swap(scheduled);
+        lock.unlock();
+        for (auto& weak : flushing) {
+            if (auto batch = weak.lock()) {
+                batch->Flush();
+            }
+        }
+        flushing.clear();
+        lock.lock();
+    }
+}
+
+} // namespace Libraries::Net
@@ -0,0 +1,107 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common/types.h"
+#include "sockets.h"
+
+namespace Libraries::Net {
+
+// Datagram batching for one UDP socket. Sends are queued and leave in one sendmmsg,
+// receives are drained with one recvmmsg into a ring that later receives read from.
+// Works on host addresses, the socket layer converts guest ones around it. Hosts
+// without sendmmsg/recvmmsg loop over single calls with the same semantics. Always
+// owned by a shared_ptr, the flusher holds weak references to it.
+class DatagramBatch : public std::enable_shared_from_this<DatagramBatch> {
+public:
+    static constexpr size_t MAX_BATCH = 32;
+    // Holds any UDP datagram, so the ring never truncates one that a direct receive into
+    // the caller's buffer would not. The host commits a slot's pages only once datagrams
+    // land in it, so most of the ring stays untouched for small datagrams.
+    static constexpr size_t DEFAULT_SLOT_SIZE = 65536;
+
+    explicit DatagramBatch(net_socket sock, size_t slot_size = DEFAULT_SLOT_SIZE);
+    ~DatagramBatch();
+
+    // Queue a datagram, flushing first when the queue is full. Returns len, or -1 with the
+    // host error of an earlier failed flush, which is reported once.
+    int Send(const void* data, u32 len, const sockaddr* to, socklen_t tolen);
+    // Send everything queued. Returns the number of datagrams sent or -1 on error.
+    int Flush();
+    bool HasPendingSends();
+
+    // Next datagram from the ring, refilled from the socket when empty. Returns the
+    // copied length, or -1 with would-block when nothing is waiting. Queued sends are
+    // flushed first, a receive is where request/response traffic turns around.
+    int Receive(void* buf, u32 len, bool peek, sockaddr* from, socklen_t* fromlen,
+                bool* truncated);
+
+private:
+    struct Outgoing {
+        std::vector<u8> data;
+        sockaddr_storage to;
+        socklen_t tolen;
+    };
+
+    struct Incoming {
+        u32 len;
+        bool truncated;
+        sockaddr_storage from;
+        socklen_t fromlen;
+    };
+
+    int FlushLocked();
+    int FillRing();
+
+    net_socket sock;
+    size_t slot_size;
+
+    std::mutex send_mutex;
+    std::array<Outgoing, MAX_BATCH> outgoing{};
+    size_t outgoing_count = 0;
+    int deferred_error = 0;
+    // Mirrors outgoing_count != 0 so receives can skip the send lock
+    std::atomic_bool has_outgoing{false};
+
+    std::mutex recv_mutex;
+    // Left uninitialized so unused slot pages are never committed
+    std::unique_ptr<u8[]> ring_data;
+    std::array<Incoming, MAX_BATCH> incoming{};
+    size_t ring_head = 0;
+    size_t ring_count = 0;
+};
+
+// Flushes queued sends a short delay after they were queued, so a burst of datagrams
+// written within one game tick leaves in a single syscall without holding any of them
+// for longer than the delay.
+class DatagramFlusher {
+public:
+    static constexpr auto FLUSH_DELAY = std::chrono::microseconds(500);
+
+    DatagramFlusher();
+    ~DatagramFlusher();
+
+    // Called by Send when a batch gets its first queued datagram, and by a flush that
+    // left datagrams queued because the socket would block
+    void Schedule(std::weak_ptr<DatagramBatch> batch);
+
+private:
+    void FlushThread();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::weak_ptr<DatagramBatch>> scheduled;
+    bool stopping = false;
+    std::thread thread;
+};
+
+} // namespace Libraries::Net
@@ -0,0 +1,520 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include "common/logging/log.h"
+#include "common/singleton.h"
+#include "core/filesys/fs.h"
+#include "core/libraries/error_codes.h"
+#include "net_epoll.h"
+#include "net_error.h"
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace Libraries::Net {
+
+using FDTable = Common::Singleton<Core::FileSys::HandleTable>;
+using Reactor = Common::Singleton<NetReactor>;
+using Clock = std::chrono::steady_clock;
+
+static bool LastErrorWouldBlock() {
+#ifdef WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+// Longest a wait that has to poll goes without checking for sceNetEpollAbort
+constexpr s64 ABORT_CHECK_US = 10000;
+
+// Remaining microseconds until a deadline, for waits that loop
+static s64 RemainingUs(s64 timeout_us, Clock::time_point start) {
+    if (timeout_us < 0) {
+        return -1;
+    }
+    auto elapsed =
+        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    return elapsed >= timeout_us ? 0 : timeout_us - elapsed;
+}
+
+static int UsToPollMs(s64 timeout_us) {
+    if (timeout_us < 0) {
+        return -1;
+    }
+    // Round up so a short timeout does not turn into a busy poll
+    s64 ms = (timeout_us + 999) / 1000;
+    return ms > 0x7FFFFFFF ? 0x7FFFFFFF : static_cast<int>(ms);
+}
+
+int NetReactor::Poll(net_pollfd* fds, size_t count, int timeout_ms) {
+#ifdef WIN32
+    return WSAPoll(fds, static_cast<ULONG>(count), timeout_ms);
+#else
+    for (;;) {
+        int result = ::poll(fds, static_cast<nfds_t>(count), timeout_ms);
+        if (result >= 0 || errno != EINTR) {
+            return result;
+        }
+    }
+#endif
+}
+
+bool NetReactor::SetNonBlocking(net_socket sock) {
+#ifdef WIN32
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+NetReactor::NetReactor() {
+#ifdef __linux__
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        LOG_ERROR(Lib_Net, "could not create the socket reactor, errno = {}", errno);
+        return;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+    thread = std::thread(&NetReactor::ReactorThread, this);
+#endif
+}
+
+NetReactor::~NetReactor() {
+#ifdef __linux__
+    if (thread.joinable()) {
+        u64 one = 1;
+        [[maybe_unused]] ssize_t written = write(wake_fd, &one, sizeof(one));
+        thread.join();
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+#endif
+}
+
+bool NetReactor::IsRunning() const {
+#ifdef __linux__
+    return epoll_fd >= 0 && wake_fd >= 0;
+#else
+    return false;
+#endif
+}
+
+bool NetReactor::AddSocket(net_socket sock) {
+    if (!IsRunning()) {
+        return false;
+    }
+#ifdef __linux__
+    // Edge-triggered: the thread only passes changes on, waiters read the level state
+    // themselves. Added every time, a descriptor number reused after close is not in
+    // the host set anymore even if we still have its entry.
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = sock;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event) != 0 && errno != EEXIST) {
+        LOG_ERROR(Lib_Net, "could not watch socket {}, errno = {}", sock, errno);
+        return false;
+    }
+    auto& entry = entries[sock];
+    if (!entry) {
+        entry = std::make_shared<Entry>();
+    }
+#endif
+    return true;
+}
+
+bool NetReactor::Watch(net_socket sock, const std::shared_ptr<Epoll>& epoll) {
+    std::scoped_lock lock{mutex};
+    if (!AddSocket(sock)) {
+        return false;
+    }
+    auto& epolls = entries[sock]->epolls;
+    std::erase_if(epolls, [&](const std::weak_ptr<Epoll>& weak) {
+        auto watcher = weak.lock();
+        return !watcher || watcher == epoll;
+    });
+    epolls.push_back(epoll);
+    return true;
+}
+
+void NetReactor::Unwatch(net_socket sock, const Epoll* epoll) {
+    std::scoped_lock lock{mutex};
+    auto it = entries.find(sock);
+    if (it == entries.end()) {
+        return;
+    }
+    auto& epolls = it->second->epolls;
+    std::erase_if(epolls, [&](const std::weak_ptr<Epoll>& weak) {
+        auto watcher = weak.lock();
+        return !watcher || watcher.get() == epoll;
+    });
+    if (epolls.empty() && !it->second->registered) {
+#ifdef __linux__
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock, nullptr);
+#endif
+        entries.erase(it);
+    }
+}
+
+bool NetReactor::Register(net_socket sock) {
+    std::scoped_lock lock{mutex};
+    if (!AddSocket(sock)) {
+        return false;
+    }
+    entries[sock]->registered = true;
+    return true;
+}
+
+void NetReactor::Unregister(net_socket sock) {
+    std::scoped_lock lock{mutex};
+    auto it = entries.find(sock);
+    if (it == entries.end() || !it->second->registered) {
+        return;
+    }
+    // Blocking calls still waiting see the socket gone, epolls keep watching it under a
+    // fresh entry until they drop it
+    std::shared_ptr<Entry> closed = std::move(it->second);
+    closed->closed = true;
+    closed->changed.notify_all();
+    if (closed->epolls.empty()) {
+#ifdef __linux__
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock, nullptr);
+#endif
+        entries.erase(it);
+        return;
+    }
+    it->second = std::make_shared<Entry>();
+    it->second->epolls = std::move(closed->epolls);
+}
+
+static u64 EntrySequence(u64 read_sequence, u64 write_sequence, u32 events) {
+    return ((events & ORBIS_NET_EPOLLIN) ? read_sequence : 0) +
+           ((events & ORBIS_NET_EPOLLOUT) ? write_sequence : 0);
+}
+
+u64 NetReactor::GetSequence(net_socket sock, u32 events) {
+    std::scoped_lock lock{mutex};
+    auto it = entries.find(sock);
+    if (it == entries.end()) {
+        return 0;
+    }
+    return EntrySequence(it->second->read_sequence, it->second->write_sequence, events);
+}
+
+bool NetReactor::WaitForChange(net_socket sock, u32 events, u64 sequence, s64 timeout_us) {
+    std::unique_lock lock{mutex};
+    auto it = entries.find(sock);
+    if (it == entries.end() || !it->second->registered) {
+        lock.unlock();
+        // Not registered with the reactor, wait on the socket itself
+        net_pollfd fd{};
+        fd.fd = sock;
+        fd.events = ((events & ORBIS_NET_EPOLLIN) ? POLLIN : 0) |
+                    ((events & ORBIS_NET_EPOLLOUT) ? POLLOUT : 0);
+        return Poll(&fd, 1, UsToPollMs(timeout_us)) > 0;
+    }
+    std::shared_ptr<Entry> entry = it->second;
+    auto changed = [&] {
+        return entry->closed ||
+               EntrySequence(entry->read_sequence, entry->write_sequence, events) != sequence;
+    };
+    if (timeout_us < 0) {
+        entry->changed.wait(lock, changed);
+    } else if (!entry->changed.wait_for(lock, std::chrono::microseconds(timeout_us), changed)) {
+        return false;
+    }
+    return !entry->closed;
+}
+
+int NetReactor::RunBlocking(net_socket sock, u32 events, s64 timeout_us,
+                            const std::function<int()>& op) {
+    auto start = Clock::now();
+    for (;;) {
+        u64 sequence = GetSequence(sock, events);
+        int result = op();
+        if (result >= 0 || !LastErrorWouldBlock()) {
+            return result;
+        }
+        s64 remaining = RemainingUs(timeout_us, start);
+        if (remaining == 0) {
+            return result;
+        }
+        // Waiting must not clobber the error the caller will report
+        int saved_errno = errno;
+        bool ready = WaitForChange(sock, events, sequence, remaining);
+        errno = saved_errno;
+        if (!ready && RemainingUs(timeout_us, start) == 0) {
+            return result;
+        }
+    }
+}
+
+void NetReactor::ReactorThread() {
+#ifdef __linux__
+    epoll_event events[64];
+    std::vector<std::shared_ptr<Epoll>> woken;
+    for (;;) {
+        int count = epoll_wait(epoll_fd, events, 64, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR(Lib_Net, "socket reactor stopped, errno = {}", errno);
+            return;
+        }
+        bool stopping = false;
+        {
+            std::scoped_lock lock{mutex};
+            for (int i = 0; i < count; i++) {
+                if (events[i].data.fd == wake_fd) {
+                    stopping = true;
+                    continue;
+                }
+                auto it = entries.find(events[i].data.fd);
+                if (it == entries.end()) {
+                    continue;
+                }
+                Entry& entry = *it->second;
+                u32 flags = events[i].events;
+                if (entry.registered) {
+                    if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                        entry.read_sequence++;
+                    }
+                    if (flags & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                        entry.write_sequence++;
+                    }
+                    entry.changed.notify_all();
+                }
+                for (const auto& weak : entry.epolls) {
+                    if (auto epoll = weak.lock()) {
+                        woken.push_back(std::move(epoll));
+                    }
+                }
+            }
+        }
+        // Outside our lock, epoll control calls us with the epoll's lock held
+        for (const auto& epoll : woken) {
+            epoll->Signal();
+        }
+        woken.clear();
+        if (stopping) {
+            return;
+        }
+    }
+#endif
+}
+
+void Epoll::Signal() {
+    {
+        std::scoped_lock lock{mutex};
+        sequence++;
+    }
+    changed.notify_all();
+}
+
+static std::shared_ptr<Epoll> GetEpoll(OrbisNetId eid) {
+    auto file = FDTable::Instance()->GetFile(eid);
+    if (!file || file->type != Core::FileSys::FileType::Epoll) {
+        return nullptr;
+    }
+    return file->epoll;
+}
+
+int PS4_SYSV_ABI sceNetEpollCreate(const char* name, int flags) {
+    int eid = FDTable::Instance()->CreateHandle();
+    if (eid < 0) {
+        return ORBIS_NET_ERROR_EMFILE;
+    }
+    auto file = FDTable::Instance()->GetFile(eid);
+    file->epoll = std::make_shared<Epoll>();
+    file->epoll->name = name ? name : "";
+    file->m_guest_name = file->epoll->name;
+    file->type = Core::FileSys::FileType::Epoll;
+    file->is_opened = true;
+    LOG_DEBUG(Lib_Net, "name = {}, flags = {} -> {}", file->m_guest_name, flags, eid);
+    return eid;
+}
+
+int PS4_SYSV_ABI sceNetEpollControl(OrbisNetId eid, int op, OrbisNetId id,
+                                    OrbisNetEpollEvent* event) {
+    auto epoll = GetEpoll(eid);
+    if (!epoll) {
+        return ORBIS_NET_ERROR_EBADF;
+    }
+    if (op != ORBIS_NET_EPOLL_CTL_DEL && !event) {
+        return ORBIS_NET_ERROR_EINVAL;
+    }
+    std::scoped_lock lock{epoll->mutex};
+    auto it = std::find_if(epoll->interests.begin(), epoll->interests.end(),
+                           [id](const Epoll::Interest& interest) { return interest.id == id; });
+    switch (op) {
+    case ORBIS_NET_EPOLL_CTL_ADD: {
+        auto file = FDTable::Instance()->GetSocket(id);
+        if (!file) {
+            return ORBIS_NET_ERROR_EBADF;
+        }
+        if (it != epoll->interests.end()) {
+            return ORBIS_NET_ERROR_EEXIST;
+        }
+        Epoll::Interest interest{id, event->events, event->data, std::nullopt};
+        auto native = file->socket->Native();
+        if (native && Reactor::Instance()->Watch(*native, epoll)) {
+            interest.watched = native;
+        }
+        epoll->interests.push_back(interest);
+        return ORBIS_OK;
+    }
+    case ORBIS_NET_EPOLL_CTL_MOD:
+        if (it == epoll->interests.end()) {
+            return ORBIS_NET_ERROR_ENOENT;
+        }
+        it->events = event->events;
+        it->data = event->data;
+        return ORBIS_OK;
+    case ORBIS_NET_EPOLL_CTL_DEL:
+        if (it == epoll->interests.end()) {
+            return ORBIS_NET_ERROR_ENOENT;
+        }
+        if (it->watched) {
+            Reactor::Instance()->Unwatch(*it->watched, epoll.get());
+        }
+        epoll->interests.erase(it);
+        return ORBIS_OK;
+    default:
+        return ORBIS_NET_ERROR_EINVAL;
+    }
+}
+
+int PS4_SYSV_ABI sceNetEpollWait(OrbisNetId eid, OrbisNetEpollEvent* events, int maxevents,
+                                 int timeout) {
+    auto epoll = GetEpoll(eid);
+    if (!epoll) {
+        return ORBIS_NET_ERROR_EBADF;
+    }
+    if (!events || maxevents <= 0) {
+        return ORBIS_NET_ERROR_EINVAL;
+    }
+    NetReactor* reactor = Reactor::Instance();
+    // Reused across waits of the same thread
+    thread_local std::vector<net_pollfd> fds;
+    thread_local std::vector<Epoll::Interest> watched;
+    auto start = Clock::now();
+    for (;;) {
+        // Read the sequence first so a signal after the readiness check still wakes us
+        u64 sequence;
+        bool all_watched = reactor->IsRunning();
+        fds.clear();
+        watched.clear();
+        {
+            std::scoped_lock lock{epoll->mutex};
+            if (epoll->aborted) {
+                epoll->aborted = false;
+                return ORBIS_NET_ERROR_EINTR;
+            }
+            sequence = epoll->sequence;
+            for (const auto& interest : epoll->interests) {
+                auto file = FDTable::Instance()->GetSocket(interest.id);
+                auto native = file ? file->socket->Native() : std::nullopt;
+                if (!native) {
+                    continue;
+                }
+                all_watched &= interest.watched == native;
+                net_pollfd fd{};
+                fd.fd = *native;
+                fd.events = ((interest.events & ORBIS_NET_EPOLLIN) ? POLLIN : 0) |
+                            ((interest.events & ORBIS_NET_EPOLLOUT) ? POLLOUT : 0);
+                fds.push_back(fd);
+                watched.push_back(interest);
+            }
+        }
+        // Level-triggered like the guest expects: readiness is checked on the sockets
+        // themselves, the reactor only tells us when to look again
+        if (!fds.empty() && NetReactor::Poll(fds.data(), fds.size(), 0) > 0) {
+            int count = 0;
+            for (size_t i = 0; i < fds.size() && count < maxevents; i++) {
+                short revents = fds[i].revents;
+                if (!revents) {
+                    continue;
+                }
+                u32 ready = 0;
+                ready |= (revents & POLLIN) ? ORBIS_NET_EPOLLIN : 0;
+                ready |= (revents & POLLOUT) ? ORBIS_NET_EPOLLOUT : 0;
+                ready |= (revents & POLLERR) ? ORBIS_NET_EPOLLERR : 0;
+                ready |= (revents & POLLHUP) ? ORBIS_NET_EPOLLHUP : 0;
+                events[count].events = ready;
+                events[count].reserved = 0;
+                events[count].ident = watched[i].id;
+                events[count].data = watched[i].data;
+                count++;
+            }
+            return count;
+        }
+        // The guest passes its timeout in microseconds, negative waits forever
+        s64 remaining = RemainingUs(timeout, start);
+        if (remaining == 0) {
+            return 0;
+        }
+        if (all_watched) {
+            std::unique_lock lock{epoll->mutex};
+            auto moved = [&] { return epoll->sequence != sequence; };
+            if (remaining < 0) {
+                epoll->changed.wait(lock, moved);
+            } else {
+                epoll->changed.wait_for(lock, std::chrono::microseconds(remaining), moved);
+            }
+        } else {
+            // Nothing wakes a host poll early, so it runs in slices short enough for
+            // sceNetEpollAbort to be seen
+            s64 slice = remaining < 0 ? ABORT_CHECK_US : std::min(remaining, ABORT_CHECK_US);
+            NetReactor::Poll(fds.data(), fds.size(), UsToPollMs(slice));
+        }
+    }
+}
+
+int PS4_SYSV_ABI sceNetEpollAbort(OrbisNetId eid, int flags) {
+    auto epoll = GetEpoll(eid);
+    if (!epoll) {
+        return ORBIS_NET_ERROR_EBADF;
+    }
+    {
+        std::scoped_lock lock{epoll->mutex};
+        epoll->aborted = true;
+    }
+    epoll->Signal();
+    return ORBIS_OK;
+}
+
+int PS4_SYSV_ABI sceNetEpollDestroy(OrbisNetId eid) {
+    auto epoll = GetEpoll(eid);
+    if (!epoll) {
+        return ORBIS_NET_ERROR_EBADF;
+    }
+    {
+        std::scoped_lock lock{epoll->mutex};
+        for (const auto& interest : epoll->interests) {
+            if (interest.watched) {
+                Reactor::Instance()->Unwatch(*interest.watched, epoll.get());
+            }
+        }
+        epoll->interests.clear();
+    }
+    FDTable::Instance()->DeleteHandle(eid);
+    return ORBIS_OK;
+}
+
+} // namespace Libraries::Net
@@ -0,0 +1,150 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "common/types.h"
+#include "net.h"
+#include "sockets.h"
+#ifndef WIN32
+#include <poll.h>
+#endif
+
+namespace Libraries::Net {
+
+constexpr u32 ORBIS_NET_EPOLLIN = 0x00000001;
+constexpr u32 ORBIS_NET_EPOLLOUT = 0x00000002;
+constexpr u32 ORBIS_NET_EPOLLERR = 0x00000008;
+constexpr u32 ORBIS_NET_EPOLLHUP = 0x00000010;
+constexpr u32 ORBIS_NET_EPOLLDESCID = 0x00010000;
+
+enum OrbisNetEpollControl : int {
+    ORBIS_NET_EPOLL_CTL_ADD = 1,
+    ORBIS_NET_EPOLL_CTL_MOD = 2,
+    ORBIS_NET_EPOLL_CTL_DEL = 3,
+};
+
+#ifdef WIN32
+using net_pollfd = WSAPOLLFD;
+#else
+using net_pollfd = pollfd;
+#endif
+
+union OrbisNetEpollData {
+    void* ptr;
+    u32 _u32;
+    int fd;
+    u64 _u64;
+};
+
+struct OrbisNetEpollEvent {
+    u32 events;
+    u32 reserved;
+    u32 ident;
+    OrbisNetEpollData data;
+};
+
+struct Epoll;
+
+// Single host readiness engine for guest sockets. Sockets are watched edge-triggered by
+// one host epoll instance serviced by one thread, which wakes only the guest epolls and
+// blocking calls waiting on the socket that changed, so neither parks inside a host
+// call. Hosts without epoll have no reactor, their waits poll the sockets instead.
+class NetReactor {
+public:
+    NetReactor();
+    ~NetReactor();
+
+    // poll() on every host, retried on EINTR
+    static int Poll(net_pollfd* fds, size_t count, int timeout_ms);
+    static bool SetNonBlocking(net_socket sock);
+
+    bool IsRunning() const;
+    // Signal epoll whenever sock changes. False if the reactor cannot watch it, the
+    // epoll then has to poll. Watching twice is harmless.
+    bool Watch(net_socket sock, const std::shared_ptr<Epoll>& epoll);
+    void Unwatch(net_socket sock, const Epoll* epoll);
+
+    // Blocking-call emulation. Sockets stay in whatever blocking mode they are in, the
+    // socket layer calls SetNonBlocking itself before registering and unregisters on
+    // close. Registering twice is harmless.
+    bool Register(net_socket sock);
+    void Unregister(net_socket sock);
+
+    // Each registered socket counts the readiness edges it has seen. Take the count before
+    // a non-blocking attempt and wait for it to move after the attempt would block, so an
+    // edge arriving in between is never lost.
+    u64 GetSequence(net_socket sock, u32 events);
+    // False on timeout or when the socket is unregistered. timeout_us < 0 waits forever.
+    bool WaitForChange(net_socket sock, u32 events, u64 sequence, s64 timeout_us);
+
+    // Run op until it stops failing with would-block, waiting for readiness in between.
+    // Emulates a blocking host call on a non-blocking socket; on timeout op's last
+    // result is returned with the would-block error still set.
+    int RunBlocking(net_socket sock, u32 events, s64 timeout_us, const std::function<int()>& op);
+
+private:
+    struct Entry {
+        std::vector<std::weak_ptr<Epoll>> epolls;
+        // Set while registered for blocking calls, which wait on changed
+        bool registered = false;
+        bool closed = false;
+        u64 read_sequence = 0;
+        u64 write_sequence = 0;
+        std::condition_variable changed;
+    };
+
+    // Adds sock to the host set if the reactor runs, with mutex held
+    bool AddSocket(net_socket sock);
+    void ReactorThread();
+
+    std::mutex mutex;
+    std::unordered_map<net_socket, std::shared_ptr<Entry>> entries;
+#ifdef __linux__
+    int epoll_fd = -1;
+    // Wakes the reactor thread for shutdown
+    int wake_fd = -1;
+    std::thread thread;
+#endif
+};
+
+// Guest epoll object, lives in the descriptor table as FileType::Epoll
+struct Epoll {
+    struct Interest {
+        OrbisNetId id;
+        u32 events;
+        OrbisNetEpollData data;
+        // Host socket the reactor watches for us, if it does
+        std::optional<net_socket> watched;
+    };
+
+    // Bump the sequence and wake the waiters
+    void Signal();
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    // Counts reactor signals and aborts, waiters sleep until it moves
+    u64 sequence = 0;
+    std::vector<Interest> interests;
+    std::string name;
+    bool aborted = false;
+};
+
+int PS4_SYSV_ABI sceNetEpollCreate(const char* name, int flags);
+int PS4_SYSV_ABI sceNetEpollControl(OrbisNetId eid, int op, OrbisNetId id,
+                                    OrbisNetEpollEvent* event);
+int PS4_SYSV_ABI sceNetEpollWait(OrbisNetId eid, OrbisNetEpollEvent* events, int maxevents,
+                                 int timeout);
+int PS4_SYSV_ABI sceNetEpollAbort(OrbisNetId eid, int flags);
+int PS4_SYSV_ABI sceNetEpollDestroy(OrbisNetId eid);
+
+} // namespace Libraries::Net
@@ -0,0 +1,205 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <array>
+#include "common/types.h"
+#include "core/libraries/kernel/kernel.h"
+#include "net.h"
+#include "net_error.h"
+#include "sockets.h"
+
+// Host to guest translation shared by every socket backend. All lookups are tables built
+// at compile time: a failed call costs one indexed load, which matters for netcode that
+// polls non-blocking sockets and sees EWOULDBLOCK hundreds of thousands of times a second.
+
+namespace Libraries::Net {
+
+#ifdef WIN32
+#define HOST_ERRNO(errname) WSA##errname
+// WinSock error codes start at WSABASEERR, index the table from there
+constexpr int HOST_ERRNO_BASE = WSABASEERR;
+#else
+#define HOST_ERRNO(errname) errname
+constexpr int HOST_ERRNO_BASE = 0;
+#endif
+constexpr int HOST_ERRNO_COUNT = 256;
+
+struct ErrnoMapping {
+    int host;
+    int orbis;
+};
+
+constexpr ErrnoMapping ERRNO_MAPPINGS[] = {
+#ifndef WIN32 // These error codes don't exist in WinSock
+    {EPERM, ORBIS_NET_EPERM},
+    {ENOENT, ORBIS_NET_ENOENT},
+    {ENOMEM, ORBIS_NET_ENOMEM},
+    {EEXIST, ORBIS_NET_EEXIST},
+    {ENODEV, ORBIS_NET_ENODEV},
+    {ENFILE, ORBIS_NET_ENFILE},
+    {ENOSPC, ORBIS_NET_ENOSPC},
+    {EPIPE, ORBIS_NET_EPIPE},
+    {ECANCELED, ORBIS_NET_ECANCELED},
+    {ENODATA, ORBIS_NET_ENODATA},
+#endif
+    {HOST_ERRNO(EINTR), ORBIS_NET_EINTR},
+    {HOST_ERRNO(EBADF), ORBIS_NET_EBADF},
+    {HOST_ERRNO(EACCES), ORBIS_NET_EACCES},
+    {HOST_ERRNO(EFAULT), ORBIS_NET_EFAULT},
+    {HOST_ERRNO(EINVAL), ORBIS_NET_EINVAL},
+    {HOST_ERRNO(EMFILE), ORBIS_NET_EMFILE},
+    {HOST_ERRNO(EWOULDBLOCK), ORBIS_NET_EWOULDBLOCK},
+    // Only listed where it is a code of its own, on Linux it would replace EWOULDBLOCK
+#if !defined(WIN32) && EAGAIN != EWOULDBLOCK
+    {EAGAIN, ORBIS_NET_EAGAIN},
+#endif
+    {HOST_ERRNO(EINPROGRESS), ORBIS_NET_EINPROGRESS},
+    {HOST_ERRNO(EALREADY), ORBIS_NET_EALREADY},
+    {HOST_ERRNO(ENOTSOCK), ORBIS_NET_ENOTSOCK},
+    {HOST_ERRNO(EDESTADDRREQ), ORBIS_NET_EDESTADDRREQ},
+    {HOST_ERRNO(EMSGSIZE), ORBIS_NET_EMSGSIZE},
+    {HOST_ERRNO(EPROTOTYPE), ORBIS_NET_EPROTOTYPE},
+    {HOST_ERRNO(ENOPROTOOPT), ORBIS_NET_ENOPROTOOPT},
+    {HOST_ERRNO(EPROTONOSUPPORT), ORBIS_NET_EPROTONOSUPPORT},
+    {HOST_ERRNO(EOPNOTSUPP), ORBIS_NET_EOPNOTSUPP},
+    {HOST_ERRNO(EAFNOSUPPORT), ORBIS_NET_EAFNOSUPPORT},
+    {HOST_ERRNO(EADDRINUSE), ORBIS_NET_EADDRINUSE},
+    {HOST_ERRNO(EADDRNOTAVAIL), ORBIS_NET_EADDRNOTAVAIL},
+    {HOST_ERRNO(ENETDOWN), ORBIS_NET_ENETDOWN},
+    {HOST_ERRNO(ENETUNREACH), ORBIS_NET_ENETUNREACH},
+    {HOST_ERRNO(ENETRESET), ORBIS_NET_ENETRESET},
+    {HOST_ERRNO(ECONNABORTED), ORBIS_NET_ECONNABORTED},
+    {HOST_ERRNO(ECONNRESET), ORBIS_NET_ECONNRESET},
+    {HOST_ERRNO(ENOBUFS), ORBIS_NET_ENOBUFS},
+    {HOST_ERRNO(EISCONN), ORBIS_NET_EISCONN},
+    {HOST_ERRNO(ENOTCONN), ORBIS_NET_ENOTCONN},
+    {HOST_ERRNO(ETIMEDOUT), ORBIS_NET_ETIMEDOUT},
+    {HOST_ERRNO(ECONNREFUSED), ORBIS_NET_ECONNREFUSED},
+    {HOST_ERRNO(ELOOP), ORBIS_NET_ELOOP},
+    {HOST_ERRNO(ENAMETOOLONG), ORBIS_NET_ENAMETOOLONG},
+    {HOST_ERRNO(EHOSTUNREACH), ORBIS_NET_EHOSTUNREACH},
+    {HOST_ERRNO(ENOTEMPTY), ORBIS_NET_ENOTEMPTY},
+};
+
+#undef HOST_ERRNO
+
+// Indexed by host error minus HOST_ERRNO_BASE, anything unlisted is internal
+constexpr auto ERRNO_TABLE = [] {
+    std::array<u16, HOST_ERRNO_COUNT> table{};
+    table.fill(ORBIS_NET_EINTERNAL);
+    for (const auto& mapping : ERRNO_MAPPINGS) {
+        table[mapping.host - HOST_ERRNO_BASE] = static_cast<u16>(mapping.orbis);
+    }
+    return table;
+}();
+
+constexpr bool ErrnoMappingsFit() {
+    for (const auto& mapping : ERRNO_MAPPINGS) {
+        if (mapping.host < HOST_ERRNO_BASE || mapping.host >= HOST_ERRNO_BASE + HOST_ERRNO_COUNT ||
+            mapping.orbis < 0 || mapping.orbis > 0xFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(ErrnoMappingsFit(), "host error codes must fit the translation table");
+
+// Two entries for one host code would silently let the later one win in ERRNO_TABLE
+constexpr bool ErrnoMappingsUnique() {
+    for (const auto& mapping : ERRNO_MAPPINGS) {
+        int count = 0;
+        for (const auto& other : ERRNO_MAPPINGS) {
+            count += other.host == mapping.host;
+        }
+        if (count != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(ErrnoMappingsUnique(), "each host error code must be mapped once");
+
+// Host error code to ORBIS_NET_E*
+inline int TranslateHostError(int error) {
+    u32 index = static_cast<u32>(error - HOST_ERRNO_BASE);
+    return index < ERRNO_TABLE.size() ? ERRNO_TABLE[index] : ORBIS_NET_EINTERNAL;
+}
+
+// Function to convert return error code
+inline int ConvertReturnErrorCode(int retval) {
+    // if it is 0 or positive return it as it is
+    if (retval >= 0) [[likely]] {
+        return retval;
+    }
+#ifdef WIN32
+    *Libraries::Kernel::__Error() = TranslateHostError(WSAGetLastError());
+#else
+    *Libraries::Kernel::__Error() = TranslateHostError(errno);
+#endif
+    return -1;
+}
+
+struct LevelMapping {
+    int orbis;
+    int host;
+};
+
+constexpr LevelMapping LEVEL_MAPPINGS[] = {
+    {ORBIS_NET_SOL_SOCKET, SOL_SOCKET},
+    {ORBIS_NET_IPPROTO_IP, IPPROTO_IP},
+    {ORBIS_NET_IPPROTO_TCP, IPPROTO_TCP},
+    {ORBIS_NET_IPPROTO_IPV6, IPPROTO_IPV6},
+};
+
+// Function to convert levels, -1 if the host has no such level
+constexpr int ConvertLevels(int level) {
+    for (const auto& mapping : LEVEL_MAPPINGS) {
+        if (mapping.orbis == level) {
+            return mapping.host;
+        }
+    }
+    return -1;
+}
+
+struct OptionMapping {
+    int orbis_level;
+    int orbis_name;
+    int host_name;
+};
+
+// Options whose value passes through unchanged. Timeouts and the guest-only options
+// such as ORBIS_NET_SO_NBIO need their values converted and are left to the backends.
+constexpr OptionMapping OPTION_MAPPINGS[] = {
+    {ORBIS_NET_SOL_SOCKET, ORBIS_NET_SO_REUSEADDR, SO_REUSEADDR},
+    {ORBIS_NET_SOL_SOCKET, ORBIS_NET_SO_KEEPALIVE, SO_KEEPALIVE},
+    {ORBIS_NET_SOL_SOCKET, ORBIS_NET_SO_BROADCAST, SO_BROADCAST},
+    {ORBIS_NET_SOL_SOCKET, ORBIS_NET_SO_LINGER, SO_LINGER},
+    {ORBIS_NET_SOL_SOCKET, ORBIS_NET_SO_SNDBUF, SO_SNDBUF},
+    {ORBIS_NET_SOL_SOCKET, ORBIS_NET_SO_RCVBUF, SO_RCVBUF},
+    {ORBIS_NET_SOL_SOCKET, ORBIS_NET_SO_ERROR, SO_ERROR},
+    {ORBIS_NET_SOL_SOCKET, ORBIS_NET_SO_TYPE, SO_TYPE},
+    {ORBIS_NET_IPPROTO_IP, ORBIS_NET_IP_HDRINCL, IP_HDRINCL},
+    {ORBIS_NET_IPPROTO_IP, ORBIS_NET_IP_TOS, IP_TOS},
+    {ORBIS_NET_IPPROTO_IP, ORBIS_NET_IP_TTL, IP_TTL},
+    {ORBIS_NET_IPPROTO_IP, ORBIS_NET_IP_MULTICAST_IF, IP_MULTICAST_IF},
+    {ORBIS_NET_IPPROTO_IP, ORBIS_NET_IP_MULTICAST_TTL, IP_MULTICAST_TTL},
+    {ORBIS_NET_IPPROTO_IP, ORBIS_NET_IP_MULTICAST_LOOP, IP_MULTICAST_LOOP},
+    {ORBIS_NET_IPPROTO_IP, ORBIS_NET_IP_ADD_MEMBERSHIP, IP_ADD_MEMBERSHIP},
+    {ORBIS_NET_IPPROTO_IP, ORBIS_NET_IP_DROP_MEMBERSHIP, IP_DROP_MEMBERSHIP},
+    {ORBIS_NET_IPPROTO_TCP, ORBIS_NET_TCP_NODELAY, TCP_NODELAY},
+    {ORBIS_NET_IPPROTO_TCP, ORBIS_NET_TCP_MAXSEG, TCP_MAXSEG},
+};
+
+// Host option name for a pass-through option, -1 if it needs special handling
+constexpr int ConvertOption(int level, int optname) {
+    for (const auto& mapping : OPTION_MAPPINGS) {
+        if (mapping.orbis_level == level && mapping.orbis_name == optname) {
+            return mapping.host_name;
+        }
+    }
+    return -1;
+}
+
+} // namespace Libraries::Net
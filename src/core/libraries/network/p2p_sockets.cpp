@@ -1,131 +1,363 @@
 // SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <algorithm>
+#include <cstring>
 #include <common/assert.h>
+#include "common/logging/log.h"
+#include "common/singleton.h"
 #include "core/libraries/kernel/kernel.h"
 #include "net.h"
-#include "neterror.h"
-#include sockets.h"
+#include "net_error.h"
+#include "p2p_transport.h"
+#include "sockets.h"
 
 namespace Libraries::Net {
 
-// P2PSocket class
+using Transport = Common::Singleton<P2PTransport>;
+
+// P2PSocket class, ORBIS_NET_SOCK_DGRAM_P2P and ORBIS_NET_SOCK_STREAM_P2P. Addresses are
+// the peer emulator's host address and UDP port, with the P2P port in sin_vport.
 class P2PSocket {
 public:
+    explicit P2PSocket(int type)
+        : kind{type == ORBIS_NET_SOCK_STREAM_P2P ? P2PKind::Stream : P2PKind::Datagram} {}
+
+    // Check if the socket is valid
+    bool IsValid() const {
+        return true;
+    }
+
     // Close the socket
     int Close() {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
-
- // Return 0 to indicate success
- return 0; 
- }
+        std::scoped_lock lock{m_mutex};
+        if (connection) {
+            connection->Close();
+            connection.reset();
+        }
+        if (port) {
+            Transport::Instance()->Unbind(port);
+            port.reset();
+        }
+        return 0;
+    }
 
     // Set socket options
-    int SetSocketOptions(int level, int optname, const void optval, u32 optlen) {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
-
- // Return 0 to indicate success
- return 0; 
- }
+    int SetSocketOptions(int level, int optname, const void* optval, u32 optlen) {
+        if (level != ORBIS_NET_SOL_SOCKET) {
+            // IP and TCP level options have no meaning on the virtual transport
+            return 0;
+        }
+        if (!optval || optlen < sizeof(int)) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        int value = *static_cast<const int*>(optval);
+        std::scoped_lock lock{m_mutex};
+        switch (optname) {
+        case ORBIS_NET_SO_NBIO:
+            nonblocking = value != 0;
+            return 0;
+        case ORBIS_NET_SO_RCVTIMEO:
+            receive_timeout_us = value > 0 ? value : -1;
+            return 0;
+        case ORBIS_NET_SO_SNDTIMEO:
+            send_timeout_us = value > 0 ? value : -1;
+            return 0;
+        default:
+            // Buffer sizes, reuse and the like are accepted as is
+            return 0;
+        }
+    }
 
     // Get socket options
-    int GetSocketOptions(int level, int optname, void optval, u32 optlen) {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
-
- // Return 0 to indicate success
- return 0; 
- }
+    int GetSocketOptions(int level, int optname, void* optval, u32* optlen) {
+        if (level != ORBIS_NET_SOL_SOCKET || !optval || !optlen || *optlen < sizeof(int)) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        std::scoped_lock lock{m_mutex};
+        int value = 0;
+        switch (optname) {
+        case ORBIS_NET_SO_NBIO:
+            value = nonblocking;
+            break;
+        case ORBIS_NET_SO_TYPE:
+            value = kind == P2PKind::Stream ? ORBIS_NET_SOCK_STREAM_P2P : ORBIS_NET_SOCK_DGRAM_P2P;
+            break;
+        case ORBIS_NET_SO_RCVTIMEO:
+            value = receive_timeout_us < 0 ? 0 : static_cast<int>(receive_timeout_us);
+            break;
+        case ORBIS_NET_SO_SNDTIMEO:
+            value = send_timeout_us < 0 ? 0 : static_cast<int>(send_timeout_us);
+            break;
+        default:
+            break;
+        }
+        *static_cast<int*>(optval) = value;
+        *optlen = sizeof(int);
+        return 0;
+    }
 
     // Bind the socket to a address
-    int Bind(const OrbisNetSockaddr addr, u32 addrlen) {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
-
- // Return 0 to indicate success
- return 0; 
- }
+    int Bind(const OrbisNetSockaddr* addr, u32 addrlen) {
+        if (!addr || addrlen < sizeof(OrbisNetSockaddrIn)) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        std::scoped_lock lock{m_mutex};
+        if (port) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        const auto* in = reinterpret_cast<const OrbisNetSockaddrIn*>(addr);
+        port = Transport::Instance()->Bind(ntohs(in->sin_vport), kind);
+        return port ? 0 : SetError(ORBIS_NET_EADDRINUSE);
+    }
 
     // Listen for incoming connections
     int Listen(int backlog) {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
+        if (kind != P2PKind::Stream) {
+            return SetError(ORBIS_NET_EOPNOTSUPP);
+        }
+        std::scoped_lock lock{m_mutex};
+        if (!port && !BindEphemeral()) {
+            return SetError(ORBIS_NET_EADDRINUSE);
+        }
+        port->Listen(backlog);
+        return 0;
+    }
 
- // Return 0 to indicate success
- return 0; 
- }
+    // Send a message over the socket
+    int SendMessage(const OrbisNetMsghdr* msg, int flags) {
+        if (!msg) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        // Gathered into one datagram, or sent in order on a stream
+        u8 gathered[P2PTransport::MAX_PAYLOAD];
+        u32 total = 0;
+        for (int i = 0; i < msg->msg_iovlen; i++) {
+            const auto& iov = msg->msg_iov[i];
+            if (kind == P2PKind::Stream) {
+                int result = SendPacket(iov.iov_base, static_cast<u32>(iov.iov_len), flags,
+                                        nullptr, 0);
+                if (result < 0) {
+                    return total ? static_cast<int>(total) : result;
+                }
+                total += result;
+                continue;
+            }
+            if (total + iov.iov_len > sizeof(gathered)) {
+                return SetError(ORBIS_NET_EMSGSIZE);
+            }
+            std::memcpy(gathered + total, iov.iov_base, iov.iov_len);
+            total += static_cast<u32>(iov.iov_len);
+        }
+        if (kind == P2PKind::Stream) {
+            return static_cast<int>(total);
+        }
+        return SendPacket(gathered, total, flags,
+                          static_cast<const OrbisNetSockaddr*>(msg->msg_name), msg->msg_namelen);
+    }
 
- // Send a message over the socket
- int SendMessage(const OrbisNetMsghdr msg, int flags) {
- // Log an error message
- LOGERROR(LibNet, "( STUBBED) called");
+    // Send a packet over the socket
+    int SendPacket(const void* msg, u32 len, int flags, const OrbisNetSockaddr* to, u32 tolen) {
+        std::unique_lock lock{m_mutex};
+        bool dontwait = nonblocking || (flags & ORBIS_NET_MSG_DONTWAIT);
+        if (kind == P2PKind::Stream) {
+            auto stream = connection;
+            if (!stream) {
+                return SetError(ORBIS_NET_ENOTCONN);
+            }
+            s64 timeout = send_timeout_us;
+            lock.unlock();
+            return Result(stream->Send(msg, len, dontwait, timeout));
+        }
+        P2PAddress destination = default_peer;
+        if (to) {
+            if (tolen < sizeof(OrbisNetSockaddrIn)) {
+                return SetError(ORBIS_NET_EINVAL);
+            }
+            destination = ToAddress(reinterpret_cast<const OrbisNetSockaddrIn*>(to));
+        } else if (!has_default_peer) {
+            return SetError(ORBIS_NET_EDESTADDRREQ);
+        }
+        if (!port && !BindEphemeral()) {
+            return SetError(ORBIS_NET_EADDRINUSE);
+        }
+        return Result(Transport::Instance()->SendTo(*port, destination, msg, len));
+    }
 
-        // Set an error code and return -1 to indicate failure
-        Libraries::Kernel::Error() = ORBISNETEAGAIN;
-        return -1;
+    // Receive a message from the socket
+    int ReceiveMessage(OrbisNetMsghdr* msg, int flags) {
+        if (!msg || msg->msg_iovlen < 1) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        // Scattering is left to the first buffer, which is what games pass
+        u32 namelen = msg->msg_namelen;
+        int result = ReceivePacket(msg->msg_iov[0].iov_base,
+                                   static_cast<u32>(msg->msg_iov[0].iov_len), flags,
+                                   static_cast<OrbisNetSockaddr*>(msg->msg_name), &namelen);
+        msg->msg_namelen = namelen;
+        return result;
     }
 
-    // Send a packet over the socket
-    int SendPacket(const void msg, u32 len, int flags, const OrbisNetSockaddr to, u32 tolen) {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
+    // Receive a packet from the socket
+    int ReceivePacket(void* buf, u32 len, int flags, OrbisNetSockaddr* from, u32* fromlen) {
+        std::unique_lock lock{m_mutex};
+        bool dontwait = nonblocking || (flags & ORBIS_NET_MSG_DONTWAIT);
+        bool peek = flags & ORBIS_NET_MSG_PEEK;
+        s64 timeout = receive_timeout_us;
+        if (kind == P2PKind::Stream) {
+            auto stream = connection;
+            lock.unlock();
+            if (!stream) {
+                return SetError(ORBIS_NET_ENOTCONN);
+            }
+            if (from && fromlen) {
+                FromAddress(stream->GetPeer(), from, fromlen);
+            }
+            return Result(stream->Receive(buf, len, peek, dontwait, timeout));
+        }
+        if (!port && !BindEphemeral()) {
+            return SetError(ORBIS_NET_EADDRINUSE);
+        }
+        auto bound = port;
+        lock.unlock();
+        P2PAddress source{};
+        int result = bound->ReceiveFrom(buf, len, &source, peek, dontwait, timeout);
+        if (result >= 0 && from && fromlen) {
+            FromAddress(source, from, fromlen);
+        }
+        return Result(result);
+    }
 
-        // Set an error code and return -1 to indicate failure
-        Libraries::Kernel::Error() = ORBISNETEAGAIN;
-        return -1;
+    // Accept an incoming connection
+    std::shared_ptr<P2PSocket> Accept(OrbisNetSockaddr* addr, u32* addrlen) {
+        std::unique_lock lock{m_mutex};
+        if (kind != P2PKind::Stream || !port) {
+            SetError(ORBIS_NET_EINVAL);
+            return nullptr;
+        }
+        auto listener = port;
+        bool dontwait = nonblocking;
+        s64 timeout = receive_timeout_us;
+        lock.unlock();
+        int error = 0;
+        auto accepted = listener->Accept(dontwait, timeout, &error);
+        if (!accepted) {
+            SetError(-error);
+            return nullptr;
+        }
+        auto socket = std::make_shared<P2PSocket>(ORBIS_NET_SOCK_STREAM_P2P);
+        socket->connection = accepted;
+        if (addr && addrlen) {
+            FromAddress(accepted->GetPeer(), addr, addrlen);
+        }
+        return socket;
     }
 
-    // Receive a message from the socket
-    int ReceiveMessage(OrbisNetMsghdr msg, int flags) {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
+    // Connect to a remote address
+    int Connect(const OrbisNetSockaddr* addr, u32 namelen) {
+        if (!addr || namelen < sizeof(OrbisNetSockaddrIn)) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        P2PAddress peer = ToAddress(reinterpret_cast<const OrbisNetSockaddrIn*>(addr));
+        std::unique_lock lock{m_mutex};
+        if (kind == P2PKind::Datagram) {
+            // Only sets the default destination
+            default_peer = peer;
+            has_default_peer = true;
+            return 0;
+        }
+        if (connection) {
+            return SetError(ORBIS_NET_EISCONN);
+        }
+        if (!port && !BindEphemeral()) {
+            return SetError(ORBIS_NET_EADDRINUSE);
+        }
+        auto stream = Transport::Instance()->Connect(*port, peer);
+        if (!stream) {
+            return SetError(ORBIS_NET_EADDRINUSE);
+        }
+        connection = stream;
+        if (nonblocking) {
+            return SetError(ORBIS_NET_EINPROGRESS);
+        }
+        lock.unlock();
+        return Result(stream->WaitConnected(-1));
+    }
 
-        // Set an error code and return -1 to indicate failure
-        Libraries::Kernel::Error() = ORBISNETEAGAIN;
-        return -1;
+    // Get the socket address
+    int GetSocketAddress(OrbisNetSockaddr* name, u32* namelen) {
+        if (!name || !namelen) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        std::scoped_lock lock{m_mutex};
+        u16 vport = port ? port->GetPort() : connection ? connection->GetLocalPort() : 0;
+        FromAddress({0, Transport::Instance()->GetHostPort(), vport}, name, namelen);
+        return 0;
     }
 
-    // Receive a packet from the socket
-    int ReceivePacket(void buf, u32 len, int flags, OrbisNetSockaddr from, u32 fromlen) {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
+    // Get the peer name
+    int GetPeerName(OrbisNetSockaddr* addr, u32* namelen) {
+        if (!addr || !namelen) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        std::scoped_lock lock{m_mutex};
+        if (connection) {
+            FromAddress(connection->GetPeer(), addr, namelen);
+            return 0;
+        }
+        if (has_default_peer) {
+            FromAddress(default_peer, addr, namelen);
+            return 0;
+        }
+        return SetError(ORBIS_NET_ENOTCONN);
+    }
 
-        // Set an error code and return -1 to indicate failure
-        Libraries::Kernel::Error() = ORBISNETEAGAIN;
-        return -1;
+    // P2P sockets share the transport's host socket, they have none of their own
+    std::optional<net_socket> Native() {
+        return std::nullopt;
     }
 
-    // Accept an incoming connection
-    SocketPtr Accept(OrbisNetSockaddr addr, u32 addrlen) {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
+private:
+    static int SetError(int error) {
+        *Libraries::Kernel::__Error() = error;
+        return -1;
+    }
 
-        // Set an error code and return nullptr to indicate failure
-        Libraries::Kernel::Error() = ORBISNETEAGAIN;
-        return nullptr;
+    // Transport results are byte counts or negative ORBIS_NET_E* errors
+    static int Result(int result) {
+        return result < 0 ? SetError(-result) : result;
     }
 
- // Connect to a remote address
- int Connect(const OrbisNetSockaddr addr, u32 namelen) {
- // Log an error message
- LOGERROR(LibNet, "( STUBBED) called");
+    static P2PAddress ToAddress(const OrbisNetSockaddrIn* in) {
+        return {ntohl(in->sin_addr), ntohs(in->sin_port), ntohs(in->sin_vport)};
+    }
 
- // Return 0 to indicate success
- return 0; 
- }
+    static void FromAddress(const P2PAddress& address, OrbisNetSockaddr* out, u32* outlen) {
+        OrbisNetSockaddrIn in{};
+        in.sin_len = sizeof(in);
+        in.sin_family = ORBIS_NET_AF_INET;
+        in.sin_port = htons(address.port);
+        in.sin_addr = htonl(address.ip);
+        in.sin_vport = htons(address.vport);
+        std::memcpy(out, &in, std::min<u32>(*outlen, sizeof(in)));
+        *outlen = sizeof(in);
+    }
 
-    // Get the socket address
-    int GetSocketAddress(OrbisNetSockaddr name, u32 namelen) {
-        // Log an error message
-        LOGERROR(LibNet, "(STUBBED) called");
+    // Called with m_mutex held
+    bool BindEphemeral() {
+        port = Transport::Instance()->Bind(0, kind);
+        return port != nullptr;
+    }
 
- // Return 0 to indicate success
- return 0; 
- }
+    const P2PKind kind;
+    std::mutex m_mutex;
+    std::shared_ptr<P2PPort> port;
+    std::shared_ptr<P2PConnection> connection;
+    P2PAddress default_peer{};
+    bool has_default_peer = false;
+    bool nonblocking = false;
+    s64 receive_timeout_us = -1;
+    s64 send_timeout_us = -1;
+};
 
-    // Get the peer name
-    int GetPeerName(OrbisNetSockaddr addr, u32* namelen) {
-        // Log an error message
-        LOGERROR(Lib_Net
+} // namespace Libraries::Net
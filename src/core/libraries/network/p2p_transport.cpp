@@ -0,0 +1,769 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include "common/logging/log.h"
+#include "net_error.h"
+#include "p2p_transport.h"
+
+namespace Libraries::Net {
+
+using Core::Networking::AllocPacket;
+using Core::Networking::FreePacket;
+using Clock = std::chrono::steady_clock;
+
+// Wire header in front of every P2P packet, big endian
+constexpr u32 HEADER_SIZE = 12;
+constexpr u16 HEADER_MAGIC = 0x5032;
+
+enum P2PPacketType : u8 {
+    P2P_DATAGRAM = 0,
+    P2P_SYN = 1,
+    P2P_SYN_ACK = 2,
+    P2P_DATA = 3,
+    P2P_ACK = 4,
+    P2P_RST = 5,
+};
+
+constexpr u8 P2P_FLAG_FIN = 0x01;
+// ACKs carry the receiver's free queue slots after the header, big endian
+constexpr u32 ACK_WINDOW_SIZE = 2;
+
+// Segments in flight per connection, and packets queued per receiver before new ones
+// are dropped (datagrams) or refused through the advertised window (streams)
+constexpr size_t SEND_WINDOW = 64;
+constexpr size_t MAX_QUEUED = 256;
+// Loopback and LAN round trips are far below these
+constexpr auto RETRANSMIT_TIMEOUT = std::chrono::milliseconds(100);
+constexpr auto TIMER_INTERVAL = std::chrono::milliseconds(20);
+constexpr u32 MAX_RETRIES = 20;
+// Host ports tried after the preferred one, for more instances on one host
+constexpr u16 HOST_PORT_ATTEMPTS = 16;
+
+#ifdef WIN32
+using HostSocket = SOCKET;
+
+static void CloseHostSocket(intptr_t sock) {
+    closesocket(static_cast<HostSocket>(sock));
+}
+
+static bool SetNonBlocking(HostSocket sock) {
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+}
+#else
+using HostSocket = int;
+
+static void CloseHostSocket(intptr_t sock) {
+    close(static_cast<HostSocket>(sock));
+}
+
+static bool SetNonBlocking(HostSocket sock) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+#endif
+
+static void WriteHeader(u8* data, u8 type, u8 flags, u16 src_vport, u16 dst_vport, u32 seq) {
+    data[0] = HEADER_MAGIC >> 8;
+    data[1] = HEADER_MAGIC & 0xFF;
+    data[2] = type;
+    data[3] = flags;
+    data[4] = static_cast<u8>(src_vport >> 8);
+    data[5] = static_cast<u8>(src_vport);
+    data[6] = static_cast<u8>(dst_vport >> 8);
+    data[7] = static_cast<u8>(dst_vport);
+    data[8] = static_cast<u8>(seq >> 24);
+    data[9] = static_cast<u8>(seq >> 16);
+    data[10] = static_cast<u8>(seq >> 8);
+    data[11] = static_cast<u8>(seq);
+}
+
+static bool SeqBefore(u32 a, u32 b) {
+    return static_cast<s32>(a - b) < 0;
+}
+
+// timeout_us < 0 waits forever; false on timeout
+template <typename Predicate>
+static bool WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                      s64 timeout_us, Predicate predicate) {
+    if (timeout_us < 0) {
+        cv.wait(lock, predicate);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::microseconds(timeout_us), predicate);
+}
+
+P2PConnection::~P2PConnection() {
+    for (PacketBuffer* packet : unacked) {
+        FreePacket(packet);
+    }
+    for (PacketBuffer* packet : received) {
+        FreePacket(packet);
+    }
+}
+
+int P2PConnection::StateError() const {
+    switch (state) {
+    case State::Connecting:
+        return -ORBIS_NET_ENOTCONN;
+    case State::Refused:
+        return -ORBIS_NET_ECONNREFUSED;
+    case State::TimedOut:
+        return -ORBIS_NET_ETIMEDOUT;
+    case State::Reset:
+        return -ORBIS_NET_ECONNRESET;
+    default:
+        return 0;
+    }
+}
+
+u16 P2PConnection::ReceiveWindow() const {
+    return static_cast<u16>(MAX_QUEUED - std::min(received.size(), MAX_QUEUED));
+}
+
+int P2PConnection::Send(const void* data, u32 size, bool nonblocking, s64 timeout_us) {
+    const u8* bytes = static_cast<const u8*>(data);
+    u32 sent = 0;
+    std::unique_lock lock{mutex};
+    while (sent < size) {
+        auto can_send = [this] {
+            return state != State::Established || local_closed ||
+                   unacked.size() < std::min<size_t>(SEND_WINDOW, peer_window);
+        };
+        if (!can_send() && (nonblocking || !WaitUntil(changed, lock, timeout_us, can_send))) {
+            return sent ? static_cast<int>(sent) : -ORBIS_NET_EAGAIN;
+        }
+        if (local_closed) {
+            return -ORBIS_NET_EPIPE;
+        }
+        if (state != State::Established) {
+            return sent ? static_cast<int>(sent) : StateError();
+        }
+        u32 chunk = std::min(size - sent, P2PTransport::MAX_PAYLOAD);
+        PacketBuffer* packet = AllocPacket();
+        packet->seq = next_seq++;
+        WriteHeader(packet->data, P2P_DATA, 0, local_vport, peer.vport, packet->seq);
+        std::memcpy(packet->data + HEADER_SIZE, bytes + sent, chunk);
+        packet->size = HEADER_SIZE + chunk;
+        if (unacked.empty()) {
+            last_transmit = Clock::now();
+            retries = 0;
+        }
+        unacked.push_back(packet);
+        transport->Transmit(peer, packet);
+        sent += chunk;
+    }
+    return static_cast<int>(sent);
+}
+
+int P2PConnection::Receive(void* buffer, u32 size, bool peek, bool nonblocking,
+                           s64 timeout_us) {
+    std::unique_lock lock{mutex};
+    auto readable = [this] {
+        return !received.empty() || peer_finished || local_closed ||
+               (state != State::Established && state != State::Connecting);
+    };
+    if (!readable() && (nonblocking || !WaitUntil(changed, lock, timeout_us, readable))) {
+        return -ORBIS_NET_EAGAIN;
+    }
+    if (received.empty()) {
+        // Orderly shutdown reads as end of stream
+        return peer_finished || local_closed ? 0 : StateError();
+    }
+    u8* out = static_cast<u8*>(buffer);
+    u32 copied = 0;
+    for (size_t i = 0; i < received.size() && copied < size;) {
+        PacketBuffer* packet = received[i];
+        u32 take = std::min(packet->size - packet->offset, size - copied);
+        std::memcpy(out + copied, packet->data + packet->offset, take);
+        copied += take;
+        if (peek) {
+            i++;
+            continue;
+        }
+        packet->offset += take;
+        if (packet->offset == packet->size) {
+            received.pop_front();
+            FreePacket(packet);
+        }
+    }
+    // Reopen a window the sender is stalled on without waiting for its probe
+    if (state == State::Established && advertised_window < SEND_WINDOW &&
+        ReceiveWindow() >= advertised_window + SEND_WINDOW / 2) {
+        advertised_window = ReceiveWindow();
+        transport->SendAck(peer, local_vport, peer.vport, receive_next, advertised_window);
+    }
+    return static_cast<int>(copied);
+}
+
+void P2PConnection::Close() {
+    std::scoped_lock lock{mutex};
+    if (local_closed) {
+        return;
+    }
+    local_closed = true;
+    if (state == State::Established) {
+        // FIN takes a sequence number so it arrives after everything sent before it
+        PacketBuffer* packet = AllocPacket();
+        packet->seq = next_seq++;
+        WriteHeader(packet->data, P2P_DATA, P2P_FLAG_FIN, local_vport, peer.vport, packet->seq);
+        packet->size = HEADER_SIZE;
+        if (unacked.empty()) {
+            last_transmit = Clock::now();
+            retries = 0;
+        }
+        unacked.push_back(packet);
+        transport->Transmit(peer, packet);
+    }
+    for (PacketBuffer* packet : received) {
+        FreePacket(packet);
+    }
+    received.clear();
+    changed.notify_all();
+}
+
+int P2PConnection::WaitConnected(s64 timeout_us) {
+    std::unique_lock lock{mutex};
+    if (!WaitUntil(changed, lock, timeout_us, [this] { return state != State::Connecting; })) {
+        return -ORBIS_NET_ETIMEDOUT;
+    }
+    return StateError();
+}
+
+P2PPort::~P2PPort() {
+    for (PacketBuffer* packet : datagrams) {
+        FreePacket(packet);
+    }
+}
+
+int P2PPort::ReceiveFrom(void* buffer, u32 size, P2PAddress* from, bool peek, bool nonblocking,
+                         s64 timeout_us) {
+    std::unique_lock lock{mutex};
+    auto readable = [this] { return !datagrams.empty() || closed; };
+    if (!readable() && (nonblocking || !WaitUntil(changed, lock, timeout_us, readable))) {
+        return -ORBIS_NET_EAGAIN;
+    }
+    if (datagrams.empty()) {
+        return -ORBIS_NET_EBADF;
+    }
+    PacketBuffer* packet = datagrams.front();
+    u32 copied = std::min(packet->size - packet->offset, size);
+    std::memcpy(buffer, packet->data + packet->offset, copied);
+    if (from) {
+        *from = {packet->address, packet->port, packet->vport};
+    }
+    if (!peek) {
+        datagrams.pop_front();
+        lock.unlock();
+        FreePacket(packet);
+    }
+    return static_cast<int>(copied);
+}
+
+std::shared_ptr<P2PConnection> P2PPort::Accept(bool nonblocking, s64 timeout_us, int* error) {
+    std::unique_lock lock{mutex};
+    auto ready = [this] { return !pending.empty() || closed; };
+    if (!ready() && (nonblocking || !WaitUntil(changed, lock, timeout_us, ready))) {
+        *error = -ORBIS_NET_EAGAIN;
+        return nullptr;
+    }
+    if (pending.empty()) {
+        *error = -ORBIS_NET_EBADF;
+        return nullptr;
+    }
+    auto connection = std::move(pending.front());
+    pending.pop_front();
+    return connection;
+}
+
+void P2PPort::Listen(int backlog_) {
+    std::scoped_lock lock{mutex};
+    backlog = std::max(backlog_, 1);
+}
+
+P2PTransport::~P2PTransport() {
+    Stop();
+}
+
+bool P2PTransport::Start(u16 preferred_port) {
+    std::scoped_lock lock{start_mutex};
+    if (running) {
+        return true;
+    }
+    HostSocket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    bool bound = false;
+    for (u16 attempt = 0; attempt < HOST_PORT_ATTEMPTS && !bound; attempt++) {
+        address.sin_port = htons(static_cast<u16>(preferred_port + attempt));
+        bound = bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    }
+    socklen_t address_size = sizeof(address);
+    if (!bound || !SetNonBlocking(sock) ||
+        getsockname(sock, reinterpret_cast<sockaddr*>(&address), &address_size) != 0) {
+        LOG_ERROR(Lib_Net, "could not open the P2P host socket near port {}", preferred_port);
+        CloseHostSocket(static_cast<intptr_t>(sock));
+        return false;
+    }
+    host_socket = static_cast<intptr_t>(sock);
+    host_port = ntohs(address.sin_port);
+    running = true;
+    io_thread = std::thread(&P2PTransport::IoThread, this);
+    LOG_INFO(Lib_Net, "P2P transport on UDP port {}", host_port);
+    return true;
+}
+
+void P2PTransport::Stop() {
+    std::scoped_lock start_lock{start_mutex};
+    if (!running.exchange(false)) {
+        return;
+    }
+    // An empty datagram to ourselves ends the I/O thread's poll
+    sockaddr_in self{};
+    self.sin_family = AF_INET;
+    self.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    self.sin_port = htons(host_port);
+    sendto(static_cast<HostSocket>(host_socket), "", 0, 0, reinterpret_cast<sockaddr*>(&self),
+           sizeof(self));
+    io_thread.join();
+    CloseHostSocket(host_socket);
+    host_socket = -1;
+
+    std::scoped_lock lock{mutex};
+    for (auto& [key, port] : ports) {
+        std::scoped_lock port_lock{port->mutex};
+        port->closed = true;
+        port->changed.notify_all();
+    }
+    ports.clear();
+    for (auto& [key, connection] : connections) {
+        std::scoped_lock connection_lock{connection->mutex};
+        connection->state = P2PConnection::State::Reset;
+        connection->changed.notify_all();
+    }
+    connections.clear();
+}
+
+std::shared_ptr<P2PPort> P2PTransport::Bind(u16 vport, P2PKind kind) {
+    if (!running && !Start()) {
+        return nullptr;
+    }
+    std::scoped_lock lock{mutex};
+    if (vport == 0) {
+        for (u32 tries = 0; tries < 16384; tries++) {
+            u16 candidate = next_ephemeral;
+            next_ephemeral = next_ephemeral == 0xFFFF ? 49152 : next_ephemeral + 1;
+            if (!ports.contains(PortKey(candidate, kind))) {
+                vport = candidate;
+                break;
+            }
+        }
+        if (vport == 0) {
+            return nullptr;
+        }
+    }
+    auto& slot = ports[PortKey(vport, kind)];
+    if (slot) {
+        return nullptr;
+    }
+    slot = std::shared_ptr<P2PPort>(new P2PPort(vport, kind));
+    return slot;
+}
+
+void P2PTransport::Unbind(const std::shared_ptr<P2PPort>& port) {
+    {
+        std::scoped_lock lock{mutex};
+        auto it = ports.find(PortKey(port->vport, port->kind));
+        if (it != ports.end() && it->second == port) {
+            ports.erase(it);
+        }
+    }
+    std::deque<std::shared_ptr<P2PConnection>> refused;
+    {
+        std::scoped_lock lock{port->mutex};
+        port->closed = true;
+        for (PacketBuffer* packet : port->datagrams) {
+            FreePacket(packet);
+        }
+        port->datagrams.clear();
+        refused.swap(port->pending);
+        port->changed.notify_all();
+    }
+    // Connections nobody accepted are reset, the peer sees them refused
+    for (auto& connection : refused) {
+        {
+            std::scoped_lock lock{connection->mutex};
+            connection->state = P2PConnection::State::Reset;
+        }
+        SendControl(connection->peer, P2P_RST, 0, connection->local_vport, connection->peer.vport,
+                    0);
+        std::scoped_lock lock{mutex};
+        connections.erase(KeyOf(*connection));
+    }
+}
+
+int P2PTransport::SendTo(const P2PPort& port, const P2PAddress& to, const void* data,
+                         u32 size) {
+    if (size > MAX_PAYLOAD) {
+        return -ORBIS_NET_EMSGSIZE;
+    }
+    PacketBuffer* packet = AllocPacket();
+    WriteHeader(packet->data, P2P_DATAGRAM, 0, port.vport, to.vport, 0);
+    std::memcpy(packet->data + HEADER_SIZE, data, size);
+    packet->size = HEADER_SIZE + size;
+    Transmit(to, packet);
+    FreePacket(packet);
+    return static_cast<int>(size);
+}
+
+std::shared_ptr<P2PConnection> P2PTransport::Connect(const P2PPort& port, const P2PAddress& to) {
+    auto connection = std::shared_ptr<P2PConnection>(
+        new P2PConnection(this, port.vport, to, P2PConnection::State::Connecting));
+    {
+        std::scoped_lock lock{mutex};
+        auto& slot = connections[KeyOf(*connection)];
+        if (slot) {
+            return nullptr;
+        }
+        slot = connection;
+    }
+    {
+        std::scoped_lock lock{connection->mutex};
+        connection->last_transmit = Clock::now();
+    }
+    SendControl(to, P2P_SYN, 0, port.vport, to.vport, 0);
+    return connection;
+}
+
+void P2PTransport::Transmit(const P2PAddress& to, const PacketBuffer* packet) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(to.ip);
+    address.sin_port = htons(to.port);
+    // A full host buffer drops the packet, datagrams are unreliable and streams resend
+    sendto(static_cast<HostSocket>(host_socket), reinterpret_cast<const char*>(packet->data),
+           static_cast<int>(packet->size), 0, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address));
+}
+
+void P2PTransport::SendControl(const P2PAddress& to, u8 type, u8 flags, u16 src_vport,
+                               u16 dst_vport, u32 seq) {
+    PacketBuffer* packet = AllocPacket();
+    WriteHeader(packet->data, type, flags, src_vport, dst_vport, seq);
+    packet->size = HEADER_SIZE;
+    Transmit(to, packet);
+    FreePacket(packet);
+}
+
+void P2PTransport::SendAck(const P2PAddress& to, u16 src_vport, u16 dst_vport, u32 ack,
+                           u16 window) {
+    PacketBuffer* packet = AllocPacket();
+    WriteHeader(packet->data, P2P_ACK, 0, src_vport, dst_vport, ack);
+    packet->data[HEADER_SIZE] = static_cast<u8>(window >> 8);
+    packet->data[HEADER_SIZE + 1] = static_cast<u8>(window);
+    packet->size = HEADER_SIZE + ACK_WINDOW_SIZE;
+    Transmit(to, packet);
+    FreePacket(packet);
+}
+
+void P2PTransport::IoThread() {
+#ifdef WIN32
+    WSAPOLLFD fd{};
+#else
+    pollfd fd{};
+#endif
+    fd.fd = static_cast<HostSocket>(host_socket);
+    fd.events = POLLIN;
+    auto next_timers = Clock::now() + TIMER_INTERVAL;
+    while (running.load(std::memory_order_acquire)) {
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_timers -
+                                                                          Clock::now());
+        int timeout_ms = static_cast<int>(std::max<s64>(wait.count(), 0));
+#ifdef WIN32
+        WSAPoll(&fd, 1, timeout_ms);
+#else
+        poll(&fd, 1, timeout_ms);
+#endif
+        for (;;) {
+            // Received straight into a pooled buffer that is queued without a copy
+            PacketBuffer* packet = AllocPacket();
+            sockaddr_in from{};
+            socklen_t from_size = sizeof(from);
+            int result = recvfrom(static_cast<HostSocket>(host_socket),
+                                  reinterpret_cast<char*>(packet->data), PacketBuffer::CAPACITY,
+                                  0, reinterpret_cast<sockaddr*>(&from), &from_size);
+            if (result < 0) {
+                FreePacket(packet);
+                break;
+            }
+            packet->size = static_cast<u32>(result);
+            packet->address = ntohl(from.sin_addr.s_addr);
+            packet->port = ntohs(from.sin_port);
+            HandlePacket(packet);
+        }
+        if (Clock::now() >= next_timers) {
+            RunTimers();
+            next_timers = Clock::now() + TIMER_INTERVAL;
+        }
+    }
+}
+
+void P2PTransport::HandlePacket(PacketBuffer* packet) {
+    const u8* data = packet->data;
+    if (packet->size < HEADER_SIZE || ((data[0] << 8) | data[1]) != HEADER_MAGIC) {
+        FreePacket(packet);
+        return;
+    }
+    u8 type = data[2];
+    u8 flags = data[3];
+    u16 src_vport = static_cast<u16>((data[4] << 8) | data[5]);
+    u16 dst_vport = static_cast<u16>((data[6] << 8) | data[7]);
+    u32 seq = (static_cast<u32>(data[8]) << 24) | (data[9] << 16) | (data[10] << 8) | data[11];
+    packet->vport = src_vport;
+    packet->seq = seq;
+    packet->offset = HEADER_SIZE;
+    if (type != P2P_DATAGRAM) {
+        HandleStream(packet, type, flags, src_vport, dst_vport, seq);
+        return;
+    }
+
+    std::shared_ptr<P2PPort> port;
+    {
+        std::scoped_lock lock{mutex};
+        auto it = ports.find(PortKey(dst_vport, P2PKind::Datagram));
+        if (it != ports.end()) {
+            port = it->second;
+        }
+    }
+    if (port) {
+        std::scoped_lock lock{port->mutex};
+        if (!port->closed && port->datagrams.size() < MAX_QUEUED) {
+            port->datagrams.push_back(packet);
+            port->changed.notify_one();
+            return;
+        }
+    }
+    FreePacket(packet);
+}
+
+void P2PTransport::HandleStream(PacketBuffer* packet, u8 type, u8 flags, u16 src_vport,
+                                u16 dst_vport, u32 seq) {
+    const P2PAddress peer{packet->address, packet->port, src_vport};
+    const ConnectionKey key{peer.ip, peer.port, src_vport, dst_vport};
+    std::shared_ptr<P2PConnection> connection;
+    std::shared_ptr<P2PPort> listener;
+    {
+        std::scoped_lock lock{mutex};
+        auto it = connections.find(key);
+        if (it != connections.end()) {
+            connection = it->second;
+        } else if (type == P2P_SYN) {
+            auto port = ports.find(PortKey(dst_vport, P2PKind::Stream));
+            if (port != ports.end()) {
+                listener = port->second;
+            }
+        }
+    }
+
+    switch (type) {
+    case P2P_SYN: {
+        if (connection) {
+            // Our SYN_ACK was lost, the connection already exists
+            SendControl(peer, P2P_SYN_ACK, 0, dst_vport, src_vport, 0);
+            break;
+        }
+        bool accepted = false;
+        bool full = false;
+        if (listener) {
+            std::scoped_lock lock{listener->mutex};
+            if (!listener->closed && listener->backlog > 0) {
+                if (listener->pending.size() >= static_cast<size_t>(listener->backlog)) {
+                    // Dropped, the peer's SYN retransmission tries again
+                    full = true;
+                } else {
+                    connection = std::shared_ptr<P2PConnection>(new P2PConnection(
+                        this, dst_vport, peer, P2PConnection::State::Established));
+                    {
+                        std::scoped_lock table_lock{mutex};
+                        connections[key] = connection;
+                    }
+                    listener->pending.push_back(connection);
+                    listener->changed.notify_one();
+                    accepted = true;
+                }
+            }
+        }
+        if (accepted) {
+            SendControl(peer, P2P_SYN_ACK, 0, dst_vport, src_vport, 0);
+        } else if (!full) {
+            SendControl(peer, P2P_RST, 0, dst_vport, src_vport, 0);
+        }
+        break;
+    }
+    case P2P_SYN_ACK:
+        if (connection) {
+            std::scoped_lock lock{connection->mutex};
+            if (connection->state == P2PConnection::State::Connecting) {
+                connection->state = P2PConnection::State::Established;
+                connection->retries = 0;
+                connection->changed.notify_all();
+            }
+        }
+        break;
+    case P2P_RST:
+        if (connection) {
+            {
+                std::scoped_lock lock{connection->mutex};
+                connection->state = connection->state == P2PConnection::State::Connecting
+                                        ? P2PConnection::State::Refused
+                                        : P2PConnection::State::Reset;
+                connection->changed.notify_all();
+            }
+            std::scoped_lock lock{mutex};
+            connections.erase(key);
+        }
+        break;
+    case P2P_DATA: {
+        if (!connection) {
+            SendControl(peer, P2P_RST, 0, dst_vport, src_vport, 0);
+            break;
+        }
+        u32 ack;
+        u16 window;
+        {
+            std::scoped_lock lock{connection->mutex};
+            // Only the next segment in order is taken, go-back-N resends the rest. A FIN
+            // takes no queue slot, so a full queue does not hold it back.
+            bool fits = connection->received.size() < MAX_QUEUED || packet->size == HEADER_SIZE;
+            if (seq == connection->receive_next && fits) {
+                connection->receive_next++;
+                if (flags & P2P_FLAG_FIN) {
+                    connection->peer_finished = true;
+                } else if (!connection->local_closed && packet->size > HEADER_SIZE) {
+                    connection->received.push_back(packet);
+                    packet = nullptr;
+                }
+                connection->changed.notify_all();
+            }
+            ack = connection->receive_next;
+            window = connection->ReceiveWindow();
+            connection->advertised_window = window;
+        }
+        SendAck(peer, dst_vport, src_vport, ack, window);
+        break;
+    }
+    case P2P_ACK:
+        if (connection) {
+            u16 window = 0xFFFF;
+            if (packet->size >= HEADER_SIZE + ACK_WINDOW_SIZE) {
+                window = static_cast<u16>((packet->data[HEADER_SIZE] << 8) |
+                                          packet->data[HEADER_SIZE + 1]);
+            }
+            std::scoped_lock lock{connection->mutex};
+            bool reopened = window > connection->peer_window;
+            connection->peer_window = window;
+            bool progressed = false;
+            while (!connection->unacked.empty() &&
+                   SeqBefore(connection->unacked.front()->seq, seq)) {
+                FreePacket(connection->unacked.front());
+                connection->unacked.pop_front();
+                progressed = true;
+            }
+            if (progressed || window == 0) {
+                // A zero window answers our probe: the peer is there, only its queue is full
+                connection->retries = 0;
+                connection->last_transmit = Clock::now();
+            }
+            if (progressed || reopened) {
+                connection->changed.notify_all();
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    FreePacket(packet);
+}
+
+void P2PTransport::RunTimers() {
+    std::vector<std::shared_ptr<P2PConnection>> live;
+    {
+        std::scoped_lock lock{mutex};
+        live.reserve(connections.size());
+        for (auto& [key, connection] : connections) {
+            live.push_back(connection);
+        }
+    }
+    auto now = Clock::now();
+    std::vector<std::shared_ptr<P2PConnection>> finished;
+    for (auto& connection : live) {
+        std::scoped_lock lock{connection->mutex};
+        using State = P2PConnection::State;
+        bool due = now - connection->last_transmit >= RETRANSMIT_TIMEOUT;
+        if (connection->state == State::Connecting && due) {
+            if (++connection->retries > MAX_RETRIES) {
+                connection->state = State::TimedOut;
+                connection->changed.notify_all();
+            } else {
+                SendControl(connection->peer, P2P_SYN, 0, connection->local_vport,
+                            connection->peer.vport, 0);
+                connection->last_transmit = now;
+            }
+        } else if (connection->state == State::Established && due &&
+                   (!connection->unacked.empty() || connection->peer_window == 0)) {
+            if (++connection->retries > MAX_RETRIES) {
+                connection->state = State::TimedOut;
+                connection->changed.notify_all();
+            } else if (connection->peer_window == 0) {
+                // Probe the closed window with the oldest segment, or with an empty one for
+                // a sequence number the peer already has, which it only acknowledges
+                if (!connection->unacked.empty()) {
+                    Transmit(connection->peer, connection->unacked.front());
+                } else {
+                    SendControl(connection->peer, P2P_DATA, 0, connection->local_vport,
+                                connection->peer.vport, connection->next_seq - 1);
+                }
+                connection->last_transmit = now;
+            } else {
+                for (PacketBuffer* packet : connection->unacked) {
+                    Transmit(connection->peer, packet);
+                }
+                connection->last_transmit = now;
+            }
+        }
+        bool drained = connection->local_closed && connection->unacked.empty();
+        bool dead = connection->state != State::Connecting &&
+                    connection->state != State::Established;
+        if (drained || dead) {
+            finished.push_back(connection);
+        }
+    }
+    if (finished.empty()) {
+        return;
+    }
+    // The guest may still hold a finished connection, only the table forgets it
+    std::scoped_lock lock{mutex};
+    for (auto& connection : finished) {
+        auto it = connections.find(KeyOf(*connection));
+        if (it != connections.end() && it->second == connection) {
+            connections.erase(it);
+        }
+    }
+}
+
+} // namespace Libraries::Net
@@ -0,0 +1,209 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include "common/types.h"
+#include "core/networking/packet_pool.h"
+
+namespace Libraries::Net {
+
+using Core::Networking::PacketBuffer;
+
+// Where a P2P socket lives: host IPv4 address and UDP port of the emulator instance,
+// plus the virtual port inside it. Host byte order throughout.
+struct P2PAddress {
+    u32 ip;
+    u16 port;
+    u16 vport;
+};
+
+enum class P2PKind : u8 {
+    Datagram,
+    Stream,
+};
+
+class P2PTransport;
+
+// One established or connecting stream. Reliable and ordered over the shared UDP
+// socket with go-back-N: segments stay queued until acknowledged and everything
+// unacknowledged is resent when the retransmission timer fires.
+class P2PConnection {
+public:
+    enum class State {
+        Connecting,
+        Established,
+        Refused,
+        TimedOut,
+        Reset,
+    };
+
+    // All of these return a byte count, or a negative ORBIS_NET_E* error
+    int Send(const void* data, u32 size, bool nonblocking, s64 timeout_us);
+    int Receive(void* buffer, u32 size, bool peek, bool nonblocking, s64 timeout_us);
+    // Sends FIN after any queued data; the transport forgets the connection once the
+    // peer acknowledged everything
+    void Close();
+    int WaitConnected(s64 timeout_us);
+
+    ~P2PConnection();
+
+    P2PAddress GetPeer() const {
+        return peer;
+    }
+    u16 GetLocalPort() const {
+        return local_vport;
+    }
+
+private:
+    friend class P2PTransport;
+
+    P2PConnection(P2PTransport* transport, u16 local_vport, P2PAddress peer, State state)
+        : transport{transport}, local_vport{local_vport}, peer{peer}, state{state} {}
+
+    int StateError() const;
+    // Free slots in the receive queue, advertised in every ACK
+    u16 ReceiveWindow() const;
+
+    P2PTransport* transport;
+    const u16 local_vport;
+    const P2PAddress peer;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    State state;
+    bool local_closed = false;
+    bool peer_finished = false;
+    // Sender side: whole wire packets until acknowledged
+    u32 next_seq = 0;
+    std::deque<PacketBuffer*> unacked;
+    std::chrono::steady_clock::time_point last_transmit{};
+    u32 retries = 0;
+    // Segments the peer can still queue, as of its last ACK
+    u16 peer_window = 0xFFFF;
+    // Receiver side: in-order payloads not yet read
+    u32 receive_next = 0;
+    std::deque<PacketBuffer*> received;
+    u16 advertised_window = 0xFFFF;
+};
+
+// A bound virtual port. Datagram ports queue what arrives for them, stream ports that
+// listen queue connections waiting for Accept.
+class P2PPort {
+public:
+    int ReceiveFrom(void* buffer, u32 size, P2PAddress* from, bool peek, bool nonblocking,
+                    s64 timeout_us);
+    std::shared_ptr<P2PConnection> Accept(bool nonblocking, s64 timeout_us, int* error);
+    void Listen(int backlog);
+
+    ~P2PPort();
+
+    u16 GetPort() const {
+        return vport;
+    }
+    P2PKind GetKind() const {
+        return kind;
+    }
+
+private:
+    friend class P2PTransport;
+
+    P2PPort(u16 vport, P2PKind kind) : vport{vport}, kind{kind} {}
+
+    const u16 vport;
+    const P2PKind kind;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool closed = false;
+    std::deque<PacketBuffer*> datagrams;
+    int backlog = 0;
+    std::deque<std::shared_ptr<P2PConnection>> pending;
+};
+
+// Host side of the P2P socket types. One UDP socket per emulator instance carries every
+// P2P socket; a small header names the source and destination virtual ports, and the
+// I/O thread demultiplexes arriving packets through one table shared by all ports. A
+// second instance on the same host takes the next free UDP port, so sessions can talk
+// over loopback.
+class P2PTransport {
+public:
+    static constexpr u16 DEFAULT_HOST_PORT = 3658;
+    static constexpr u32 MAX_PAYLOAD = 1200;
+
+    P2PTransport() = default;
+    ~P2PTransport();
+
+    // Binds the host socket at preferred_port or the next free one of a few after it.
+    // Called on first use with the default port if nobody started it before.
+    bool Start(u16 preferred_port = DEFAULT_HOST_PORT);
+    void Stop();
+    u16 GetHostPort() const {
+        return host_port;
+    }
+
+    // Null if the virtual port is taken; port 0 picks a free ephemeral one
+    std::shared_ptr<P2PPort> Bind(u16 vport, P2PKind kind);
+    void Unbind(const std::shared_ptr<P2PPort>& port);
+
+    int SendTo(const P2PPort& port, const P2PAddress& to, const void* data, u32 size);
+    std::shared_ptr<P2PConnection> Connect(const P2PPort& port, const P2PAddress& to);
+
+private:
+    friend class P2PConnection;
+
+    struct ConnectionKey {
+        u32 ip;
+        u16 port;
+        u16 peer_vport;
+        u16 local_vport;
+
+        bool operator<(const ConnectionKey& other) const {
+            return std::tie(ip, port, peer_vport, local_vport) <
+                   std::tie(other.ip, other.port, other.peer_vport, other.local_vport);
+        }
+    };
+
+    static u32 PortKey(u16 vport, P2PKind kind) {
+        return (static_cast<u32>(kind) << 16) | vport;
+    }
+    static ConnectionKey KeyOf(const P2PConnection& connection) {
+        return {connection.peer.ip, connection.peer.port, connection.peer.vport,
+                connection.local_vport};
+    }
+
+    void Transmit(const P2PAddress& to, const PacketBuffer* packet);
+    void SendControl(const P2PAddress& to, u8 type, u8 flags, u16 src_vport, u16 dst_vport,
+                     u32 seq);
+    void SendAck(const P2PAddress& to, u16 src_vport, u16 dst_vport, u32 ack, u16 window);
+    void IoThread();
+    void HandlePacket(PacketBuffer* packet);
+    void HandleStream(PacketBuffer* packet, u8 type, u8 flags, u16 src_vport, u16 dst_vport,
+                      u32 seq);
+    void RunTimers();
+
+    // Socket handle kept as an integer so this header stays free of platform headers
+    intptr_t host_socket = -1;
+    u16 host_port = 0;
+    std::atomic_bool running{false};
+    std::thread io_thread;
+    std::mutex start_mutex;
+
+    // Demux table of every bound port and every live connection
+    std::mutex mutex;
+    std::unordered_map<u32, std::shared_ptr<P2PPort>> ports;
+    std::map<ConnectionKey, std::shared_ptr<P2PConnection>> connections;
+    u16 next_ephemeral = 49152;
+};
+
+} // namespace Libraries::Net
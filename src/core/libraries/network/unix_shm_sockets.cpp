@@ -0,0 +1,414 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <common/assert.h>
+#include "common/logging/log.h"
+#include "common/singleton.h"
+#include "core/libraries/kernel/kernel.h"
+#include "core/networking/networking.h"
+#include "net.h"
+#include "net_error.h"
+#include "net_translate.h"
+#include "sockets.h"
+#include "unix_shm_transport.h"
+#ifndef WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/un.h>
+
+namespace Libraries::Net {
+
+// AF_UNIX stream socket that moves to a ShmStream once connected, when the networking
+// config enables shm_unix_sockets. Binding, listening and connecting stay with the host
+// kernel, which also keeps the path namespace shared with other emulator instances;
+// without the option, or when the peer does not take the offer, data stays there too.
+// Accepted sockets answer the offer when it is already there, otherwise on their first
+// transfer, so Accept itself never waits for the peer.
+// Not built on Windows, where UnixSocket keeps serving AF_UNIX.
+class ShmUnixSocket {
+public:
+    ShmUnixSocket() : sock{::socket(AF_UNIX, SOCK_STREAM, 0)} {}
+
+    // Check if the socket is valid
+    bool IsValid() const {
+        return sock != -1;
+    }
+
+    // Close the socket
+    int Close() {
+        std::scoped_lock lock{m_mutex};
+        // The segment goes first, the peer sees end of stream rather than a vanished socket.
+        // Calls still inside it hold their own reference, and the stream its own descriptor.
+        stream.reset();
+        if (sock != -1) {
+            ::close(sock);
+            sock = -1;
+        }
+        return 0;
+    }
+
+    // Set socket options
+    int SetSocketOptions(int level, int optname, const void* optval, u32 optlen) {
+        if (level != ORBIS_NET_SOL_SOCKET) {
+            return 0;
+        }
+        if (!optval || optlen < sizeof(int)) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        int value = *static_cast<const int*>(optval);
+        std::scoped_lock lock{m_mutex};
+        switch (optname) {
+        case ORBIS_NET_SO_NBIO:
+            nonblocking = value != 0;
+            return 0;
+        case ORBIS_NET_SO_RCVTIMEO:
+            receive_timeout_us = value > 0 ? value : -1;
+            return 0;
+        case ORBIS_NET_SO_SNDTIMEO:
+            send_timeout_us = value > 0 ? value : -1;
+            return 0;
+        default:
+            return 0;
+        }
+    }
+
+    // Get socket options
+    int GetSocketOptions(int level, int optname, void* optval, u32* optlen) {
+        if (level != ORBIS_NET_SOL_SOCKET || !optval || !optlen || *optlen < sizeof(int)) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        std::scoped_lock lock{m_mutex};
+        int value = 0;
+        switch (optname) {
+        case ORBIS_NET_SO_NBIO:
+            value = nonblocking;
+            break;
+        case ORBIS_NET_SO_TYPE:
+            value = ORBIS_NET_SOCK_STREAM;
+            break;
+        case ORBIS_NET_SO_RCVTIMEO:
+            value = receive_timeout_us < 0 ? 0 : static_cast<int>(receive_timeout_us);
+            break;
+        case ORBIS_NET_SO_SNDTIMEO:
+            value = send_timeout_us < 0 ? 0 : static_cast<int>(send_timeout_us);
+            break;
+        default:
+            break;
+        }
+        *static_cast<int*>(optval) = value;
+        *optlen = sizeof(int);
+        return 0;
+    }
+
+    // Bind the socket to a address
+    int Bind(const OrbisNetSockaddr* addr, u32 addrlen) {
+        sockaddr_un host{};
+        if (!ToHost(addr, addrlen, &host)) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        int result = ::bind(sock, reinterpret_cast<sockaddr*>(&host), sizeof(host));
+        return ConvertReturnErrorCode(result);
+    }
+
+    // Listen for incoming connections
+    int Listen(int backlog) {
+        int result = ::listen(sock, backlog);
+        if (result == 0) {
+            // Blocking accepts wait in poll instead, so a connection another thread takes
+            // first sends this one back to waiting rather than stuck in accept
+            int flags = ::fcntl(sock, F_GETFL);
+            result = ::fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+        }
+        return ConvertReturnErrorCode(result);
+    }
+
+    // Send a message over the socket
+    int SendMessage(const OrbisNetMsghdr* msg, int flags) {
+        if (!msg) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        u32 total = 0;
+        for (int i = 0; i < msg->msg_iovlen; i++) {
+            const auto& iov = msg->msg_iov[i];
+            int result =
+                SendPacket(iov.iov_base, static_cast<u32>(iov.iov_len), flags, nullptr, 0);
+            if (result < 0) {
+                return total ? static_cast<int>(total) : result;
+            }
+            total += result;
+            if (static_cast<u32>(result) < iov.iov_len) {
+                break;
+            }
+        }
+        return static_cast<int>(total);
+    }
+
+    // Send a packet over the socket
+    int SendPacket(const void* msg, u32 len, int flags, const OrbisNetSockaddr* to, u32 tolen) {
+        Options options;
+        auto shared = GetStream(&options);
+        bool dontwait = options.nonblocking || (flags & ORBIS_NET_MSG_DONTWAIT);
+        if (int result = Negotiate(dontwait, ShmStream::HANDSHAKE_TIMEOUT_US, true); result < 0) {
+            return SetError(-result);
+        }
+        if (!shared) {
+            shared = GetStream();
+        }
+        if (shared) {
+            int result;
+            {
+                // One writer at a time, the ring has a single producer
+                std::scoped_lock lock{send_mutex};
+                result = shared->Send(msg, len, dontwait, options.send_timeout_us);
+            }
+            if (result != ShmStream::DECLINED) {
+                return Result(result);
+            }
+            DropStream(shared);
+        }
+        int host_flags = MSG_NOSIGNAL | (dontwait ? MSG_DONTWAIT : 0);
+        return ConvertReturnErrorCode(static_cast<int>(::send(sock, msg, len, host_flags)));
+    }
+
+    // Receive a message from the socket
+    int ReceiveMessage(OrbisNetMsghdr* msg, int flags) {
+        if (!msg || msg->msg_iovlen < 1) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        msg->msg_namelen = 0;
+        return ReceivePacket(msg->msg_iov[0].iov_base, static_cast<u32>(msg->msg_iov[0].iov_len),
+                             flags, nullptr, nullptr);
+    }
+
+    // Receive a packet from the socket
+    int ReceivePacket(void* buf, u32 len, int flags, OrbisNetSockaddr* from, u32* fromlen) {
+        Options options;
+        auto shared = GetStream(&options);
+        bool dontwait = options.nonblocking || (flags & ORBIS_NET_MSG_DONTWAIT);
+        bool peek = flags & ORBIS_NET_MSG_PEEK;
+        if (from && fromlen) {
+            // Stream peers are unnamed, like on the kernel path
+            *fromlen = 0;
+        }
+        // Waiting for the first bytes is what a receive does anyway, no handshake limit
+        if (int result = Negotiate(dontwait, options.receive_timeout_us, false); result < 0) {
+            return SetError(-result);
+        }
+        if (!shared) {
+            shared = GetStream();
+        }
+        if (shared) {
+            int result;
+            {
+                std::scoped_lock lock{receive_mutex};
+                result = shared->Receive(buf, len, peek, dontwait, options.receive_timeout_us);
+            }
+            if (result != ShmStream::DECLINED) {
+                return Result(result);
+            }
+            DropStream(shared);
+        }
+        int host_flags = (dontwait ? MSG_DONTWAIT : 0) | (peek ? MSG_PEEK : 0);
+        return ConvertReturnErrorCode(static_cast<int>(::recv(sock, buf, len, host_flags)));
+    }
+
+    // Accept an incoming connection
+    std::shared_ptr<ShmUnixSocket> Accept(OrbisNetSockaddr* addr, u32* addrlen) {
+        Options options;
+        GetStream(&options);
+        int accepted;
+        while ((accepted = ::accept(sock, nullptr, nullptr)) < 0) {
+            if (options.nonblocking || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                ConvertReturnErrorCode(accepted);
+                return nullptr;
+            }
+            pollfd pending{sock, POLLIN, 0};
+            ::poll(&pending, 1, -1);
+        }
+        auto socket = std::make_shared<ShmUnixSocket>(accepted);
+        if (Enabled()) {
+            // The offer leaves right after connect and is usually here already
+            std::unique_ptr<ShmStream> taken;
+            auto outcome = ShmStream::Answer(accepted, 0, &taken);
+            socket->stream = std::move(taken);
+            socket->negotiating = outcome == ShmStream::Outcome::Pending;
+        }
+        if (addr && addrlen) {
+            *addrlen = 0;
+        }
+        return socket;
+    }
+
+    // Connect to a remote address
+    int Connect(const OrbisNetSockaddr* addr, u32 namelen) {
+        sockaddr_un host{};
+        if (!ToHost(addr, namelen, &host)) {
+            return SetError(ORBIS_NET_EINVAL);
+        }
+        int result = ::connect(sock, reinterpret_cast<sockaddr*>(&host), sizeof(host));
+        if (result < 0) {
+            return ConvertReturnErrorCode(result);
+        }
+        if (Enabled()) {
+            std::scoped_lock lock{m_mutex};
+            stream = ShmStream::Offer(sock);
+        }
+        return 0;
+    }
+
+    // Get the socket address
+    int GetSocketAddress(OrbisNetSockaddr* name, u32* namelen) {
+        sockaddr_un host{};
+        socklen_t size = sizeof(host);
+        if (::getsockname(sock, reinterpret_cast<sockaddr*>(&host), &size) < 0) {
+            return ConvertReturnErrorCode(-1);
+        }
+        FromHost(host, name, namelen);
+        return 0;
+    }
+
+    // Get the peer name
+    int GetPeerName(OrbisNetSockaddr* addr, u32* namelen) {
+        sockaddr_un host{};
+        socklen_t size = sizeof(host);
+        if (::getpeername(sock, reinterpret_cast<sockaddr*>(&host), &size) < 0) {
+            return ConvertReturnErrorCode(-1);
+        }
+        FromHost(host, addr, namelen);
+        return 0;
+    }
+
+    // The host socket only carries data while no stream took over, the reactor would
+    // never see the stream's traffic on it
+    std::optional<net_socket> Native() {
+        if (GetStream()) {
+            return std::nullopt;
+        }
+        return sock;
+    }
+
+    explicit ShmUnixSocket(net_socket accepted)
+        : sock{accepted}, accepted_at{std::chrono::steady_clock::now()} {}
+
+private:
+    struct Options {
+        bool nonblocking;
+        s64 receive_timeout_us;
+        s64 send_timeout_us;
+    };
+
+    std::shared_ptr<ShmStream> GetStream(Options* options = nullptr) {
+        std::scoped_lock lock{m_mutex};
+        if (options) {
+            *options = {nonblocking, receive_timeout_us, send_timeout_us};
+        }
+        return stream;
+    }
+
+    // The connector refused the segment, the socket carries the stream from now on
+    void DropStream(const std::shared_ptr<ShmStream>& refused) {
+        std::scoped_lock lock{m_mutex};
+        if (stream == refused) {
+            stream.reset();
+        }
+    }
+
+    // Accepting side: answers an offer that had not arrived by Accept before the first
+    // transfer. 0 once settled, or a negative ORBIS_NET_E* error while it still may come.
+    // With settle a blocking call waits out the handshake, and whatever the call, a peer
+    // silent for HANDSHAKE_TIMEOUT_US since accept is taken to have no offer.
+    int Negotiate(bool dontwait, s64 timeout_us, bool settle) {
+        if (!negotiating.load(std::memory_order_acquire)) [[likely]] {
+            return 0;
+        }
+        std::scoped_lock lock{negotiate_mutex};
+        if (!negotiating.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+        s64 handshake_left = ShmStream::HANDSHAKE_TIMEOUT_US - SinceAcceptUs();
+        s64 wait_us = dontwait ? 0 : settle ? std::max<s64>(handshake_left, 0) : timeout_us;
+        std::unique_ptr<ShmStream> taken;
+        auto outcome = ShmStream::Answer(sock, wait_us, &taken);
+        if (outcome == ShmStream::Outcome::Pending && (dontwait || !settle) &&
+            SinceAcceptUs() < ShmStream::HANDSHAKE_TIMEOUT_US) {
+            return -ORBIS_NET_EAGAIN;
+        }
+        {
+            std::scoped_lock stream_lock{m_mutex};
+            stream = std::move(taken);
+        }
+        negotiating.store(false, std::memory_order_release);
+        return 0;
+    }
+
+    s64 SinceAcceptUs() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - accepted_at)
+            .count();
+    }
+
+    static bool Enabled() {
+        return Common::Singleton<Core::Networking::NetworkingCore>::Instance()
+            ->GetConfig()
+            .shm_unix_sockets;
+    }
+
+    static int SetError(int error) {
+        *Libraries::Kernel::__Error() = error;
+        return -1;
+    }
+
+    // Stream results are byte counts or negative ORBIS_NET_E* errors
+    static int Result(int result) {
+        return result < 0 ? SetError(-result) : result;
+    }
+
+    static bool ToHost(const OrbisNetSockaddr* addr, u32 addrlen, sockaddr_un* host) {
+        if (!addr || addrlen <= offsetof(OrbisNetSockaddrUn, sun_path)) {
+            return false;
+        }
+        const auto* un = reinterpret_cast<const OrbisNetSockaddrUn*>(addr);
+        size_t limit = std::min<size_t>(sizeof(un->sun_path),
+                                        addrlen - offsetof(OrbisNetSockaddrUn, sun_path));
+        size_t length = strnlen(un->sun_path, limit);
+        if (length >= sizeof(host->sun_path)) {
+            return false;
+        }
+        host->sun_family = AF_UNIX;
+        std::memcpy(host->sun_path, un->sun_path, length);
+        return true;
+    }
+
+    static void FromHost(const sockaddr_un& host, OrbisNetSockaddr* out, u32* outlen) {
+        if (!out || !outlen) {
+            return;
+        }
+        OrbisNetSockaddrUn un{};
+        un.sun_len = sizeof(un);
+        un.sun_family = ORBIS_NET_AF_UNIX;
+        std::strncpy(un.sun_path, host.sun_path, sizeof(un.sun_path) - 1);
+        std::memcpy(out, &un, std::min<u32>(*outlen, sizeof(un)));
+        *outlen = sizeof(un);
+    }
+
+    std::mutex m_mutex;
+    net_socket sock;
+    std::shared_ptr<ShmStream> stream;
+    std::mutex send_mutex;
+    std::mutex receive_mutex;
+    std::mutex negotiate_mutex;
+    std::atomic<bool> negotiating = false;
+    // Start of the handshake window of an accepted socket
+    std::chrono::steady_clock::time_point accepted_at{};
+    bool nonblocking = false;
+    s64 receive_timeout_us = -1;
+    s64 send_timeout_us = -1;
+};
+
+} // namespace Libraries::Net
+
+#endif
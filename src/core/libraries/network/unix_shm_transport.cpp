@@ -0,0 +1,443 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "common/logging/log.h"
+#include "net_error.h"
+#include "net_translate.h"
+#include "unix_shm_transport.h"
+
+namespace Libraries::Net {
+
+using Clock = std::chrono::steady_clock;
+
+// Written by the connecting side together with the segment's descriptor, answered by
+// one ACK or NAK byte from the accepting side
+constexpr char HELLO[8] = {'L', 'A', 'Y', 'R', 'S', 'H', 'M', '1'};
+constexpr char ACK = 'Y';
+constexpr char NAK = 'N';
+// Blocked sides wake up this often to check the peer process is still there
+constexpr s64 LIVENESS_INTERVAL_US = 100000;
+
+// Shared between the two processes: indices count bytes and wrap, and each side only
+// ever stores its own index. The flags say a side sleeps on the other's index.
+struct ShmStream::Ring {
+    alignas(64) std::atomic<u32> write_index;
+    std::atomic<u32> reader_waiting;
+    std::atomic<u32> writer_closed;
+    alignas(64) std::atomic<u32> read_index;
+    std::atomic<u32> writer_waiting;
+    std::atomic<u32> reader_closed;
+    alignas(64) u8 data[RING_SIZE];
+};
+static_assert(std::atomic<u32>::is_always_lock_free);
+static_assert((ShmStream::RING_SIZE & (ShmStream::RING_SIZE - 1)) == 0,
+              "ring size must be a power of two");
+
+// Rings are named from the connecting side
+struct ShmStream::Segment {
+    Ring to_acceptor;
+    Ring to_connector;
+};
+
+#ifdef __linux__
+// The segment is mapped into two processes, so the futexes must not be private
+static void FutexWait(std::atomic<u32>* word, u32 expected, s64 timeout_us) {
+    timespec timeout{static_cast<time_t>(timeout_us / 1000000),
+                     static_cast<long>(timeout_us % 1000000) * 1000};
+    syscall(SYS_futex, reinterpret_cast<u32*>(word), FUTEX_WAIT, expected, &timeout, nullptr,
+            0);
+}
+
+static void FutexWake(std::atomic<u32>* word) {
+    syscall(SYS_futex, reinterpret_cast<u32*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+#else
+static void FutexWait(std::atomic<u32>*, u32, s64) {}
+static void FutexWake(std::atomic<u32>*) {}
+#endif
+
+// Sleeps until *word moves away from expected or the other side closes, the deadline
+// passes, or a liveness check is due. The flag is raised before the final check so a
+// concurrent store either is seen here or sees the flag and wakes us.
+static void WaitForChange(std::atomic<u32>* word, u32 expected, const std::atomic<u32>* closed,
+                          std::atomic<u32>* waiting, s64 timeout_us) {
+    waiting->store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (word->load(std::memory_order_relaxed) == expected &&
+        !closed->load(std::memory_order_relaxed)) {
+        FutexWait(word, expected, std::min(timeout_us, LIVENESS_INTERVAL_US));
+    }
+    waiting->store(0, std::memory_order_relaxed);
+}
+
+// Counterpart of WaitForChange, called after storing the new index
+static void WakeIfWaiting(std::atomic<u32>* word, std::atomic<u32>* waiting) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting->load(std::memory_order_relaxed)) {
+        FutexWake(word);
+    }
+}
+
+// Microseconds left before the deadline, timeout_us < 0 never runs out
+static s64 RemainingUs(s64 timeout_us, Clock::time_point start) {
+    if (timeout_us < 0) {
+        return LIVENESS_INTERVAL_US;
+    }
+    auto elapsed =
+        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    return std::max<s64>(timeout_us - elapsed, 0);
+}
+
+#ifdef __linux__
+static int PollTimeoutMs(s64 timeout_us) {
+    if (timeout_us < 0) {
+        return -1;
+    }
+    return static_cast<int>(std::min<s64>((timeout_us + 999) / 1000, INT_MAX));
+}
+#endif
+
+std::unique_ptr<ShmStream> ShmStream::Offer(net_socket sock) {
+#ifdef __linux__
+    int own = fcntl(sock, F_DUPFD_CLOEXEC, 0);
+    if (own < 0) {
+        return nullptr;
+    }
+    int memory = memfd_create("layra-unix-shm", MFD_CLOEXEC);
+    void* mapping = MAP_FAILED;
+    if (memory >= 0 && ftruncate(memory, sizeof(Segment)) == 0) {
+        mapping = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+    }
+    if (mapping == MAP_FAILED) {
+        if (memory >= 0) {
+            close(memory);
+        }
+        close(own);
+        return nullptr;
+    }
+    // The file starts zeroed, which is the initial state of both rings
+    auto* segment = new (mapping) Segment;
+
+    iovec hello{const_cast<char*>(HELLO), sizeof(HELLO)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+    msghdr message{};
+    message.msg_iov = &hello;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(rights), &memory, sizeof(int));
+    bool sent = sendmsg(sock, &message, MSG_NOSIGNAL) == sizeof(HELLO);
+    close(memory);
+    if (!sent) {
+        munmap(mapping, sizeof(Segment));
+        close(own);
+        return nullptr;
+    }
+    return std::unique_ptr<ShmStream>(new ShmStream(own, segment, true));
+#else
+    return nullptr;
+#endif
+}
+
+ShmStream::Outcome ShmStream::Answer(net_socket sock, s64 timeout_us,
+                                     std::unique_ptr<ShmStream>* stream) {
+#ifdef __linux__
+    pollfd offer{sock, POLLIN, 0};
+    int ready = poll(&offer, 1, PollTimeoutMs(timeout_us));
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+        return Outcome::Pending;
+    }
+    // Peek first so a peer without the transport keeps its bytes. The hello goes out in one
+    // write, so a shorter read is not one.
+    char hello[sizeof(HELLO)];
+    ssize_t peeked = recv(sock, hello, sizeof(hello), MSG_PEEK | MSG_DONTWAIT);
+    if (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return Outcome::Pending;
+    }
+    if (peeked != sizeof(hello) || std::memcmp(hello, HELLO, sizeof(HELLO)) != 0) {
+        return Outcome::Kernel;
+    }
+    iovec payload{hello, sizeof(hello)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+    msghdr message{};
+    message.msg_iov = &payload;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    int memory = -1;
+    if (recvmsg(sock, &message, MSG_CMSG_CLOEXEC | MSG_DONTWAIT) == sizeof(hello)) {
+        cmsghdr* rights = CMSG_FIRSTHDR(&message);
+        if (rights && rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS) {
+            std::memcpy(&memory, CMSG_DATA(rights), sizeof(int));
+        }
+    }
+    void* mapping = MAP_FAILED;
+    if (memory >= 0) {
+        // A shorter file would fault on the first ring access, refuse it instead
+        struct stat info;
+        if (fstat(memory, &info) == 0 && static_cast<u64>(info.st_size) >= sizeof(Segment)) {
+            mapping =
+                mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+        }
+        close(memory);
+    }
+    int own = mapping != MAP_FAILED ? fcntl(sock, F_DUPFD_CLOEXEC, 0) : -1;
+    // The offer is consumed, the connector waits for this byte whatever it says
+    char reply = own >= 0 ? ACK : NAK;
+    if (send(sock, &reply, 1, MSG_NOSIGNAL) != 1 || own < 0) {
+        LOG_WARN(Lib_Net, "could not take the shared memory stream, staying on the socket");
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, sizeof(Segment));
+        }
+        if (own >= 0) {
+            close(own);
+        }
+        return Outcome::Kernel;
+    }
+    stream->reset(new ShmStream(own, static_cast<Segment*>(mapping), false));
+    return Outcome::Shared;
+#else
+    return Outcome::Kernel;
+#endif
+}
+
+ShmStream::ShmStream(net_socket sock, Segment* segment, bool connector)
+    : sock{sock}, segment{segment},
+      tx{connector ? &segment->to_acceptor : &segment->to_connector},
+      rx{connector ? &segment->to_connector : &segment->to_acceptor},
+      verdict{connector ? Verdict::Pending : Verdict::Taken} {}
+
+ShmStream::~ShmStream() {
+    Shutdown();
+    rx->reader_closed.store(1, std::memory_order_release);
+    WakeIfWaiting(&rx->read_index, &rx->writer_waiting);
+#ifdef __linux__
+    munmap(segment, sizeof(Segment));
+    close(sock);
+#endif
+}
+
+int ShmStream::AwaitVerdict(bool nonblocking, s64 timeout_us) {
+#ifdef __linux__
+    auto start = Clock::now();
+    // Waiting happens outside the lock, a sender filling the ring meanwhile is fine
+    pollfd answer{sock, POLLIN, 0};
+    if (verdict.load(std::memory_order_acquire) == Verdict::Pending &&
+        poll(&answer, 1, nonblocking ? 0 : PollTimeoutMs(timeout_us)) <= 0) {
+        return -ORBIS_NET_EAGAIN;
+    }
+    std::scoped_lock lock{verdict_mutex};
+    if (verdict.load(std::memory_order_relaxed) == Verdict::Pending) {
+        char reply = 0;
+        ssize_t got = recv(sock, &reply, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return -ORBIS_NET_EAGAIN;
+        }
+        if (got == 1 && reply == ACK) {
+            recv(sock, &reply, 1, MSG_DONTWAIT);
+            verdict.store(Verdict::Taken, std::memory_order_release);
+            return 0;
+        }
+        // A refusal, or an acceptor that hung up or never knew the transport. It has read
+        // nothing from the ring, whatever is there goes over the socket in order.
+        if (got == 1 && reply == NAK) {
+            recv(sock, &reply, 1, MSG_DONTWAIT);
+        }
+        LOG_WARN(Lib_Net, "peer did not take the shared memory stream, staying on the socket");
+        verdict.store(Verdict::Draining, std::memory_order_release);
+    }
+    if (verdict.load(std::memory_order_relaxed) == Verdict::Draining) {
+        // Only DECLINED sends the caller to the socket, nothing may overtake the ring
+        if (int result = DrainRefused(nonblocking, RemainingUs(timeout_us, start)); result < 0) {
+            return result;
+        }
+        verdict.store(Verdict::Refused, std::memory_order_release);
+    }
+    return verdict.load(std::memory_order_relaxed) == Verdict::Taken ? 0 : DECLINED;
+#else
+    return 0;
+#endif
+}
+
+int ShmStream::DrainRefused(bool nonblocking, s64 timeout_us) {
+#ifdef __linux__
+    // The acceptor never reads the ring now, its read index records how far we got
+    auto start = Clock::now();
+    u32 tail = tx->read_index.load(std::memory_order_relaxed);
+    u32 head = tx->write_index.load(std::memory_order_relaxed);
+    while (tail != head) {
+        u32 offset = tail & (RING_SIZE - 1);
+        u32 chunk = std::min(head - tail, RING_SIZE - offset);
+        ssize_t sent = send(sock, tx->data + offset, chunk, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent > 0) {
+            tail += static_cast<u32>(sent);
+            tx->read_index.store(tail, std::memory_order_relaxed);
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -TranslateHostError(errno);
+        }
+        s64 remaining = RemainingUs(timeout_us, start);
+        pollfd writable{sock, POLLOUT, 0};
+        if (nonblocking || remaining == 0 || poll(&writable, 1, PollTimeoutMs(remaining)) == 0) {
+            return -ORBIS_NET_EAGAIN;
+        }
+    }
+#endif
+    return 0;
+}
+
+bool ShmStream::PeerGone() const {
+#ifdef __linux__
+    // Nothing travels over the socket after the handshake, any event on it is the peer
+    // closing it or exiting
+    pollfd fd{sock, POLLIN | POLLRDHUP, 0};
+    return poll(&fd, 1, 0) == 1;
+#else
+    return false;
+#endif
+}
+
+u32 ShmStream::Write(const u8* bytes, u32 size) {
+    u32 head = tx->write_index.load(std::memory_order_relaxed);
+    u32 space = RING_SIZE - (head - tx_cached_read);
+    if (space == 0) {
+        tx_cached_read = tx->read_index.load(std::memory_order_acquire);
+        space = RING_SIZE - (head - tx_cached_read);
+    }
+    u32 chunk = std::min(space, size);
+    u32 offset = head & (RING_SIZE - 1);
+    u32 first = std::min(chunk, RING_SIZE - offset);
+    std::memcpy(tx->data + offset, bytes, first);
+    std::memcpy(tx->data, bytes + first, chunk - first);
+    if (chunk) {
+        tx->write_index.store(head + chunk, std::memory_order_release);
+        WakeIfWaiting(&tx->write_index, &tx->reader_waiting);
+    }
+    return chunk;
+}
+
+int ShmStream::Send(const void* data, u32 size, bool nonblocking, s64 timeout_us) {
+    const u8* bytes = static_cast<const u8*>(data);
+    u32 sent = 0;
+    auto start = Clock::now();
+    while (sent < size) {
+        if (tx->writer_closed.load(std::memory_order_relaxed) ||
+            tx->reader_closed.load(std::memory_order_acquire)) {
+            return sent ? static_cast<int>(sent) : -ORBIS_NET_EPIPE;
+        }
+        u32 written;
+        if (verdict.load(std::memory_order_acquire) == Verdict::Taken) [[likely]] {
+            written = Write(bytes + sent, size - sent);
+        } else {
+            std::scoped_lock lock{verdict_mutex};
+            // Once refused nothing more goes into the ring, AwaitVerdict takes over below
+            written = verdict.load(std::memory_order_relaxed) == Verdict::Pending
+                          ? Write(bytes + sent, size - sent)
+                          : 0;
+        }
+        if (written) {
+            sent += written;
+            continue;
+        }
+        s64 remaining = RemainingUs(timeout_us, start);
+        if (verdict.load(std::memory_order_acquire) != Verdict::Taken) {
+            // The acceptor reads nothing from the ring before it answered
+            int result = AwaitVerdict(nonblocking, remaining);
+            if (result == 0 ||
+                (result == -ORBIS_NET_EAGAIN && !nonblocking && RemainingUs(timeout_us, start))) {
+                continue;
+            }
+            return sent ? static_cast<int>(sent) : result;
+        }
+        if (nonblocking || remaining == 0) {
+            return sent ? static_cast<int>(sent) : -ORBIS_NET_EAGAIN;
+        }
+        WaitForChange(&tx->read_index, tx_cached_read, &tx->reader_closed, &tx->writer_waiting,
+                      remaining);
+        if (tx->read_index.load(std::memory_order_relaxed) == tx_cached_read && PeerGone()) {
+            return sent ? static_cast<int>(sent) : -ORBIS_NET_EPIPE;
+        }
+    }
+    return static_cast<int>(sent);
+}
+
+int ShmStream::Receive(void* buffer, u32 size, bool peek, bool nonblocking, s64 timeout_us) {
+    if (verdict.load(std::memory_order_acquire) != Verdict::Taken) {
+        // Nothing arrives in the ring before the acceptor's answer, wait for that instead
+        if (int result = AwaitVerdict(nonblocking, timeout_us); result != 0) {
+            return result;
+        }
+    }
+    auto start = Clock::now();
+    for (;;) {
+        u32 tail = rx->read_index.load(std::memory_order_relaxed);
+        u32 available = rx_cached_write - tail;
+        if (available == 0) {
+            rx_cached_write = rx->write_index.load(std::memory_order_acquire);
+            available = rx_cached_write - tail;
+        }
+        if (available) {
+            u32 chunk = std::min(available, size);
+            u32 offset = tail & (RING_SIZE - 1);
+            u32 first = std::min(chunk, RING_SIZE - offset);
+            std::memcpy(buffer, rx->data + offset, first);
+            std::memcpy(static_cast<u8*>(buffer) + first, rx->data, chunk - first);
+            if (!peek) {
+                rx->read_index.store(tail + chunk, std::memory_order_release);
+                WakeIfWaiting(&rx->read_index, &rx->writer_waiting);
+            }
+            return static_cast<int>(chunk);
+        }
+        // The writer closes after its last index store, so seeing the flag and then no
+        // new data is the end of the stream
+        if (rx->writer_closed.load(std::memory_order_acquire)) {
+            if (rx->write_index.load(std::memory_order_acquire) == tail) {
+                return 0;
+            }
+            continue;
+        }
+        s64 remaining = RemainingUs(timeout_us, start);
+        if (nonblocking || remaining == 0) {
+            return -ORBIS_NET_EAGAIN;
+        }
+        WaitForChange(&rx->write_index, tail, &rx->writer_closed, &rx->reader_waiting,
+                      remaining);
+        if (rx->write_index.load(std::memory_order_relaxed) == tail && PeerGone()) {
+            // A peer that exited without closing reads like one that did
+            return 0;
+        }
+    }
+}
+
+void ShmStream::Shutdown() {
+    if (tx->writer_closed.exchange(1, std::memory_order_release)) {
+        return;
+    }
+    WakeIfWaiting(&tx->write_index, &tx->reader_waiting);
+}
+
+} // namespace Libraries::Net
@@ -0,0 +1,90 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include "common/types.h"
+#include "sockets.h"
+
+namespace Libraries::Net {
+
+// Byte stream between two emulator processes on one host through a shared memory
+// segment: one single-producer ring per direction, futex wakeups, and no kernel copy on
+// the data path. The connected AF_UNIX socket it upgrades hands the segment over and
+// stays open so either side notices when the other process goes away.
+//
+// Both ends must enable it, the connecting side writes a hello into the stream that a
+// side without it would hand to the guest. Neither side blocks to negotiate: the
+// connector offers right after connecting and may fill its ring at once, the acceptor
+// answers every offer it reads with one byte, and the connector's first receive, or a
+// full ring, waits for that byte. A refused offer sends what the ring holds over the
+// socket instead, so both ends always agree on where the data is. Linux only, elsewhere
+// there is never an offer and the kernel socket is used as is.
+class ShmStream {
+public:
+    static constexpr u32 RING_SIZE = 256 * 1024;
+    // How long after accept an acceptor that has to send first, blocking or not, waits for
+    // an offer before it settles on the socket. The offer leaves within Connect, so a peer
+    // silent this long has none.
+    static constexpr s64 HANDSHAKE_TIMEOUT_US = 1000000;
+    // Send or Receive on the connecting side after the peer refused the offer. Everything
+    // written so far went out over the socket, which carries the stream from now on.
+    static constexpr int DECLINED = INT_MIN;
+
+    enum class Outcome {
+        Shared,  // the segment carries the stream
+        Kernel,  // the socket does, for good
+        Pending, // no offer and no data yet
+    };
+
+    // Connecting side: creates the segment and sends the offer over sock, without waiting
+    // for the answer. Null, with nothing sent, if shared memory is unavailable.
+    static std::unique_ptr<ShmStream> Offer(net_socket sock);
+    // Accepting side: waits up to timeout_us (< 0 for ever, 0 to poll) for the first bytes
+    // and answers them if they are an offer. Nothing is read from sock unless they are.
+    static Outcome Answer(net_socket sock, s64 timeout_us, std::unique_ptr<ShmStream>* stream);
+
+    ~ShmStream();
+
+    // Byte count, 0 at end of stream, DECLINED, or a negative ORBIS_NET_E* error
+    int Send(const void* data, u32 size, bool nonblocking, s64 timeout_us);
+    int Receive(void* buffer, u32 size, bool peek, bool nonblocking, s64 timeout_us);
+    // Ends our direction, the peer reads end of stream once it drained the ring
+    void Shutdown();
+
+private:
+    struct Ring;
+    struct Segment;
+
+    // Draining: refused, the ring still holds bytes that have to go out over the socket
+    enum class Verdict : u8 { Pending, Taken, Draining, Refused };
+
+    ShmStream(net_socket sock, Segment* segment, bool connector);
+
+    // Connecting side: 0 once the acceptor took the offer, DECLINED once a refused ring
+    // went out over the socket, -ORBIS_NET_EAGAIN if either did not finish within
+    // timeout_us, or another negative ORBIS_NET_E* error if the socket failed
+    int AwaitVerdict(bool nonblocking, s64 timeout_us);
+    // Sends what the ring holds after a refusal, 0 once it is empty
+    int DrainRefused(bool nonblocking, s64 timeout_us);
+    u32 Write(const u8* bytes, u32 size);
+    bool PeerGone() const;
+
+    // Our own duplicate of the socket, closing the guest's does not pull it from under us
+    net_socket sock;
+    Segment* segment;
+    Ring* tx;
+    Ring* rx;
+    // Held while writing before the verdict, so a refusal resends every byte exactly once
+    std::mutex verdict_mutex;
+    std::atomic<Verdict> verdict;
+    // Last seen peer indices, reloaded only when they say the ring is full or empty
+    u32 tx_cached_read = 0;
+    u32 rx_cached_write = 0;
+};
+
+} // namespace Libraries::Net
@@ -0,0 +1,453 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include "common/logging/log.h"
+#include "lan_play_tunnel.h"
+
+namespace Core {
+namespace Networking {
+
+// switch-lan-play relay framing: one type byte, then the payload
+enum LanPlayPacketType : u8 {
+    LANPLAY_KEEPALIVE = 0,
+    LANPLAY_IPV4 = 1,
+    LANPLAY_PING = 2,
+    LANPLAY_IPV4_FRAG = 3,
+};
+
+constexpr u32 IPV4_HEADER_SIZE = 20;
+constexpr u32 UDP_HEADER_SIZE = 8;
+constexpr u8 IPPROTO_UDP_NUMBER = 17;
+constexpr auto PING_INTERVAL = std::chrono::seconds(10);
+
+#ifdef WIN32
+using TunnelSocket = SOCKET;
+using TunnelPollFd = WSAPOLLFD;
+
+static bool WouldBlock() {
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+static void CloseTunnelSocket(intptr_t sock) {
+    closesocket(static_cast<TunnelSocket>(sock));
+}
+
+static bool SetNonBlocking(TunnelSocket sock) {
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+}
+
+static int PollSockets(TunnelPollFd* fds, u32 count, int timeout_ms) {
+    return WSAPoll(fds, count, timeout_ms);
+}
+#else
+using TunnelSocket = int;
+using TunnelPollFd = pollfd;
+
+static bool WouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+static void CloseTunnelSocket(intptr_t sock) {
+    close(static_cast<TunnelSocket>(sock));
+}
+
+static bool SetNonBlocking(TunnelSocket sock) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int PollSockets(TunnelPollFd* fds, u32 count, int timeout_ms) {
+    return poll(fds, count, timeout_ms);
+}
+#endif
+
+static u64 NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void Put16(u8* p, u16 value) {
+    p[0] = static_cast<u8>(value >> 8);
+    p[1] = static_cast<u8>(value);
+}
+
+static void Put32(u8* p, u32 value) {
+    Put16(p, static_cast<u16>(value >> 16));
+    Put16(p + 2, static_cast<u16>(value));
+}
+
+static u16 Get16(const u8* p) {
+    return static_cast<u16>((p[0] << 8) | p[1]);
+}
+
+static u32 Get32(const u8* p) {
+    return (static_cast<u32>(Get16(p)) << 16) | Get16(p + 2);
+}
+
+static u16 HeaderChecksum(const u8* header, u32 size) {
+    u32 sum = 0;
+    for (u32 i = 0; i < size; i += 2) {
+        sum += Get16(header + i);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<u16>(~sum);
+}
+
+void LanPlayTunnel::LatencyCounter::Add(u64 ns) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+    u64 max = max_ns.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+LanPlayTunnel::LanPlayTunnel(std::string relay_address, std::string guest_ip)
+    : relay_address{std::move(relay_address)} {
+    in_addr address{};
+    if (inet_pton(AF_INET, guest_ip.c_str(), &address) == 1) {
+        guest_address = ntohl(address.s_addr);
+    } else {
+        LOG_ERROR(Networking, "Invalid LAN Play guest address: {}", guest_ip);
+    }
+}
+
+LanPlayTunnel::~LanPlayTunnel() {
+    Stop();
+    // Guest threads may still have queued datagrams after Stop
+    DrainRings();
+}
+
+bool LanPlayTunnel::Start() {
+    if (running) {
+        return true;
+    }
+    if (guest_address == 0) {
+        return false;
+    }
+    size_t colon = relay_address.rfind(':');
+    if (colon == std::string::npos) {
+        LOG_ERROR(Networking, "LAN Play relay address has no port: {}", relay_address);
+        return false;
+    }
+    std::string host = relay_address.substr(0, colon);
+    std::string port = relay_address.substr(colon + 1);
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* resolved = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &resolved) != 0 || !resolved) {
+        LOG_ERROR(Networking, "Could not resolve LAN Play relay: {}", relay_address);
+        return false;
+    }
+
+    TunnelSocket relay = socket(AF_INET, SOCK_DGRAM, 0);
+    bool connected = connect(relay, resolved->ai_addr, static_cast<int>(resolved->ai_addrlen)) == 0;
+    freeaddrinfo(resolved);
+    // The wake socket is connected to itself, a byte sent to it interrupts the poll
+    TunnelSocket wake = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in loopback{};
+    loopback.sin_family = AF_INET;
+    loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t loopback_size = sizeof(loopback);
+    bool wake_ready =
+        bind(wake, reinterpret_cast<sockaddr*>(&loopback), sizeof(loopback)) == 0 &&
+        getsockname(wake, reinterpret_cast<sockaddr*>(&loopback), &loopback_size) == 0 &&
+        connect(wake, reinterpret_cast<sockaddr*>(&loopback), sizeof(loopback)) == 0;
+    if (!connected || !wake_ready || !SetNonBlocking(relay) || !SetNonBlocking(wake)) {
+        LOG_ERROR(Networking, "Could not open the LAN Play tunnel sockets");
+        CloseTunnelSocket(static_cast<intptr_t>(relay));
+        CloseTunnelSocket(static_cast<intptr_t>(wake));
+        return false;
+    }
+    relay_socket = static_cast<intptr_t>(relay);
+    wake_socket = static_cast<intptr_t>(wake);
+
+    running = true;
+    io_thread = std::thread(&LanPlayTunnel::IoThread, this);
+    LOG_INFO(Networking, "LAN Play tunnel up, relay {}", relay_address);
+    return true;
+}
+
+void LanPlayTunnel::Stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    u8 byte = 0;
+    send(static_cast<TunnelSocket>(wake_socket), reinterpret_cast<const char*>(&byte), 1, 0);
+    io_thread.join();
+    CloseTunnelSocket(relay_socket);
+    CloseTunnelSocket(wake_socket);
+    relay_socket = -1;
+    wake_socket = -1;
+    DrainRings();
+
+    LanPlayStats stats = GetStats();
+    LOG_INFO(Networking,
+             "LAN Play tunnel down: {} sent, {} received, {} dropped, added latency avg/max "
+             "send {}/{} us, receive {}/{} us, relay rtt {} us",
+             stats.frames_sent, stats.frames_received, stats.frames_dropped,
+             stats.send_latency_avg_ns / 1000, stats.send_latency_max_ns / 1000,
+             stats.receive_latency_avg_ns / 1000, stats.receive_latency_max_ns / 1000,
+             stats.relay_rtt_ns / 1000);
+}
+
+bool LanPlayTunnel::SendDatagram(u16 source_port, u32 dest_ip, u16 dest_port, const void* data,
+                                 u32 size) {
+    constexpr u32 MAX_PAYLOAD = MAX_IPV4_SIZE - IPV4_HEADER_SIZE - UDP_HEADER_SIZE;
+    if (!running || size > MAX_PAYLOAD) {
+        return false;
+    }
+    if (dest_ip == 0xFFFFFFFF) {
+        // The relay only knows the virtual subnet's broadcast address
+        dest_ip = guest_address | ~guest_netmask;
+    }
+    // Built in its final wire form, the I/O thread sends it as is
+    PacketBuffer* packet = AllocPacket();
+    u32 total = IPV4_HEADER_SIZE + UDP_HEADER_SIZE + size;
+    packet->data[0] = LANPLAY_IPV4;
+    u8* ip = packet->data + 1;
+    ip[0] = 0x45;
+    ip[1] = 0;
+    Put16(ip + 2, static_cast<u16>(total));
+    Put16(ip + 6, 0);
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP_NUMBER;
+    Put32(ip + 12, guest_address);
+    Put32(ip + 16, dest_ip);
+    // A zero UDP checksum means none over IPv4
+    u8* udp = ip + IPV4_HEADER_SIZE;
+    Put16(udp, source_port);
+    Put16(udp + 2, dest_port);
+    Put16(udp + 4, static_cast<u16>(UDP_HEADER_SIZE + size));
+    Put16(udp + 6, 0);
+    std::memcpy(udp + UDP_HEADER_SIZE, data, size);
+    packet->size = total + 1;
+    {
+        std::scoped_lock lock{send_mutex};
+        Put16(ip + 4, next_ip_id++);
+        Put16(ip + 10, 0);
+        Put16(ip + 10, HeaderChecksum(ip, IPV4_HEADER_SIZE));
+        packet->queued_ns = NowNs();
+        if (!outbound.Push(packet)) {
+            frames_dropped.fetch_add(1, std::memory_order_relaxed);
+            FreePacket(packet);
+            return false;
+        }
+    }
+    WakeIoThread();
+    return true;
+}
+
+int LanPlayTunnel::ReceiveDatagram(u32* source_ip, u16* source_port, u16* dest_port,
+                                   void* buffer, u32 buffer_size) {
+    PacketBuffer* packet;
+    {
+        std::scoped_lock lock{receive_mutex};
+        packet = inbound.Front();
+        if (!packet) {
+            return -1;
+        }
+        inbound.Pop();
+    }
+    // Packets were checked to be whole IPv4/UDP packets before they were queued
+    const u8* ip = packet->data + 1;
+    u32 ip_size = packet->size - 1;
+    u32 header_size = (ip[0] & 0xF) * 4;
+    const u8* udp = ip + header_size;
+    u32 size = std::min<u32>(Get16(udp + 4) - UDP_HEADER_SIZE,
+                             ip_size - header_size - UDP_HEADER_SIZE);
+    *source_ip = Get32(ip + 12);
+    *source_port = Get16(udp);
+    *dest_port = Get16(udp + 2);
+    std::memcpy(buffer, udp + UDP_HEADER_SIZE, std::min(size, buffer_size));
+    receive_latency.Add(NowNs() - packet->queued_ns);
+    FreePacket(packet);
+    return static_cast<int>(size);
+}
+
+LanPlayStats LanPlayTunnel::GetStats() const {
+    auto average = [](const LatencyCounter& counter) {
+        u64 count = counter.count.load(std::memory_order_relaxed);
+        return count ? counter.total_ns.load(std::memory_order_relaxed) / count : 0;
+    };
+    LanPlayStats stats{};
+    stats.frames_sent = frames_sent.load(std::memory_order_relaxed);
+    stats.frames_received = frames_received.load(std::memory_order_relaxed);
+    stats.frames_dropped = frames_dropped.load(std::memory_order_relaxed);
+    stats.send_latency_avg_ns = average(send_latency);
+    stats.send_latency_max_ns = send_latency.max_ns.load(std::memory_order_relaxed);
+    stats.receive_latency_avg_ns = average(receive_latency);
+    stats.receive_latency_max_ns = receive_latency.max_ns.load(std::memory_order_relaxed);
+    stats.relay_rtt_ns = relay_rtt_ns.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void LanPlayTunnel::WakeIoThread() {
+    // Pairs with the fence in IoThread: either it sees the new packet before sleeping, or
+    // we see it is about to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (io_sleeping.exchange(false)) {
+        u8 byte = 0;
+        send(static_cast<TunnelSocket>(wake_socket), reinterpret_cast<const char*>(&byte), 1, 0);
+    }
+}
+
+void LanPlayTunnel::SendControl(u8 type, const void* payload, u32 size) {
+    u8 packet[1 + sizeof(u64)];
+    packet[0] = type;
+    std::memcpy(packet + 1, payload, size);
+    send(static_cast<TunnelSocket>(relay_socket), reinterpret_cast<const char*>(packet),
+         static_cast<int>(1 + size), 0);
+}
+
+bool LanPlayTunnel::SendPending() {
+    while (PacketBuffer* packet = outbound.Front()) {
+        int result = send(static_cast<TunnelSocket>(relay_socket),
+                          reinterpret_cast<const char*>(packet->data),
+                          static_cast<int>(packet->size), 0);
+        if (result < 0 && WouldBlock()) {
+            // Socket buffer full, the caller waits for it to drain
+            return false;
+        }
+        if (result < 0) {
+            frames_dropped.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            frames_sent.fetch_add(1, std::memory_order_relaxed);
+            send_latency.Add(NowNs() - packet->queued_ns);
+        }
+        outbound.Pop();
+        FreePacket(packet);
+    }
+    return true;
+}
+
+void LanPlayTunnel::ReceiveFromRelay() {
+    const u32 broadcast = guest_address | ~guest_netmask;
+    // Received straight into a pooled packet that is queued as is; kept for the next
+    // datagram when this one is not for the guest
+    PacketPtr packet;
+    for (;;) {
+        if (!packet) {
+            packet.reset(AllocPacket());
+        }
+        int result = recv(static_cast<TunnelSocket>(relay_socket),
+                          reinterpret_cast<char*>(packet->data), 1 + MAX_IPV4_SIZE, 0);
+        if (result <= 0) {
+            return;
+        }
+        u32 size = static_cast<u32>(result) - 1;
+        const u8* ip = packet->data + 1;
+        switch (packet->data[0]) {
+        case LANPLAY_IPV4: {
+            u32 header_size = (ip[0] & 0xF) * 4;
+            if (size < IPV4_HEADER_SIZE + UDP_HEADER_SIZE || (ip[0] >> 4) != 4 ||
+                ip[9] != IPPROTO_UDP_NUMBER || header_size < IPV4_HEADER_SIZE ||
+                size < header_size + UDP_HEADER_SIZE ||
+                Get16(ip + header_size + 4) < UDP_HEADER_SIZE) {
+                frames_dropped.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            u32 dest = Get32(ip + 16);
+            if (dest != guest_address && dest != broadcast && dest != 0xFFFFFFFF) {
+                break;
+            }
+            packet->size = static_cast<u32>(result);
+            packet->queued_ns = NowNs();
+            if (!inbound.Push(packet.get())) {
+                frames_dropped.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            packet.release();
+            frames_received.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        case LANPLAY_PING:
+            if (size == sizeof(u64)) {
+                u64 sent_ns;
+                std::memcpy(&sent_ns, ip, sizeof(sent_ns));
+                relay_rtt_ns.store(NowNs() - sent_ns, std::memory_order_relaxed);
+            }
+            break;
+        case LANPLAY_IPV4_FRAG:
+            // Fragmented packets are not reassembled, LAN games stay below the MTU
+            frames_dropped.fetch_add(1, std::memory_order_relaxed);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void LanPlayTunnel::DrainRings() {
+    // Only called with the I/O thread stopped, so this thread may consume outbound.
+    // Guest threads holding the tunnel may still receive, inbound is theirs to share.
+    std::scoped_lock lock{receive_mutex};
+    for (auto* ring : {&outbound, &inbound}) {
+        while (PacketBuffer* packet = ring->Front()) {
+            ring->Pop();
+            FreePacket(packet);
+        }
+    }
+}
+
+void LanPlayTunnel::IoThread() {
+    auto next_ping = std::chrono::steady_clock::now();
+    TunnelPollFd fds[2]{};
+    fds[0].fd = static_cast<TunnelSocket>(relay_socket);
+    fds[0].events = POLLIN;
+    fds[1].fd = static_cast<TunnelSocket>(wake_socket);
+    fds[1].events = POLLIN;
+    while (running.load(std::memory_order_acquire)) {
+        bool sent_all = SendPending();
+        ReceiveFromRelay();
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_ping) {
+            // Doubles as the keepalive, the relay answers with the same payload
+            u64 now_ns = NowNs();
+            SendControl(LANPLAY_PING, &now_ns, sizeof(now_ns));
+            next_ping = now + PING_INTERVAL;
+        }
+
+        io_sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sent_all && !outbound.Empty()) {
+            io_sleeping.store(false);
+            continue;
+        }
+        // A full socket buffer keeps the rest queued until the relay socket is writable
+        fds[0].events = sent_all ? POLLIN : POLLIN | POLLOUT;
+        int timeout_ms = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(next_ping - now).count() + 1);
+        PollSockets(fds, 2, timeout_ms);
+        io_sleeping.store(false);
+        if (fds[1].revents) {
+            u8 drain[16];
+            while (recv(static_cast<TunnelSocket>(wake_socket), reinterpret_cast<char*>(drain),
+                        sizeof(drain), 0) > 0) {
+            }
+        }
+    }
+}
+
+} // namespace Networking
+} // namespace Core
@@ -0,0 +1,109 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "common/types.h"
+#include "packet_pool.h"
+
+namespace Core {
+namespace Networking {
+
+struct LanPlayStats {
+    u64 frames_sent;
+    u64 frames_received;
+    // Frames lost because a queue was full or the relay sent something unusable
+    u64 frames_dropped;
+    // Time frames waited between the guest and the wire, in each direction
+    u64 send_latency_avg_ns;
+    u64 send_latency_max_ns;
+    u64 receive_latency_avg_ns;
+    u64 receive_latency_max_ns;
+    // Last round trip to the relay measured with a ping, 0 until the first reply
+    u64 relay_rtt_ns;
+};
+
+// Tunnel to a switch-lan-play compatible relay. Guest datagrams are wrapped in IPv4/UDP
+// packets from the guest's virtual LAN address and relayed over one UDP socket. All
+// socket work happens on the tunnel's own thread; guest threads only touch the frame
+// rings, so a slow relay never blocks emulation.
+class LanPlayTunnel {
+public:
+    // Largest IPv4 packet carried, the virtual LAN's MTU
+    static constexpr u32 MAX_IPV4_SIZE = 1500;
+
+    LanPlayTunnel(std::string relay_address, std::string guest_ip);
+    ~LanPlayTunnel();
+
+    // Resolves the relay and starts the I/O thread, false if the relay is unusable
+    bool Start();
+    void Stop();
+
+    // Queue a UDP datagram for the virtual LAN, dest_ip in host byte order and
+    // 0xFFFFFFFF or the subnet broadcast for broadcast. False if the queue is full or
+    // the datagram does not fit one frame.
+    bool SendDatagram(u16 source_port, u32 dest_ip, u16 dest_port, const void* data, u32 size);
+    // Next UDP datagram from the virtual LAN, -1 when none is waiting. Returns the
+    // datagram size, the copy is cut to buffer_size.
+    int ReceiveDatagram(u32* source_ip, u16* source_port, u16* dest_port, void* buffer,
+                        u32 buffer_size);
+
+    u32 GetGuestAddress() const {
+        return guest_address;
+    }
+    LanPlayStats GetStats() const;
+
+private:
+    static constexpr u32 RING_SIZE = 256;
+
+    struct LatencyCounter {
+        std::atomic<u64> count{0};
+        std::atomic<u64> total_ns{0};
+        std::atomic<u64> max_ns{0};
+
+        void Add(u64 ns);
+    };
+
+    void DrainRings();
+    void IoThread();
+    // False if the relay socket would block with datagrams still queued
+    bool SendPending();
+    void ReceiveFromRelay();
+    void SendControl(u8 type, const void* payload, u32 size);
+    void WakeIoThread();
+
+    std::string relay_address;
+    u32 guest_address = 0;
+    u32 guest_netmask = 0xFFFF0000;
+
+    // Socket handles are kept as integers so this header stays free of platform headers
+    intptr_t relay_socket = -1;
+    intptr_t wake_socket = -1;
+    std::atomic_bool running{false};
+    // Set while the I/O thread is about to sleep, producers then wake it
+    std::atomic_bool io_sleeping{false};
+    std::thread io_thread;
+
+    // Guest threads share one side of each ring, these keep them from racing each other
+    std::mutex send_mutex;
+    std::mutex receive_mutex;
+    u16 next_ip_id = 0;
+    // Packets hold the relay framing byte followed by the IPv4 packet
+    PacketRing<RING_SIZE> outbound;
+    PacketRing<RING_SIZE> inbound;
+
+    std::atomic<u64> frames_sent{0};
+    std::atomic<u64> frames_received{0};
+    std::atomic<u64> frames_dropped{0};
+    LatencyCounter send_latency;
+    LatencyCounter receive_latency;
+    std::atomic<u64> relay_rtt_ns{0};
+};
+
+} // namespace Networking
+} // namespace Core
@@ -8,7 +8,7 @@
 namespace Core {
 namespace Networking {
 
-NetworkingCore::NetworkingCore() : lan_play_tunnel_handle(nullptr, [](void*){}) {
+NetworkingCore::NetworkingCore() {
     LOG_INFO(Networking, "NetworkingCore created.");
 }
 
@@ -36,12 +36,14 @@ void NetworkingCore::Shutdown() {
 }
 
 void NetworkingCore::UpdateConfig(const Config& new_config) {
-    if (current_config.mode == Mode::LAN_Play && new_config.mode != Mode::LAN_Play) {
+    Mode old_mode = current_config.mode;
+    // The tunnel starts from the new relay and guest address
+    current_config = new_config;
+    if (old_mode == Mode::LAN_Play && new_config.mode != Mode::LAN_Play) {
         StopLANPlayTunnel();
-    } else if (current_config.mode != Mode::LAN_Play && new_config.mode == Mode::LAN_Play) {
+    } else if (old_mode != Mode::LAN_Play && new_config.mode == Mode::LAN_Play) {
         StartLANPlayTunnel();
     }
-    current_config = new_config;
     LOG_INFO(Networking, "Networking config updated. Mode: {}", (int)current_config.mode);
 }
 
@@ -92,26 +94,36 @@ int NetworkingCore::sceNetRecv(int s, void* buf, size_t len, int flags) {
 // --- LAN Play Implementation ---
 
 void NetworkingCore::StartLANPlayTunnel() {
-    if (lan_play_tunnel_handle.get() != nullptr) {
+    if (GetLANPlayTunnel()) {
         LOG_WARN(Networking, "LAN Play tunnel already running.");
         return;
     }
-    
-    // TODO: Actual implementation of the LAN Play tunnel (UDP socket, thread, packet handling)
+
     LOG_INFO(Networking, "Starting LAN Play tunnel to relay: {}", current_config.lan_play_relay_address);
-    // For now, just set a dummy handle to indicate it's "running"
-    lan_play_tunnel_handle.reset((void*)1); 
+    auto tunnel = std::make_shared<LanPlayTunnel>(current_config.lan_play_relay_address,
+                                                  current_config.guest_ip);
+    if (!tunnel->Start()) {
+        LOG_ERROR(Networking, "LAN Play tunnel could not be started.");
+        return;
+    }
+    std::scoped_lock lock{tunnel_mutex};
+    lan_play_tunnel = std::move(tunnel);
 }
 
 void NetworkingCore::StopLANPlayTunnel() {
-    if (lan_play_tunnel_handle.get() == nullptr) {
+    std::shared_ptr<LanPlayTunnel> tunnel;
+    {
+        std::scoped_lock lock{tunnel_mutex};
+        tunnel = std::move(lan_play_tunnel);
+    }
+    if (!tunnel) {
         LOG_WARN(Networking, "LAN Play tunnel is not running.");
         return;
     }
-    
-    // TODO: Clean up resources (close socket, join thread)
+
     LOG_INFO(Networking, "Stopping LAN Play tunnel.");
-    lan_play_tunnel_handle.reset(nullptr);
+    // Guest threads holding a reference free it once they are done
+    tunnel->Stop();
 }
 
 } // namespace Networking
@@ -5,8 +5,10 @@
 
 #include <string>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include "common/singleton.h"
+#include "lan_play_tunnel.h"
 
 namespace Core {
 namespace Networking {
@@ -24,6 +26,9 @@ struct Config {
     std::string ezfn_server_address = "";
     std::string gtav_server_address = "";
     bool spoof_psn = false;
+    // Guest AF_UNIX stream sockets between emulator instances on this host move their data
+    // through shared memory instead of the kernel. Every instance involved must enable it.
+    bool shm_unix_sockets = false;
 };
 
 class NetworkingCore {
@@ -34,6 +39,9 @@ public:
     void Init();
     void Shutdown();
     void UpdateConfig(const Config& new_config);
+    const Config& GetConfig() const {
+        return current_config;
+    }
 
     // Core HLE functions to intercept guest network calls
     // Placeholder for actual HLE implementation
@@ -46,12 +54,19 @@ public:
     // LAN Play specific functions
     void StartLANPlayTunnel();
     void StopLANPlayTunnel();
+    // Null unless LAN Play is running. The reference keeps the tunnel alive across a
+    // concurrent stop, after which its sends fail.
+    std::shared_ptr<LanPlayTunnel> GetLANPlayTunnel() {
+        std::scoped_lock lock{tunnel_mutex};
+        return lan_play_tunnel;
+    }
 
 private:
     Config current_config;
     bool is_initialized = false;
-    // Placeholder for the actual LAN Play tunnel implementation (e.g., a UDP socket and a separate thread)
-    std::unique_ptr<void, void(*)(void*)> lan_play_tunnel_handle; 
+    // Guards lan_play_tunnel, which guest threads read while the config changes
+    std::mutex tunnel_mutex;
+    std::shared_ptr<LanPlayTunnel> lan_play_tunnel;
 };
 
 } // namespace Networking
@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "packet_pool.h"
+
+namespace Core {
+namespace Networking {
+
+// A thread keeps up to CACHE_LIMIT free buffers and trades TRANSFER_BATCH at a time with
+// the shared list. Buffers usually die on a different thread than they were born on
+// (guest thread to I/O thread and back), batching keeps that flow cheap.
+constexpr u32 CACHE_LIMIT = 64;
+constexpr u32 TRANSFER_BATCH = 32;
+constexpr u32 SLAB_PACKETS = 64;
+
+namespace {
+
+class SharedPool {
+public:
+    // Chain of count buffers linked through next, or {nullptr, 0} if none are left
+    std::pair<PacketBuffer*, u32> TakeChain() {
+        std::scoped_lock lock{mutex};
+        if (chains.empty()) {
+            return {nullptr, 0};
+        }
+        auto chain = chains.back();
+        chains.pop_back();
+        return chain;
+    }
+
+    void GiveChain(PacketBuffer* head, u32 count) {
+        std::scoped_lock lock{mutex};
+        chains.emplace_back(head, count);
+    }
+
+    // Fresh buffers linked into one chain, only when every cache and the list are empty
+    PacketBuffer* NewSlab() {
+        auto slab = std::make_unique<PacketBuffer[]>(SLAB_PACKETS);
+        for (u32 i = 0; i < SLAB_PACKETS; i++) {
+            slab[i].next = i + 1 < SLAB_PACKETS ? &slab[i + 1] : nullptr;
+        }
+        PacketBuffer* head = slab.get();
+        std::scoped_lock lock{mutex};
+        slabs.push_back(std::move(slab));
+        return head;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::pair<PacketBuffer*, u32>> chains;
+    std::vector<std::unique_ptr<PacketBuffer[]>> slabs;
+};
+
+// Never destroyed: I/O threads of singletons and thread caches of exiting threads can
+// still return buffers while static destructors run
+SharedPool& Shared() {
+    static SharedPool* pool = new SharedPool;
+    return *pool;
+}
+
+struct ThreadCache {
+    PacketBuffer* head = nullptr;
+    u32 count = 0;
+
+    ~ThreadCache() {
+        // Hand everything back so buffers of exited threads are reused
+        if (head) {
+            Shared().GiveChain(head, count);
+        }
+    }
+};
+
+thread_local ThreadCache cache;
+
+} // namespace
+
+PacketBuffer* AllocPacket() {
+    if (!cache.head) {
+        auto [head, count] = Shared().TakeChain();
+        if (!head) {
+            head = Shared().NewSlab();
+            count = SLAB_PACKETS;
+        }
+        cache.head = head;
+        cache.count = count;
+    }
+    PacketBuffer* packet = cache.head;
+    cache.head = packet->next;
+    cache.count--;
+    packet->size = 0;
+    packet->offset = 0;
+    return packet;
+}
+
+void FreePacket(PacketBuffer* packet) {
+    if (!packet) {
+        return;
+    }
+    packet->next = cache.head;
+    cache.head = packet;
+    if (++cache.count < CACHE_LIMIT) {
+        return;
+    }
+    // Split off the oldest TRANSFER_BATCH buffers, the newest stay warm in this thread
+    PacketBuffer* last_kept = cache.head;
+    for (u32 i = 1; i < CACHE_LIMIT - TRANSFER_BATCH; i++) {
+        last_kept = last_kept->next;
+    }
+    Shared().GiveChain(last_kept->next, TRANSFER_BATCH);
+    last_kept->next = nullptr;
+    cache.count = CACHE_LIMIT - TRANSFER_BATCH;
+}
+
+} // namespace Networking
+} // namespace Core
@@ -0,0 +1,102 @@
+// SPDX-FileCopyrightText: Copyright 2025 LayraPS4 Emulator Project
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include "common/types.h"
+
+namespace Core {
+namespace Networking {
+
+// Fixed-size buffer for one datagram. Buffers come from the packet pool and travel
+// between queues by pointer, the payload is written once and never copied in between.
+struct alignas(64) PacketBuffer {
+    static constexpr u32 TOTAL_SIZE = 2048;
+    static constexpr u32 HEADER_SIZE = 64;
+    static constexpr u32 CAPACITY = TOTAL_SIZE - HEADER_SIZE;
+
+    // Free list link, only meaningful while the buffer is in the pool
+    PacketBuffer* next;
+    u32 size;
+    // Host steady clock when the buffer entered its current queue
+    u64 queued_ns;
+    // Sender of a received datagram: IPv4 address and port in host byte order, plus the
+    // P2P virtual port
+    u32 address;
+    u16 port;
+    u16 vport;
+    // Stream sequence number, and where the unread payload starts in data
+    u32 seq;
+    u32 offset;
+    alignas(64) u8 data[CAPACITY];
+};
+static_assert(sizeof(PacketBuffer) == PacketBuffer::TOTAL_SIZE);
+
+// Buffers are cached per thread and exchanged with a shared overflow list in batches, so
+// the usual alloc/free pair costs no lock and no heap call. The pool only grows, to the
+// peak number of buffers in flight.
+PacketBuffer* AllocPacket();
+void FreePacket(PacketBuffer* packet);
+
+struct PacketDeleter {
+    void operator()(PacketBuffer* packet) const {
+        FreePacket(packet);
+    }
+};
+using PacketPtr = std::unique_ptr<PacketBuffer, PacketDeleter>;
+
+// Lock-free ring of packet pointers between one producing and one consuming thread
+template <u32 Size>
+class PacketRing {
+    static_assert((Size & (Size - 1)) == 0, "ring size must be a power of two");
+
+public:
+    // Producer side, false if the ring is full and the packet stays with the caller
+    bool Push(PacketBuffer* packet) {
+        u32 tail = write_index.load(std::memory_order_relaxed);
+        if (tail - cached_read_index == Size) {
+            // Only reload the consumer's index when the cached one says we are full
+            cached_read_index = read_index.load(std::memory_order_acquire);
+            if (tail - cached_read_index == Size) {
+                return false;
+            }
+        }
+        packets[tail & (Size - 1)] = packet;
+        write_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, null when the ring is empty. Pop once done with the packet.
+    PacketBuffer* Front() {
+        u32 head = read_index.load(std::memory_order_relaxed);
+        if (head == cached_write_index) {
+            cached_write_index = write_index.load(std::memory_order_acquire);
+            if (head == cached_write_index) {
+                return nullptr;
+            }
+        }
+        return packets[head & (Size - 1)];
+    }
+    void Pop() {
+        read_index.store(read_index.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+    }
+
+    bool Empty() const {
+        return read_index.load(std::memory_order_acquire) ==
+               write_index.load(std::memory_order_acquire);
+    }
+
+private:
+    // Producer and consumer state live on separate cache lines
+    alignas(64) std::atomic<u32> write_index{0};
+    u32 cached_read_index = 0;
+    alignas(64) std::atomic<u32> read_index{0};
+    u32 cached_write_index = 0;
+    alignas(64) PacketBuffer* packets[Size];
+};
+
+} // namespace Networking
+} // namespace Core
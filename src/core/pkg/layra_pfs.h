@@ -0,0 +1,60 @@
+#ifndef LAYRA_PFS_H
+#define LAYRA_PFS_H
+#include <stdint.h>
+
+// PFS structures are little-endian, unlike the package header around them
+#define LAYRA_PFS_MAGIC 20130315
+#define LAYRA_PFS_INODE_SIZE 0xA8
+
+#define LAYRA_PFS_DIRENT_FILE 2
+#define LAYRA_PFS_DIRENT_DIRECTORY 3
+#define LAYRA_PFS_DIRENT_DOT 4
+#define LAYRA_PFS_DIRENT_DOTDOT 5
+
+// Superblock at the start of the PFS image
+typedef struct {
+    int64_t version;
+    int64_t magic;
+    int64_t id;
+    uint8_t fmode;
+    uint8_t clean;
+    uint8_t read_only;
+    uint8_t rsv;
+    uint16_t mode;
+    uint16_t unk1;
+    int32_t block_size;
+    int32_t backup_count;
+    int64_t block_count;
+    int64_t dinode_count;
+    int64_t data_block_count;
+    int64_t dinode_block_count;
+    int64_t superroot_ino;
+} layra_pfs_header_t;
+
+// Inode as stored in the inode blocks following the superblock. Files and
+// directories occupy contiguous blocks starting at loc.
+typedef struct {
+    uint16_t mode;
+    uint16_t nlink;
+    uint32_t flags;
+    int64_t size;
+    int64_t size_compressed;
+    int64_t time_sec[4];
+    uint32_t time_nsec[4];
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t unk1;
+    uint64_t unk2;
+    uint32_t blocks;
+    uint32_t loc;
+} layra_pfs_inode_t;
+
+// Directory entry header, followed by namelen name bytes; entries are entsize long
+typedef struct {
+    int32_t ino;
+    int32_t type;
+    int32_t namelen;
+    int32_t entsize;
+} layra_pfs_dirent_t;
+
+#endif // LAYRA_PFS_H
@@ -0,0 +1,310 @@
+#include <string.h>
+#include <vector>
+#include "layra_pkg.h"
+#include "layra_vfs.h"
+#include "layra_xts.h"
+#include "vfs_handlers.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Leading PFS image sectors stored in the clear (the superblock)
+#define LAYRA_PFS_PLAIN_SECTORS 1
+
+struct layra_pkg {
+    // Read-only view of the whole file
+    const uint8_t* data;
+    uint64_t size;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+    // Built once at open and never modified afterwards
+    layra_pkg_info_t info;
+    std::vector<layra_pkg_entry_t> entries;
+    std::vector<const char*> names;
+    int has_keys;
+    // Expanded once here so sector reads only run the cipher
+    layra_xts_key_t xts_key;
+};
+
+static int layra_pkg_in_bounds(const layra_pkg_t* pkg, uint64_t offset, uint64_t size) {
+    return offset <= pkg->size && size <= pkg->size - offset;
+}
+
+static int layra_pkg_map_file(layra_pkg_t* pkg, const char* path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return -1;
+    }
+    // The mapping keeps the file open
+    pkg->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!pkg->mapping) {
+        return -1;
+    }
+    pkg->data = (const uint8_t*)MapViewOfFile(pkg->mapping, FILE_MAP_READ, 0, 0, 0);
+    pkg->size = (uint64_t)size.QuadPart;
+    return pkg->data ? 0 : -1;
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    pkg->data = (const uint8_t*)data;
+    pkg->size = (uint64_t)info.st_size;
+    return 0;
+#endif
+}
+
+// Validate the header and convert it and the entry table to host order, in one pass
+static int layra_pkg_build_index(layra_pkg_t* pkg) {
+    if (pkg->size < sizeof(layra_pkg_header_t)) {
+        return -1;
+    }
+    const layra_pkg_header_t* header = (const layra_pkg_header_t*)pkg->data;
+    if (BE32_TO_HOST(header->pkg_magic) != LAYRA_PKG_MAGIC) {
+        return -1;
+    }
+    layra_pkg_info_t* info = &pkg->info;
+    info->pkg_type = BE32_TO_HOST(header->pkg_type);
+    info->file_count = BE32_TO_HOST(header->pkg_file_count);
+    info->entry_count = BE32_TO_HOST(header->pkg_entry_count);
+    info->table_offset = BE32_TO_HOST(header->pkg_table_offset);
+    info->body_offset = BE64_TO_HOST(header->pkg_body_offset);
+    info->body_size = BE64_TO_HOST(header->pkg_body_size);
+    info->content_offset = BE64_TO_HOST(header->pkg_content_offset);
+    info->content_size = BE64_TO_HOST(header->pkg_content_size);
+    memcpy(info->content_id, header->pkg_content_id, sizeof(header->pkg_content_id));
+    info->content_id[sizeof(header->pkg_content_id)] = '\0';
+    info->drm_type = BE32_TO_HOST(header->pkg_drm_type);
+    info->content_type = BE32_TO_HOST(header->pkg_content_type);
+    info->content_flags = BE32_TO_HOST(header->pkg_content_flags);
+    info->pfs_image_count = BE32_TO_HOST(header->pfs_image_count);
+    info->pfs_image_flags = BE64_TO_HOST(header->pfs_image_flags);
+    info->pfs_image_offset = BE64_TO_HOST(header->pfs_image_offset);
+    info->pfs_image_size = BE64_TO_HOST(header->pfs_image_size);
+    info->mount_image_offset = BE64_TO_HOST(header->mount_image_offset);
+    info->mount_image_size = BE64_TO_HOST(header->mount_image_size);
+    info->pkg_size = BE64_TO_HOST(header->pkg_size);
+    if (!layra_pkg_in_bounds(pkg, info->table_offset,
+                             (uint64_t)info->entry_count * sizeof(layra_pkg_entry_t)) ||
+        !layra_pkg_in_bounds(pkg, info->pfs_image_offset, info->pfs_image_size)) {
+        return -1;
+    }
+
+    const layra_pkg_entry_t* raw = (const layra_pkg_entry_t*)(pkg->data + info->table_offset);
+    pkg->entries.resize(info->entry_count);
+    const layra_pkg_entry_t* names_entry = NULL;
+    for (uint32_t i = 0; i < info->entry_count; i++) {
+        layra_pkg_entry_t* entry = &pkg->entries[i];
+        entry->id = BE32_TO_HOST(raw[i].id);
+        entry->filename_offset = BE32_TO_HOST(raw[i].filename_offset);
+        entry->flags1 = BE32_TO_HOST(raw[i].flags1);
+        entry->flags2 = BE32_TO_HOST(raw[i].flags2);
+        entry->offset = BE32_TO_HOST(raw[i].offset);
+        entry->size = BE32_TO_HOST(raw[i].size);
+        entry->padding = 0;
+        if (entry->id == LAYRA_PKG_ENTRY_ID_NAMES) {
+            names_entry = entry;
+        }
+    }
+
+    // Names are only usable when the names table is stored in the clear
+    pkg->names.assign(info->entry_count, NULL);
+    if (names_entry && layra_pkg_in_bounds(pkg, names_entry->offset, names_entry->size)) {
+        const char* table = (const char*)pkg->data + names_entry->offset;
+        for (uint32_t i = 0; i < info->entry_count; i++) {
+            uint32_t offset = pkg->entries[i].filename_offset;
+            if (offset == 0 || offset >= names_entry->size) {
+                continue;
+            }
+            if (memchr(table + offset, '\0', names_entry->size - offset)) {
+                pkg->names[i] = table + offset;
+            }
+        }
+    }
+    return 0;
+}
+
+layra_pkg_t* layra_pkg_open(const char* path) {
+    if (!path) {
+        return NULL;
+    }
+    layra_pkg_t* pkg = new layra_pkg_t();
+    pkg->data = NULL;
+    pkg->size = 0;
+#ifdef _WIN32
+    pkg->mapping = NULL;
+#endif
+    pkg->has_keys = 0;
+    if (layra_pkg_map_file(pkg, path) != 0 || layra_pkg_build_index(pkg) != 0) {
+        layra_pkg_close(pkg);
+        return NULL;
+    }
+    return pkg;
+}
+
+void layra_pkg_close(layra_pkg_t* pkg) {
+    if (!pkg) {
+        return;
+    }
+#ifdef _WIN32
+    if (pkg->data) {
+        UnmapViewOfFile(pkg->data);
+    }
+    if (pkg->mapping) {
+        CloseHandle(pkg->mapping);
+    }
+#else
+    if (pkg->data) {
+        munmap((void*)pkg->data, (size_t)pkg->size);
+    }
+#endif
+    delete pkg;
+}
+
+const layra_pkg_header_t* layra_pkg_get_header(const layra_pkg_t* pkg) {
+    return (const layra_pkg_header_t*)pkg->data;
+}
+
+const layra_pkg_info_t* layra_pkg_get_info(const layra_pkg_t* pkg) {
+    return &pkg->info;
+}
+
+uint32_t layra_pkg_get_entry_count(const layra_pkg_t* pkg) {
+    return (uint32_t)pkg->entries.size();
+}
+
+const layra_pkg_entry_t* layra_pkg_get_entries(const layra_pkg_t* pkg) {
+    return pkg->entries.data();
+}
+
+int layra_pkg_get_entry(const layra_pkg_t* pkg, uint32_t index, layra_pkg_entry_t* entry) {
+    if (index >= pkg->entries.size()) {
+        return -1;
+    }
+    *entry = pkg->entries[index];
+    return 0;
+}
+
+int layra_pkg_find_entry(const layra_pkg_t* pkg, uint32_t id, layra_pkg_entry_t* entry) {
+    for (const layra_pkg_entry_t& candidate : pkg->entries) {
+        if (candidate.id == id) {
+            *entry = candidate;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* layra_pkg_get_entry_name(const layra_pkg_t* pkg, uint32_t index) {
+    return index < pkg->names.size() ? pkg->names[index] : NULL;
+}
+
+const uint8_t* layra_pkg_map(const layra_pkg_t* pkg, uint64_t offset, uint64_t size) {
+    return layra_pkg_in_bounds(pkg, offset, size) ? pkg->data + offset : NULL;
+}
+
+int layra_pkg_read(layra_pkg_t* pkg, uint64_t offset, void* buffer, size_t size) {
+    const uint8_t* data = layra_pkg_map(pkg, offset, size);
+    if (!data) {
+        return -1;
+    }
+    memcpy(buffer, data, size);
+    return 0;
+}
+
+uint64_t layra_pkg_get_pfs_offset(const layra_pkg_t* pkg) {
+    return pkg->info.pfs_image_offset;
+}
+
+uint64_t layra_pkg_get_pfs_size(const layra_pkg_t* pkg) {
+    return pkg->info.pfs_image_size;
+}
+
+int layra_pkg_set_pfs_keys(layra_pkg_t* pkg, const uint8_t data_key[LAYRA_PKG_KEY_SIZE],
+                           const uint8_t tweak_key[LAYRA_PKG_KEY_SIZE]) {
+    if (!pkg || !data_key || !tweak_key) {
+        return -1;
+    }
+    layra_xts_init_key(&pkg->xts_key, data_key, tweak_key);
+    pkg->has_keys = 1;
+    return 0;
+}
+
+int layra_pkg_has_pfs_keys(const layra_pkg_t* pkg) {
+    return pkg && pkg->has_keys;
+}
+
+int layra_pkg_read_pfs_sectors(layra_pkg_t* pkg, uint64_t first_sector, uint32_t count,
+                               void* buffer) {
+    uint64_t pfs_size = layra_pkg_get_pfs_size(pkg);
+    uint64_t sector_count = (pfs_size + LAYRA_PKG_SECTOR_SIZE - 1) / LAYRA_PKG_SECTOR_SIZE;
+    if (first_sector >= sector_count || count > sector_count - first_sector) {
+        return -1;
+    }
+    // The image end need not be sector aligned, zero the tail of the last sector
+    uint64_t offset = first_sector * LAYRA_PKG_SECTOR_SIZE;
+    size_t size = (size_t)count * LAYRA_PKG_SECTOR_SIZE;
+    size_t available = pfs_size - offset < size ? (size_t)(pfs_size - offset) : size;
+    if (layra_pkg_read(pkg, layra_pkg_get_pfs_offset(pkg) + offset, buffer, available) != 0) {
+        return -1;
+    }
+    memset((uint8_t*)buffer + available, 0, size - available);
+    if (!pkg->has_keys) {
+        return 0;
+    }
+    uint8_t* data = (uint8_t*)buffer;
+    if (first_sector < LAYRA_PFS_PLAIN_SECTORS) {
+        uint32_t plain = (uint32_t)(LAYRA_PFS_PLAIN_SECTORS - first_sector);
+        plain = plain < count ? plain : count;
+        data += (size_t)plain * LAYRA_PKG_SECTOR_SIZE;
+        first_sector += plain;
+        count -= plain;
+    }
+    // Large reads are split across the crypto workers, small ones stay on this thread
+    layra_xts_decrypt_sectors_parallel(&pkg->xts_key, first_sector, count, data);
+    return 0;
+}
+
+int layra_pkg_mount(layra_pkg_t* pkg, const char* mount_point) {
+    if (!pkg) {
+        return -1;
+    }
+    layra_vfs_handler_t handler;
+    if (vfs_pkg_handler_create(pkg, &handler) != 0) {
+        return -1;
+    }
+    if (layra_vfs_mount_handler(mount_point, &handler) != 0) {
+        handler.destroy(handler.ctx);
+        return -1;
+    }
+    return 0;
+}
+
+int layra_pkg_open_and_mount(const char* pkg_path, const char* mount_point) {
+    // Nothing is extracted: files are read and decrypted out of the package on demand
+    return layra_pkg_mount(layra_pkg_open(pkg_path), mount_point);
+}
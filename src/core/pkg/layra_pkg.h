@@ -0,0 +1,158 @@
+#ifndef LAYRA_PKG_H
+#define LAYRA_PKG_H
+#include <stddef.h>
+#include <stdint.h>
+
+#define LAYRA_PKG_MAGIC 0x7F434E54
+// PFS images are encrypted in XTS sectors of this size
+#define LAYRA_PKG_SECTOR_SIZE 0x1000
+#define LAYRA_PKG_KEY_SIZE 16
+
+// PKG headers are big-endian on disk
+#define BE16_TO_HOST(x) layra_pkg_swap16(x)
+#define BE32_TO_HOST(x) layra_pkg_swap32(x)
+#define BE64_TO_HOST(x) layra_pkg_swap64(x)
+
+static inline uint16_t layra_pkg_swap16(uint16_t value) {
+    return (uint16_t)((value >> 8) | (value << 8));
+}
+
+static inline uint32_t layra_pkg_swap32(uint32_t value) {
+    return ((value >> 24) & 0xFF) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) |
+           (value << 24);
+}
+
+static inline uint64_t layra_pkg_swap64(uint64_t value) {
+    return ((uint64_t)layra_pkg_swap32((uint32_t)value) << 32) |
+           layra_pkg_swap32((uint32_t)(value >> 32));
+}
+
+// On-disk package header (see PKG_Design.md), fields are big-endian
+typedef struct {
+    uint32_t pkg_magic;
+    uint32_t pkg_type;
+    uint32_t pkg_0x008;
+    uint32_t pkg_file_count;
+    uint32_t pkg_entry_count;
+    uint16_t pkg_sc_entry_count;
+    uint16_t pkg_entry_count_2;
+    uint32_t pkg_table_offset;
+    uint32_t pkg_entry_data_size;
+    uint64_t pkg_body_offset;
+    uint64_t pkg_body_size;
+    uint64_t pkg_content_offset;
+    uint64_t pkg_content_size;
+    unsigned char pkg_content_id[0x24];
+    unsigned char pkg_padding[0xC];
+    uint32_t pkg_drm_type;
+    uint32_t pkg_content_type;
+    uint32_t pkg_content_flags;
+    uint32_t pkg_promote_size;
+    uint32_t pkg_version_date;
+    uint32_t pkg_version_hash;
+    uint32_t pkg_0x088;
+    uint32_t pkg_0x08C;
+    uint32_t pkg_0x090;
+    uint32_t pkg_0x094;
+    uint32_t pkg_iro_tag;
+    uint32_t pkg_drm_type_version;
+    unsigned char pkg_zeroes_1[0x60];
+    unsigned char digest_entries1[0x20];
+    unsigned char digest_entries2[0x20];
+    unsigned char digest_table_digest[0x20];
+    unsigned char digest_body_digest[0x20];
+    unsigned char pkg_zeroes_2[0x280];
+    uint32_t pkg_0x400;
+    uint32_t pfs_image_count;
+    uint64_t pfs_image_flags;
+    uint64_t pfs_image_offset;
+    uint64_t pfs_image_size;
+    uint64_t mount_image_offset;
+    uint64_t mount_image_size;
+    uint64_t pkg_size;
+    uint32_t pfs_signed_size;
+    uint32_t pfs_cache_size;
+    unsigned char pfs_image_digest[0x20];
+    unsigned char pfs_signed_digest[0x20];
+    uint64_t pfs_split_size_nth_0;
+    uint64_t pfs_split_size_nth_1;
+    unsigned char pkg_zeroes_3[0xB50];
+    unsigned char pkg_digest[0x20];
+} layra_pkg_header_t;
+
+// Entry of the file table at pkg_table_offset, big-endian on disk
+typedef struct {
+    uint32_t id;
+    uint32_t filename_offset;
+    uint32_t flags1;
+    uint32_t flags2;
+    uint32_t offset;
+    uint32_t size;
+    uint64_t padding;
+} layra_pkg_entry_t;
+
+// Native-endian summary of the header, validated against the file size at open
+typedef struct {
+    uint32_t pkg_type;
+    uint32_t file_count;
+    uint32_t entry_count;
+    uint32_t table_offset;
+    uint64_t body_offset;
+    uint64_t body_size;
+    uint64_t content_offset;
+    uint64_t content_size;
+    char content_id[0x25];
+    uint32_t drm_type;
+    uint32_t content_type;
+    uint32_t content_flags;
+    uint32_t pfs_image_count;
+    uint64_t pfs_image_flags;
+    uint64_t pfs_image_offset;
+    uint64_t pfs_image_size;
+    uint64_t mount_image_offset;
+    uint64_t mount_image_size;
+    uint64_t pkg_size;
+} layra_pkg_info_t;
+
+// Table entry holding the names of the other entries
+#define LAYRA_PKG_ENTRY_ID_NAMES 0x200
+
+typedef struct layra_pkg layra_pkg_t;
+
+// PKG functions, returning 0 on success and -1 on failure unless noted.
+// Opening maps the file and indexes it once; the getters below are plain memory
+// lookups into that index and never touch the file.
+layra_pkg_t* layra_pkg_open(const char* path);
+void layra_pkg_close(layra_pkg_t* pkg);
+// Raw header as stored in the file
+const layra_pkg_header_t* layra_pkg_get_header(const layra_pkg_t* pkg);
+const layra_pkg_info_t* layra_pkg_get_info(const layra_pkg_t* pkg);
+uint32_t layra_pkg_get_entry_count(const layra_pkg_t* pkg);
+// Table entries in host order, get_entry_count() long
+const layra_pkg_entry_t* layra_pkg_get_entries(const layra_pkg_t* pkg);
+int layra_pkg_get_entry(const layra_pkg_t* pkg, uint32_t index, layra_pkg_entry_t* entry);
+int layra_pkg_find_entry(const layra_pkg_t* pkg, uint32_t id, layra_pkg_entry_t* entry);
+// Name of an entry from the names table, NULL for unnamed entries
+const char* layra_pkg_get_entry_name(const layra_pkg_t* pkg, uint32_t index);
+// Raw package bytes, straight out of the mapping
+const uint8_t* layra_pkg_map(const layra_pkg_t* pkg, uint64_t offset, uint64_t size);
+int layra_pkg_read(layra_pkg_t* pkg, uint64_t offset, void* buffer, size_t size);
+// PFS image location inside the package
+uint64_t layra_pkg_get_pfs_offset(const layra_pkg_t* pkg);
+uint64_t layra_pkg_get_pfs_size(const layra_pkg_t* pkg);
+// XTS keys of the PFS image. They come from the package's EKPFS, which needs the
+// console keys to unwrap, so the caller supplies them. Without keys the image is
+// treated as plaintext (debug and pre-decrypted images).
+int layra_pkg_set_pfs_keys(layra_pkg_t* pkg, const uint8_t data_key[LAYRA_PKG_KEY_SIZE],
+                           const uint8_t tweak_key[LAYRA_PKG_KEY_SIZE]);
+// Non-zero once keys are set, reads of the image then pay for decryption
+int layra_pkg_has_pfs_keys(const layra_pkg_t* pkg);
+// Read and decrypt consecutive PFS image sectors
+int layra_pkg_read_pfs_sectors(layra_pkg_t* pkg, uint64_t first_sector, uint32_t count,
+                               void* buffer);
+// Mount the package's PFS image at a VFS path, streamed from the package in place.
+// The mount takes ownership of the package, also when mounting fails.
+int layra_pkg_mount(layra_pkg_t* pkg, const char* mount_point);
+int layra_pkg_open_and_mount(const char* pkg_path, const char* mount_point);
+
+#endif // LAYRA_PKG_H
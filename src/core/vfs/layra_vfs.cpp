@@ -0,0 +1,430 @@
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <stdio.h>
+#include <string.h>
+#include "layra_pkg.h"
+#include "layra_vfs.h"
+#include "vfs_handlers.h"
+
+// Registered mount point, kept alive by open files after it is unmounted
+typedef struct layra_vfs_mount {
+    char mount_point[LAYRA_VFS_MAX_PATH];
+    size_t length;
+    uint64_t hash;
+    layra_vfs_handler_t handler;
+    std::atomic<int> refs;
+} layra_vfs_mount_t;
+
+struct layra_vfs_file {
+    layra_vfs_mount_t* mount;
+    void* handle;
+    uint64_t position;
+    int append;
+};
+
+// Open-addressed table of mount prefixes by hash, twice the mount count so probes stay short
+#define LAYRA_VFS_PREFIX_SLOTS (LAYRA_VFS_MAX_MOUNTS * 2)
+// Per-thread cache of the mounts recently resolved for a directory
+#define LAYRA_VFS_RESOLVE_CACHE_SIZE 64
+// Longer directories are resolved without the cache
+#define LAYRA_VFS_RESOLVE_CACHE_PATH 256
+
+typedef struct {
+    uint64_t generation;
+    size_t length;
+    char directory[LAYRA_VFS_RESOLVE_CACHE_PATH];
+    layra_vfs_mount_t* mount;
+} layra_vfs_resolve_entry_t;
+
+static layra_vfs_mount_t* g_mounts[LAYRA_VFS_MAX_MOUNTS];
+static layra_vfs_mount_t* g_prefix_table[LAYRA_VFS_PREFIX_SLOTS];
+// Bumped on every mount table change, stale resolve cache entries then miss
+static uint64_t g_mount_generation = 1;
+// Lookups share the lock, only mount and unmount take it exclusively
+static std::shared_mutex g_mount_mutex;
+
+// FNV-1a, extended one character at a time while walking a path
+#define LAYRA_VFS_HASH_SEED 0xCBF29CE484222325ull
+static inline uint64_t layra_vfs_hash_step(uint64_t hash, char c) {
+    return (hash ^ (uint8_t)c) * 0x100000001B3ull;
+}
+
+static uint64_t layra_vfs_hash(const char* text, size_t length) {
+    uint64_t hash = LAYRA_VFS_HASH_SEED;
+    for (size_t i = 0; i < length; i++) {
+        hash = layra_vfs_hash_step(hash, text[i]);
+    }
+    return hash;
+}
+
+// Rebuild the prefix table from the mount slots, caller holds the lock exclusively
+static void layra_vfs_rebuild_prefixes(void) {
+    memset(g_prefix_table, 0, sizeof(g_prefix_table));
+    for (int i = 0; i < LAYRA_VFS_MAX_MOUNTS; i++) {
+        layra_vfs_mount_t* mount = g_mounts[i];
+        if (!mount) {
+            continue;
+        }
+        size_t slot = mount->hash % LAYRA_VFS_PREFIX_SLOTS;
+        while (g_prefix_table[slot]) {
+            slot = (slot + 1) % LAYRA_VFS_PREFIX_SLOTS;
+        }
+        g_prefix_table[slot] = mount;
+    }
+    g_mount_generation++;
+}
+
+static layra_vfs_mount_t* layra_vfs_lookup_prefix(const char* path, size_t length,
+                                                  uint64_t hash) {
+    size_t slot = hash % LAYRA_VFS_PREFIX_SLOTS;
+    while (layra_vfs_mount_t* mount = g_prefix_table[slot]) {
+        if (mount->hash == hash && mount->length == length &&
+            memcmp(mount->mount_point, path, length) == 0) {
+            return mount;
+        }
+        slot = (slot + 1) % LAYRA_VFS_PREFIX_SLOTS;
+    }
+    return NULL;
+}
+
+// Longest mounted prefix of a normalized path. Every component boundary is probed
+// once with the hash built so far, so the cost is one pass over the path.
+static layra_vfs_mount_t* layra_vfs_match_mount(const char* path, size_t length) {
+    layra_vfs_mount_t* best = NULL;
+    uint64_t hash = LAYRA_VFS_HASH_SEED;
+    for (size_t i = 0; i < length; i++) {
+        if (path[i] == '/') {
+            if (layra_vfs_mount_t* mount = layra_vfs_lookup_prefix(path, i, hash)) {
+                best = mount;
+            }
+        }
+        hash = layra_vfs_hash_step(hash, path[i]);
+    }
+    if (layra_vfs_mount_t* mount = layra_vfs_lookup_prefix(path, length, hash)) {
+        best = mount;
+    }
+    return best;
+}
+
+static void layra_vfs_release_mount(layra_vfs_mount_t* mount) {
+    if (mount->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (mount->handler.destroy) {
+            mount->handler.destroy(mount->handler.ctx);
+        }
+        delete mount;
+    }
+}
+
+// Collapse repeated separators and "." components, reject ".." so paths cannot
+// climb out of their mount. Returns the normalized length or -1.
+static int layra_vfs_normalize(const char* path, char* out, size_t out_size) {
+    if (!path || path[0] != '/' || out_size < 2) {
+        return -1;
+    }
+    size_t length = 0;
+    const char* cur = path;
+    while (*cur) {
+        while (*cur == '/') {
+            cur++;
+        }
+        const char* end = cur;
+        while (*end && *end != '/') {
+            end++;
+        }
+        size_t component = end - cur;
+        if (component == 0 || (component == 1 && cur[0] == '.')) {
+            cur = end;
+            continue;
+        }
+        if (component == 2 && cur[0] == '.' && cur[1] == '.') {
+            return -1;
+        }
+        if (length + 1 + component + 1 > out_size) {
+            return -1;
+        }
+        out[length++] = '/';
+        memcpy(out + length, cur, component);
+        length += component;
+        cur = end;
+    }
+    if (length == 0) {
+        out[length++] = '/';
+    }
+    out[length] = '\0';
+    return (int)length;
+}
+
+// Find the mount owning a path and take a reference on it. relative_path points
+// into the normalized buffer.
+static layra_vfs_mount_t* layra_vfs_find_mount(const char* path, char* normalized,
+                                               const char** relative_path) {
+    int length = layra_vfs_normalize(path, normalized, LAYRA_VFS_MAX_PATH);
+    if (length < 0) {
+        return NULL;
+    }
+    // Level loads open many files from the same few directories. The mount of the
+    // directory is cached, only a mount at the full path itself is probed each time.
+    // Entries are tagged with the mount generation, so they can hold raw mount pointers
+    // without references.
+    thread_local layra_vfs_resolve_entry_t cache[LAYRA_VFS_RESOLVE_CACHE_SIZE];
+    size_t dir_length = (size_t)length;
+    while (dir_length > 0 && normalized[dir_length] != '/') {
+        dir_length--;
+    }
+    uint64_t dir_hash = layra_vfs_hash(normalized, dir_length);
+    layra_vfs_resolve_entry_t* entry = &cache[dir_hash % LAYRA_VFS_RESOLVE_CACHE_SIZE];
+
+    std::shared_lock lock{g_mount_mutex};
+    layra_vfs_mount_t* mount;
+    if (entry->generation == g_mount_generation && entry->length == dir_length &&
+        memcmp(entry->directory, normalized, dir_length) == 0) {
+        mount = entry->mount;
+    } else {
+        mount = layra_vfs_match_mount(normalized, dir_length);
+        if (dir_length <= LAYRA_VFS_RESOLVE_CACHE_PATH) {
+            entry->generation = g_mount_generation;
+            entry->length = dir_length;
+            memcpy(entry->directory, normalized, dir_length);
+            entry->mount = mount;
+        }
+    }
+    uint64_t hash = dir_hash;
+    for (size_t i = dir_length; i < (size_t)length; i++) {
+        hash = layra_vfs_hash_step(hash, normalized[i]);
+    }
+    if (layra_vfs_mount_t* exact = layra_vfs_lookup_prefix(normalized, (size_t)length, hash)) {
+        mount = exact;
+    }
+    if (!mount) {
+        return NULL;
+    }
+    mount->refs.fetch_add(1, std::memory_order_relaxed);
+    const char* rest = normalized + mount->length;
+    *relative_path = *rest == '/' ? rest + 1 : rest;
+    return mount;
+}
+
+int layra_vfs_init(void) {
+    // Initialize the VFS
+    layra_vfs_shutdown();
+    return 0;
+}
+
+void layra_vfs_shutdown(void) {
+    std::scoped_lock lock{g_mount_mutex};
+    for (int i = 0; i < LAYRA_VFS_MAX_MOUNTS; i++) {
+        if (g_mounts[i]) {
+            layra_vfs_release_mount(g_mounts[i]);
+            g_mounts[i] = NULL;
+        }
+    }
+    layra_vfs_rebuild_prefixes();
+}
+
+int layra_vfs_mount(const char* mount_point, const char* source_path) {
+    if (!source_path) {
+        return -1;
+    }
+    size_t length = strlen(source_path);
+    if (length > 4 && (strcmp(source_path + length - 4, ".pkg") == 0 ||
+                       strcmp(source_path + length - 4, ".PKG") == 0)) {
+        return layra_pkg_open_and_mount(source_path, mount_point);
+    }
+    layra_vfs_handler_t handler;
+    if (vfs_dir_handler_create(source_path, &handler) != 0) {
+        return -1;
+    }
+    return layra_vfs_mount_handler(mount_point, &handler);
+}
+
+int layra_vfs_mount_handler(const char* mount_point, const layra_vfs_handler_t* handler) {
+    if (!handler || !handler->open || !handler->read) {
+        return -1;
+    }
+    layra_vfs_mount_t* mount = new layra_vfs_mount_t();
+    int length = layra_vfs_normalize(mount_point, mount->mount_point, LAYRA_VFS_MAX_PATH);
+    if (length < 0) {
+        delete mount;
+        return -1;
+    }
+    // The root mount matches every path through its empty prefix
+    if (length == 1) {
+        mount->mount_point[0] = '\0';
+        length = 0;
+    }
+    mount->length = (size_t)length;
+    mount->hash = layra_vfs_hash(mount->mount_point, mount->length);
+    mount->handler = *handler;
+    mount->refs.store(1, std::memory_order_relaxed);
+
+    std::scoped_lock lock{g_mount_mutex};
+    int free_slot = -1;
+    for (int i = 0; i < LAYRA_VFS_MAX_MOUNTS; i++) {
+        if (!g_mounts[i]) {
+            if (free_slot < 0) {
+                free_slot = i;
+            }
+        } else if (strcmp(g_mounts[i]->mount_point, mount->mount_point) == 0) {
+            free_slot = -1;
+            break;
+        }
+    }
+    if (free_slot < 0) {
+        // Already mounted or out of slots, the caller keeps ownership of the handler
+        delete mount;
+        return -1;
+    }
+    g_mounts[free_slot] = mount;
+    layra_vfs_rebuild_prefixes();
+    return 0;
+}
+
+int layra_vfs_unmount(const char* mount_point) {
+    char normalized[LAYRA_VFS_MAX_PATH];
+    int length = layra_vfs_normalize(mount_point, normalized, sizeof(normalized));
+    if (length < 0) {
+        return -1;
+    }
+    if (length == 1) {
+        normalized[0] = '\0';
+    }
+    std::scoped_lock lock{g_mount_mutex};
+    for (int i = 0; i < LAYRA_VFS_MAX_MOUNTS; i++) {
+        if (g_mounts[i] && strcmp(g_mounts[i]->mount_point, normalized) == 0) {
+            layra_vfs_release_mount(g_mounts[i]);
+            g_mounts[i] = NULL;
+            layra_vfs_rebuild_prefixes();
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int layra_vfs_resolve_path(const char* path, char* host_path, size_t host_path_size) {
+    char normalized[LAYRA_VFS_MAX_PATH];
+    const char* relative_path;
+    layra_vfs_mount_t* mount = layra_vfs_find_mount(path, normalized, &relative_path);
+    if (!mount) {
+        return -1;
+    }
+    int result = -1;
+    if (mount->handler.host_path) {
+        result = mount->handler.host_path(mount->handler.ctx, relative_path, host_path,
+                                          host_path_size);
+    }
+    layra_vfs_release_mount(mount);
+    return result;
+}
+
+layra_vfs_file_t* layra_vfs_fopen(const char* path, const char* mode) {
+    if (!mode) {
+        return NULL;
+    }
+    char normalized[LAYRA_VFS_MAX_PATH];
+    const char* relative_path;
+    layra_vfs_mount_t* mount = layra_vfs_find_mount(path, normalized, &relative_path);
+    if (!mount) {
+        return NULL;
+    }
+    int writing = strpbrk(mode, "wa+") != NULL;
+    void* handle = NULL;
+    if (!writing || mount->handler.write) {
+        handle = mount->handler.open(mount->handler.ctx, relative_path, mode);
+    }
+    if (!handle) {
+        layra_vfs_release_mount(mount);
+        return NULL;
+    }
+    layra_vfs_file_t* file = new layra_vfs_file_t();
+    file->mount = mount;
+    file->handle = handle;
+    file->position = 0;
+    file->append = mode[0] == 'a';
+    return file;
+}
+
+int layra_vfs_fclose(layra_vfs_file_t* file) {
+    if (!file) {
+        return -1;
+    }
+    if (file->mount->handler.close) {
+        file->mount->handler.close(file->mount->handler.ctx, file->handle);
+    }
+    layra_vfs_release_mount(file->mount);
+    delete file;
+    return 0;
+}
+
+size_t layra_vfs_fread(void* buffer, size_t size, size_t count, layra_vfs_file_t* file) {
+    if (!file || size == 0 || count > SIZE_MAX / size) {
+        return 0;
+    }
+    size_t read = layra_vfs_pread(file, buffer, size * count, file->position);
+    file->position += read;
+    return read / size;
+}
+
+size_t layra_vfs_fwrite(const void* buffer, size_t size, size_t count, layra_vfs_file_t* file) {
+    if (!file || !file->mount->handler.write || size == 0 || count > SIZE_MAX / size) {
+        return 0;
+    }
+    const layra_vfs_handler_t* handler = &file->mount->handler;
+    if (file->append) {
+        file->position = layra_vfs_fsize(file);
+    }
+    size_t written = handler->write(handler->ctx, file->handle, buffer, size * count,
+                                    file->position);
+    file->position += written;
+    return written / size;
+}
+
+int layra_vfs_fseek(layra_vfs_file_t* file, long offset, int origin) {
+    if (!file) {
+        return -1;
+    }
+    int64_t base;
+    switch (origin) {
+    case SEEK_SET:
+        base = 0;
+        break;
+    case SEEK_CUR:
+        base = (int64_t)file->position;
+        break;
+    case SEEK_END:
+        base = (int64_t)layra_vfs_fsize(file);
+        break;
+    default:
+        return -1;
+    }
+    if (base + offset < 0) {
+        return -1;
+    }
+    file->position = (uint64_t)(base + offset);
+    return 0;
+}
+
+long layra_vfs_ftell(layra_vfs_file_t* file) {
+    return file ? (long)file->position : -1;
+}
+
+size_t layra_vfs_pread(layra_vfs_file_t* file, void* buffer, size_t size, uint64_t offset) {
+    if (!file || !buffer || size == 0) {
+        return 0;
+    }
+    const layra_vfs_handler_t* handler = &file->mount->handler;
+    return handler->read(handler->ctx, file->handle, buffer, size, offset);
+}
+
+int vfs_file_native_fd(layra_vfs_file_t* file) {
+    const layra_vfs_handler_t* handler = &file->mount->handler;
+    return handler->native_fd ? handler->native_fd(handler->ctx, file->handle) : -1;
+}
+
+uint64_t layra_vfs_fsize(layra_vfs_file_t* file) {
+    if (!file || !file->mount->handler.size) {
+        return 0;
+    }
+    const layra_vfs_handler_t* handler = &file->mount->handler;
+    return handler->size(handler->ctx, file->handle);
+}
@@ -0,0 +1,98 @@
+#ifndef LAYRA_VFS_H
+#define LAYRA_VFS_H
+#include <stddef.h>
+#include <stdint.h>
+
+#define LAYRA_VFS_MAX_MOUNTS 32
+#define LAYRA_VFS_MAX_PATH 1024
+
+// Storage behind a mount point. Handler files are addressed by absolute offset so
+// several readers can share a source without a common file position.
+typedef struct layra_vfs_handler {
+    void* ctx;
+    // Open a path relative to the mount point ("" is the mount root), NULL on failure
+    void* (*open)(void* ctx, const char* relative_path, const char* mode);
+    void (*close)(void* ctx, void* file);
+    // Returns the number of bytes transferred
+    size_t (*read)(void* ctx, void* file, void* buffer, size_t size, uint64_t offset);
+    // NULL for read-only sources
+    size_t (*write)(void* ctx, void* file, const void* buffer, size_t size, uint64_t offset);
+    uint64_t (*size)(void* ctx, void* file);
+    // Translate a relative path to a host path, NULL for sources without host files
+    int (*host_path)(void* ctx, const char* relative_path, char* out, size_t out_size);
+    // Host descriptor behind an open file for native async reads, NULL or -1 when
+    // reads have to go through read()
+    int (*native_fd)(void* ctx, void* file);
+    // Called once the mount is gone
+    void (*destroy)(void* ctx);
+} layra_vfs_handler_t;
+
+typedef struct layra_vfs_file layra_vfs_file_t;
+
+// VFS functions, all return 0 on success and -1 on failure unless noted
+int layra_vfs_init(void);
+void layra_vfs_shutdown(void);
+// Mount a host directory, or a .pkg file through the streaming PKG handler
+int layra_vfs_mount(const char* mount_point, const char* source_path);
+// Mount a handler directly, the VFS owns it until unmount
+int layra_vfs_mount_handler(const char* mount_point, const layra_vfs_handler_t* handler);
+int layra_vfs_unmount(const char* mount_point);
+// Translate a virtual path to a host path (directory mounts only)
+int layra_vfs_resolve_path(const char* path, char* host_path, size_t host_path_size);
+
+layra_vfs_file_t* layra_vfs_fopen(const char* path, const char* mode);
+int layra_vfs_fclose(layra_vfs_file_t* file);
+size_t layra_vfs_fread(void* buffer, size_t size, size_t count, layra_vfs_file_t* file);
+size_t layra_vfs_fwrite(const void* buffer, size_t size, size_t count, layra_vfs_file_t* file);
+int layra_vfs_fseek(layra_vfs_file_t* file, long offset, int origin);
+long layra_vfs_ftell(layra_vfs_file_t* file);
+// Positional read that leaves the file position alone, returns bytes read
+size_t layra_vfs_pread(layra_vfs_file_t* file, void* buffer, size_t size, uint64_t offset);
+uint64_t layra_vfs_fsize(layra_vfs_file_t* file);
+
+// Asynchronous reads. Requests are submitted in batches and complete in any order.
+// Host files are read through io_uring on Linux; other sources and hosts without
+// io_uring are served by a worker pool. Files and buffers must stay valid until
+// their request completes. Any thread may submit; one thread at a time polls.
+typedef struct {
+    layra_vfs_file_t* file;
+    void* buffer;
+    size_t size;
+    uint64_t offset;
+    uint64_t user_data;
+} layra_vfs_read_request_t;
+
+typedef struct {
+    uint64_t user_data;
+    // Bytes read, or -1 on error
+    int64_t result;
+} layra_vfs_completion_t;
+
+typedef struct layra_vfs_io_queue layra_vfs_io_queue_t;
+
+// depth bounds the requests in flight at once
+layra_vfs_io_queue_t* layra_vfs_io_queue_create(uint32_t depth);
+// Waits for requests still in flight, their completions are discarded
+void layra_vfs_io_queue_destroy(layra_vfs_io_queue_t* queue);
+// Returns how many requests were queued, fewer than count when the queue is full
+int layra_vfs_submit_reads(layra_vfs_io_queue_t* queue, const layra_vfs_read_request_t* requests,
+                           uint32_t count);
+// Collect up to max completions. With wait set, blocks until at least one is available
+// unless nothing is in flight. Returns the number collected.
+uint32_t layra_vfs_poll_completions(layra_vfs_io_queue_t* queue,
+                                    layra_vfs_completion_t* completions, uint32_t max, int wait);
+
+// Counters of the decrypted-sector cache behind package mounts
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t used_bytes;
+    uint64_t budget_bytes;
+} layra_vfs_cache_stats_t;
+
+// Memory the sector cache may hold, 0 disables it. Shrinking evicts right away.
+void layra_vfs_set_sector_cache_budget(uint64_t bytes);
+void layra_vfs_get_sector_cache_stats(layra_vfs_cache_stats_t* stats);
+
+#endif // LAYRA_VFS_H
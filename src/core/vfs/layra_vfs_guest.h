@@ -0,0 +1,14 @@
+#ifndef LAYRA_VFS_GUEST_H
+#define LAYRA_VFS_GUEST_H
+#include "layra_vfs.h"
+
+class MemoryManager;
+
+// Positional read straight into guest memory, without a bounce buffer for plain
+// writable pages. The range is split at page runs: ordinary pages are filled in place
+// between MemoryManager::prepareHostWrite and finishHostWrite, MMIO pages go through
+// writeMemory. Stops at the first page the guest could not write. Returns bytes read.
+size_t layra_vfs_pread_guest(layra_vfs_file_t* file, MemoryManager* memory,
+                             uint64_t guest_address, size_t size, uint64_t offset);
+
+#endif // LAYRA_VFS_GUEST_H
@@ -0,0 +1,468 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "layra_vfs.h"
+#include "vfs_handlers.h"
+#ifdef __linux__
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#define LAYRA_VFS_HAVE_IO_URING
+#endif
+
+// Threads serving reads that cannot go through io_uring, reads mostly wait on storage
+#define VFS_IO_POOL_THREADS 4
+#define VFS_IO_MAX_DEPTH 4096
+// Largest read handed to the kernel at once, bigger requests go to the pool
+#define VFS_IO_URING_MAX_READ 0x7FFFF000u
+// Marks completions the pool posts through the ring rather than kernel reads
+#define VFS_IO_POOL_COMPLETION (1ull << 63)
+
+typedef struct {
+    uint64_t user_data;
+    // Filled by the pool before it posts the completion. The ring hands it over through
+    // the kernel, which the atomic makes explicit.
+    std::atomic<int64_t> result;
+#ifdef LAYRA_VFS_HAVE_IO_URING
+    struct iovec iov;
+#endif
+} vfs_io_slot_t;
+
+#ifdef LAYRA_VFS_HAVE_IO_URING
+// Raw io_uring rings, set up with plain syscalls so there is no liburing dependency
+typedef struct {
+    int fd;
+    void* sq_map;
+    size_t sq_map_size;
+    void* cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+} vfs_io_ring_t;
+#endif
+
+struct layra_vfs_io_queue {
+    // Serializes submit and poll callers
+    std::mutex mutex;
+    std::unique_ptr<vfs_io_slot_t[]> slots;
+    std::vector<uint32_t> free_slots;
+    uint32_t in_flight;
+#ifdef LAYRA_VFS_HAVE_IO_URING
+    // Taken by both submitters and pool threads posting completions
+    std::mutex sq_mutex;
+    vfs_io_ring_t ring;
+    int has_ring;
+#endif
+    // Pool completions when there is no ring to post them through
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    std::deque<uint32_t> done;
+    // Pool jobs that still touch the queue, guarded by done_mutex. A completion posted
+    // through the ring can be reaped before its worker lets go of sq_mutex, so destroy
+    // waits for this rather than for in_flight alone.
+    uint32_t pool_jobs;
+};
+
+#ifdef LAYRA_VFS_HAVE_IO_URING
+static int vfs_io_ring_setup(vfs_io_ring_t* ring, uint32_t entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // Fails with ENOSYS on old kernels and EPERM under some sandboxes, the pool covers both
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return -1;
+    }
+    ring->fd = fd;
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_map_size = ring->cq_map_size = std::max(ring->sq_map_size, ring->cq_map_size);
+    }
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            munmap(ring->sq_map, ring->sq_map_size);
+            close(fd);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_map != ring->sq_map) {
+            munmap(ring->cq_map, ring->cq_map_size);
+        }
+        munmap(ring->sq_map, ring->sq_map_size);
+        close(fd);
+        return -1;
+    }
+    uint8_t* sq = (uint8_t*)ring->sq_map;
+    uint8_t* cq = (uint8_t*)ring->cq_map;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void vfs_io_ring_teardown(vfs_io_ring_t* ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+}
+
+static int vfs_io_ring_enter(vfs_io_ring_t* ring, unsigned to_submit, unsigned min_complete,
+                             unsigned flags) {
+    for (;;) {
+        int result = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, flags,
+                                  NULL, 0);
+        if (result >= 0 || errno != EINTR) {
+            return result;
+        }
+    }
+}
+
+// Entry the given number of places past the published tail, caller holds sq_mutex.
+// In-flight requests never exceed the ring size, so an entry is always free.
+static struct io_uring_sqe* vfs_io_ring_get_sqe(vfs_io_ring_t* ring, unsigned prepared) {
+    unsigned index = (*ring->sq_tail + prepared) & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    return sqe;
+}
+
+// Publish prepared entries and hand everything not yet consumed to the kernel
+static void vfs_io_ring_submit(vfs_io_ring_t* ring, unsigned added) {
+    unsigned tail = *ring->sq_tail + added;
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    unsigned pending = tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (pending) {
+        // Entries the kernel refuses now (EAGAIN, EBUSY) stay queued, the next submit or
+        // a waiting poller hands them over
+        vfs_io_ring_enter(ring, pending, 0, 0);
+    }
+}
+#endif
+
+// Read the pool performs on behalf of a queue slot
+typedef struct {
+    layra_vfs_io_queue_t* queue;
+    uint32_t slot;
+    layra_vfs_read_request_t request;
+} vfs_io_job_t;
+
+// Last thing a pool job does with its queue
+static void vfs_io_post_pool_completion(layra_vfs_io_queue_t* queue, uint32_t slot) {
+    bool posted = false;
+#ifdef LAYRA_VFS_HAVE_IO_URING
+    if (queue->has_ring) {
+        // Funnel through the ring so pollers wait on a single source
+        std::scoped_lock lock{queue->sq_mutex};
+        struct io_uring_sqe* sqe = vfs_io_ring_get_sqe(&queue->ring, 0);
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = VFS_IO_POOL_COMPLETION | slot;
+        vfs_io_ring_submit(&queue->ring, 1);
+        posted = true;
+    }
+#endif
+    // Notify under the lock, the queue may be destroyed as soon as it is released
+    std::scoped_lock lock{queue->done_mutex};
+    if (!posted) {
+        queue->done.push_back(slot);
+    }
+    queue->pool_jobs--;
+    queue->done_cv.notify_all();
+}
+
+// Shared by every queue, started on first use and kept for the process lifetime
+class vfs_io_pool {
+public:
+    vfs_io_pool() {
+        for (int i = 0; i < VFS_IO_POOL_THREADS; i++) {
+            workers.emplace_back(&vfs_io_pool::worker_thread, this);
+        }
+    }
+    ~vfs_io_pool() {
+        {
+            std::scoped_lock lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    void push(const vfs_io_job_t* jobs_in, size_t count) {
+        {
+            std::scoped_lock lock{mutex};
+            jobs.insert(jobs.end(), jobs_in, jobs_in + count);
+        }
+        if (count == 1) {
+            wake.notify_one();
+        } else {
+            wake.notify_all();
+        }
+    }
+private:
+    void worker_thread() {
+        for (;;) {
+            vfs_io_job_t job;
+            {
+                std::unique_lock lock{mutex};
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            const layra_vfs_read_request_t& request = job.request;
+            int64_t result = -1;
+            if (request.file && (request.buffer || request.size == 0)) {
+                result = (int64_t)layra_vfs_pread(request.file, request.buffer, request.size,
+                                                  request.offset);
+            }
+            job.queue->slots[job.slot].result.store(result, std::memory_order_release);
+            vfs_io_post_pool_completion(job.queue, job.slot);
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<vfs_io_job_t> jobs;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+};
+
+static vfs_io_pool* vfs_io_get_pool(void) {
+    static vfs_io_pool pool;
+    return &pool;
+}
+
+layra_vfs_io_queue_t* layra_vfs_io_queue_create(uint32_t depth) {
+    if (depth == 0) {
+        return NULL;
+    }
+    depth = std::min<uint32_t>(depth, VFS_IO_MAX_DEPTH);
+    layra_vfs_io_queue_t* queue = new layra_vfs_io_queue_t();
+    queue->slots.reset(new vfs_io_slot_t[depth]);
+    queue->free_slots.reserve(depth);
+    for (uint32_t i = depth; i > 0; i--) {
+        queue->free_slots.push_back(i - 1);
+    }
+    queue->in_flight = 0;
+    queue->pool_jobs = 0;
+#ifdef LAYRA_VFS_HAVE_IO_URING
+    queue->has_ring = vfs_io_ring_setup(&queue->ring, depth) == 0;
+#endif
+    return queue;
+}
+
+static void vfs_io_push_jobs(layra_vfs_io_queue_t* queue, const vfs_io_job_t* jobs,
+                             size_t count) {
+    {
+        std::scoped_lock lock{queue->done_mutex};
+        queue->pool_jobs += (uint32_t)count;
+    }
+    vfs_io_get_pool()->push(jobs, count);
+}
+
+// Move finished requests into completions, caller holds the queue mutex
+static uint32_t vfs_io_reap(layra_vfs_io_queue_t* queue, layra_vfs_completion_t* completions,
+                            uint32_t max) {
+    uint32_t count = 0;
+#ifdef LAYRA_VFS_HAVE_IO_URING
+    if (queue->has_ring) {
+        vfs_io_ring_t* ring = &queue->ring;
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail && count < max) {
+            const struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            uint32_t slot = (uint32_t)(cqe->user_data & ~VFS_IO_POOL_COMPLETION);
+            int64_t result = cqe->res < 0 ? -1 : (int64_t)cqe->res;
+            if (cqe->user_data & VFS_IO_POOL_COMPLETION) {
+                result = queue->slots[slot].result.load(std::memory_order_acquire);
+            }
+            completions[count].user_data = queue->slots[slot].user_data;
+            completions[count].result = result;
+            queue->free_slots.push_back(slot);
+            count++;
+            head++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        queue->in_flight -= count;
+        return count;
+    }
+#endif
+    std::scoped_lock lock{queue->done_mutex};
+    while (!queue->done.empty() && count < max) {
+        uint32_t slot = queue->done.front();
+        queue->done.pop_front();
+        completions[count].user_data = queue->slots[slot].user_data;
+        completions[count].result = queue->slots[slot].result.load(std::memory_order_relaxed);
+        queue->free_slots.push_back(slot);
+        count++;
+    }
+    queue->in_flight -= count;
+    return count;
+}
+
+int layra_vfs_submit_reads(layra_vfs_io_queue_t* queue, const layra_vfs_read_request_t* requests,
+                           uint32_t count) {
+    if (!queue || (!requests && count)) {
+        return -1;
+    }
+    std::scoped_lock lock{queue->mutex};
+    count = std::min<uint32_t>(count, (uint32_t)queue->free_slots.size());
+    vfs_io_job_t jobs[64];
+    size_t job_count = 0;
+#ifdef LAYRA_VFS_HAVE_IO_URING
+    std::unique_lock sq_lock{queue->sq_mutex, std::defer_lock};
+    unsigned ring_count = 0;
+#endif
+    for (uint32_t i = 0; i < count; i++) {
+        const layra_vfs_read_request_t& request = requests[i];
+        uint32_t slot = queue->free_slots.back();
+        queue->free_slots.pop_back();
+        queue->slots[slot].user_data = request.user_data;
+        queue->in_flight++;
+#ifdef LAYRA_VFS_HAVE_IO_URING
+        int fd = -1;
+        if (queue->has_ring && request.file && request.buffer) {
+            fd = vfs_file_native_fd(request.file);
+        }
+        if (fd >= 0 && request.size <= VFS_IO_URING_MAX_READ) {
+            if (!sq_lock.owns_lock()) {
+                sq_lock.lock();
+            }
+            vfs_io_slot_t* entry = &queue->slots[slot];
+            entry->iov.iov_base = request.buffer;
+            entry->iov.iov_len = request.size;
+            struct io_uring_sqe* sqe = vfs_io_ring_get_sqe(&queue->ring, ring_count);
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t)(uintptr_t)&entry->iov;
+            sqe->len = 1;
+            sqe->off = request.offset;
+            sqe->user_data = slot;
+            ring_count++;
+            continue;
+        }
+#endif
+        jobs[job_count++] = vfs_io_job_t{queue, slot, request};
+        if (job_count == sizeof(jobs) / sizeof(jobs[0])) {
+            vfs_io_push_jobs(queue, jobs, job_count);
+            job_count = 0;
+        }
+    }
+#ifdef LAYRA_VFS_HAVE_IO_URING
+    if (ring_count) {
+        // One syscall for the whole batch
+        vfs_io_ring_submit(&queue->ring, ring_count);
+    }
+    if (sq_lock.owns_lock()) {
+        sq_lock.unlock();
+    }
+#endif
+    if (job_count) {
+        vfs_io_push_jobs(queue, jobs, job_count);
+    }
+    return (int)count;
+}
+
+uint32_t layra_vfs_poll_completions(layra_vfs_io_queue_t* queue,
+                                    layra_vfs_completion_t* completions, uint32_t max, int wait) {
+    if (!queue || !completions || max == 0) {
+        return 0;
+    }
+    std::unique_lock lock{queue->mutex};
+    uint32_t count = vfs_io_reap(queue, completions, max);
+    while (count == 0 && wait && queue->in_flight > 0) {
+        // Let other threads submit while this one sleeps
+        lock.unlock();
+#ifdef LAYRA_VFS_HAVE_IO_URING
+        if (queue->has_ring) {
+            // Submit whatever the kernel refused before, otherwise this could wait for
+            // reads that were never started
+            unsigned pending;
+            {
+                std::scoped_lock sq_lock{queue->sq_mutex};
+                pending = *queue->ring.sq_tail -
+                          __atomic_load_n(queue->ring.sq_head, __ATOMIC_ACQUIRE);
+            }
+            vfs_io_ring_enter(&queue->ring, pending, 1, IORING_ENTER_GETEVENTS);
+        } else
+#endif
+        {
+            std::unique_lock done_lock{queue->done_mutex};
+            queue->done_cv.wait(done_lock, [queue] { return !queue->done.empty(); });
+        }
+        lock.lock();
+        count = vfs_io_reap(queue, completions, max);
+    }
+    return count;
+}
+
+void layra_vfs_io_queue_destroy(layra_vfs_io_queue_t* queue) {
+    if (!queue) {
+        return;
+    }
+    layra_vfs_completion_t discard[64];
+    for (;;) {
+        {
+            std::scoped_lock lock{queue->mutex};
+            if (queue->in_flight == 0) {
+                break;
+            }
+        }
+        layra_vfs_poll_completions(queue, discard, 64, 1);
+    }
+    {
+        // Workers may still be inside vfs_io_post_pool_completion
+        std::unique_lock lock{queue->done_mutex};
+        queue->done_cv.wait(lock, [queue] { return queue->pool_jobs == 0; });
+    }
+#ifdef LAYRA_VFS_HAVE_IO_URING
+    if (queue->has_ring) {
+        vfs_io_ring_teardown(&queue->ring);
+    }
+#endif
+    delete queue;
+}
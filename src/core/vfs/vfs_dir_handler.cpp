@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <string.h>
+#include "vfs_handlers.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+    char root[LAYRA_VFS_MAX_PATH];
+} vfs_dir_ctx_t;
+
+static int vfs_dir_host_path(void* ctx, const char* relative_path, char* out, size_t out_size) {
+    vfs_dir_ctx_t* dir = (vfs_dir_ctx_t*)ctx;
+    int length = snprintf(out, out_size, "%s/%s", dir->root, relative_path);
+    return length < 0 || (size_t)length >= out_size ? -1 : 0;
+}
+
+#ifdef _WIN32
+static void* vfs_dir_open(void* ctx, const char* relative_path, const char* mode) {
+    char path[LAYRA_VFS_MAX_PATH];
+    if (vfs_dir_host_path(ctx, relative_path, path, sizeof(path)) != 0) {
+        return NULL;
+    }
+    DWORD access = GENERIC_READ;
+    DWORD disposition = OPEN_EXISTING;
+    if (mode[0] == 'w') {
+        access |= GENERIC_WRITE;
+        disposition = CREATE_ALWAYS;
+    } else if (mode[0] == 'a') {
+        access |= GENERIC_WRITE;
+        disposition = OPEN_ALWAYS;
+    } else if (strchr(mode, '+')) {
+        access |= GENERIC_WRITE;
+    }
+    HANDLE handle = CreateFileA(path, access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+    return handle == INVALID_HANDLE_VALUE ? NULL : handle;
+}
+
+static void vfs_dir_close(void*, void* file) {
+    CloseHandle((HANDLE)file);
+}
+
+static size_t vfs_dir_read(void*, void* file, void* buffer, size_t size, uint64_t offset) {
+    size_t total = 0;
+    while (total < size) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)(offset + total);
+        overlapped.OffsetHigh = (DWORD)((offset + total) >> 32);
+        DWORD chunk = size - total > 0x40000000 ? 0x40000000 : (DWORD)(size - total);
+        DWORD read = 0;
+        if (!ReadFile((HANDLE)file, (char*)buffer + total, chunk, &read, &overlapped) ||
+            read == 0) {
+            break;
+        }
+        total += read;
+    }
+    return total;
+}
+
+static size_t vfs_dir_write(void*, void* file, const void* buffer, size_t size,
+                            uint64_t offset) {
+    size_t total = 0;
+    while (total < size) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)(offset + total);
+        overlapped.OffsetHigh = (DWORD)((offset + total) >> 32);
+        DWORD chunk = size - total > 0x40000000 ? 0x40000000 : (DWORD)(size - total);
+        DWORD written = 0;
+        if (!WriteFile((HANDLE)file, (const char*)buffer + total, chunk, &written, &overlapped) ||
+            written == 0) {
+            break;
+        }
+        total += written;
+    }
+    return total;
+}
+
+static uint64_t vfs_dir_size(void*, void* file) {
+    LARGE_INTEGER size;
+    return GetFileSizeEx((HANDLE)file, &size) ? (uint64_t)size.QuadPart : 0;
+}
+#else
+// Descriptors are stored as fd + 1 so a valid handle is never NULL
+static inline int vfs_dir_fd(void* file) {
+    return (int)((intptr_t)file - 1);
+}
+
+static void* vfs_dir_open(void* ctx, const char* relative_path, const char* mode) {
+    char path[LAYRA_VFS_MAX_PATH];
+    if (vfs_dir_host_path(ctx, relative_path, path, sizeof(path)) != 0) {
+        return NULL;
+    }
+    int flags = strchr(mode, '+') ? O_RDWR : O_RDONLY;
+    if (mode[0] == 'w') {
+        flags = (flags == O_RDWR ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+    } else if (mode[0] == 'a') {
+        flags = (flags == O_RDWR ? O_RDWR : O_WRONLY) | O_CREAT;
+    }
+    int fd = open(path, flags | O_CLOEXEC, 0644);
+    return fd < 0 ? NULL : (void*)(intptr_t)(fd + 1);
+}
+
+static void vfs_dir_close(void*, void* file) {
+    close(vfs_dir_fd(file));
+}
+
+static size_t vfs_dir_read(void*, void* file, void* buffer, size_t size, uint64_t offset) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t read = pread(vfs_dir_fd(file), (char*)buffer + total, size - total,
+                             (off_t)(offset + total));
+        if (read <= 0) {
+            break;
+        }
+        total += (size_t)read;
+    }
+    return total;
+}
+
+static size_t vfs_dir_write(void*, void* file, const void* buffer, size_t size,
+                            uint64_t offset) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t written = pwrite(vfs_dir_fd(file), (const char*)buffer + total, size - total,
+                                 (off_t)(offset + total));
+        if (written <= 0) {
+            break;
+        }
+        total += (size_t)written;
+    }
+    return total;
+}
+
+static uint64_t vfs_dir_size(void*, void* file) {
+    struct stat info;
+    return fstat(vfs_dir_fd(file), &info) == 0 ? (uint64_t)info.st_size : 0;
+}
+
+static int vfs_dir_native_fd(void*, void* file) {
+    return vfs_dir_fd(file);
+}
+#endif
+
+static void vfs_dir_destroy(void* ctx) {
+    delete (vfs_dir_ctx_t*)ctx;
+}
+
+int vfs_dir_handler_create(const char* host_directory, layra_vfs_handler_t* handler) {
+    if (!host_directory || !handler) {
+        return -1;
+    }
+    vfs_dir_ctx_t* dir = new vfs_dir_ctx_t();
+    size_t length = strlen(host_directory);
+    while (length > 1 && (host_directory[length - 1] == '/' || host_directory[length - 1] == '\\')) {
+        length--;
+    }
+    if (length >= sizeof(dir->root)) {
+        delete dir;
+        return -1;
+    }
+    memcpy(dir->root, host_directory, length);
+    dir->root[length] = '\0';
+
+    handler->ctx = dir;
+    handler->open = vfs_dir_open;
+    handler->close = vfs_dir_close;
+    handler->read = vfs_dir_read;
+    handler->write = vfs_dir_write;
+    handler->size = vfs_dir_size;
+    handler->host_path = vfs_dir_host_path;
+#ifdef _WIN32
+    handler->native_fd = NULL;
+#else
+    handler->native_fd = vfs_dir_native_fd;
+#endif
+    handler->destroy = vfs_dir_destroy;
+    return 0;
+}
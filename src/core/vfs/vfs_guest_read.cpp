@@ -0,0 +1,67 @@
+#include "layra_vfs_guest.h"
+#include "memorymanager.h"
+
+enum vfs_guest_page_kind { VFS_GUEST_DIRECT, VFS_GUEST_MMIO, VFS_GUEST_INVALID };
+
+static vfs_guest_page_kind vfs_guest_classify(MemoryManager* memory, uint64_t address) {
+    uint8_t flags = memory->getPageFlags(address);
+    if ((flags & (PAGE_MAPPED | PAGE_WRITE)) != (PAGE_MAPPED | PAGE_WRITE)) {
+        return VFS_GUEST_INVALID;
+    }
+    return flags & PAGE_MMIO ? VFS_GUEST_MMIO : VFS_GUEST_DIRECT;
+}
+
+size_t layra_vfs_pread_guest(layra_vfs_file_t* file, MemoryManager* memory,
+                             uint64_t guest_address, size_t size, uint64_t offset) {
+    if (!file || !memory || size == 0 || guest_address >= GUEST_ADDRESS_SPACE_SIZE ||
+        size > GUEST_ADDRESS_SPACE_SIZE - guest_address) {
+        return 0;
+    }
+    size_t done = 0;
+    while (done < size) {
+        uint64_t address = guest_address + done;
+        vfs_guest_page_kind kind = vfs_guest_classify(memory, address);
+        if (kind == VFS_GUEST_INVALID) {
+            break;
+        }
+        // Extend to the end of the run of pages of the same kind
+        size_t run = (size_t)(GUEST_PAGE_SIZE - (address & (GUEST_PAGE_SIZE - 1)));
+        while (run < size - done && vfs_guest_classify(memory, address + run) == kind) {
+            run += GUEST_PAGE_SIZE;
+        }
+        if (run > size - done) {
+            run = size - done;
+        }
+
+        size_t read = 0;
+        if (kind == VFS_GUEST_DIRECT) {
+            // Guest pages are contiguous in the host reservation, so the whole run is
+            // read in one call
+            uint8_t* dst = memory->prepareHostWrite(address, run);
+            if (!dst) {
+                break;
+            }
+            read = layra_vfs_pread(file, dst, run, offset + done);
+            memory->finishHostWrite(address, run);
+        } else {
+            // Device memory has to see every byte through its handler
+            uint8_t bounce[GUEST_PAGE_SIZE];
+            while (read < run) {
+                size_t chunk = run - read < sizeof(bounce) ? run - read : sizeof(bounce);
+                size_t got = layra_vfs_pread(file, bounce, chunk, offset + done + read);
+                if (got == 0 || !memory->writeMemory(address + read, bounce, got)) {
+                    break;
+                }
+                read += got;
+                if (got < chunk) {
+                    break;
+                }
+            }
+        }
+        done += read;
+        if (read < run) {
+            break;
+        }
+    }
+    return done;
+}
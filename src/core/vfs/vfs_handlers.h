@@ -0,0 +1,16 @@
+#ifndef VFS_HANDLERS_H
+#define VFS_HANDLERS_H
+#include "layra_vfs.h"
+
+typedef struct layra_pkg layra_pkg_t;
+
+// Handler serving a host directory
+int vfs_dir_handler_create(const char* host_directory, layra_vfs_handler_t* handler);
+// Handler serving the PFS image of an open package in place. Takes ownership of
+// pkg, also on failure.
+int vfs_pkg_handler_create(layra_pkg_t* pkg, layra_vfs_handler_t* handler);
+
+// Host descriptor of an open VFS file, -1 when its handler has none
+int vfs_file_native_fd(layra_vfs_file_t* file);
+
+#endif // VFS_HANDLERS_H
@@ -0,0 +1,264 @@
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "layra_pfs.h"
+#include "layra_pkg.h"
+#include "vfs_handlers.h"
+#include "vfs_sector_cache.h"
+
+static_assert(VFS_SECTOR_CACHE_SECTOR_SIZE == LAYRA_PKG_SECTOR_SIZE,
+              "cache entries are PFS sectors");
+
+// Sectors fetched from the package per read call
+#define VFS_PKG_READ_SECTORS 64
+// Deepest directory nesting we follow, guards against corrupt images with loops
+#define VFS_PKG_MAX_DEPTH 64
+// Inode flag of PFSC-compressed files, which are not streamed yet
+#define LAYRA_PFS_INODE_COMPRESSED 0x1
+
+typedef struct {
+    // Byte range of the file inside the decrypted PFS image
+    uint64_t offset;
+    uint64_t size;
+    int is_directory;
+    int is_compressed;
+} vfs_pkg_node_t;
+
+typedef struct {
+    layra_pkg_t* pkg;
+    uint64_t image_size;
+    uint64_t block_size;
+    // Decrypted sectors go through the shared sector cache. Plaintext images skip it,
+    // their sectors are copied into the per-thread buffer and from there to the caller.
+    int cached;
+    uint64_t cache_source;
+    // Relative path to node, built once at mount time
+    std::unordered_map<std::string, vfs_pkg_node_t> nodes;
+} vfs_pkg_ctx_t;
+
+// Read a byte range of the decrypted PFS image, decrypting only the sectors it touches
+// that are not cached yet
+static size_t vfs_pkg_read_image(vfs_pkg_ctx_t* ctx, void* buffer, size_t size, uint64_t offset) {
+    if (offset >= ctx->image_size) {
+        return 0;
+    }
+    if (size > ctx->image_size - offset) {
+        size = (size_t)(ctx->image_size - offset);
+    }
+    thread_local std::vector<uint8_t> sectors(VFS_PKG_READ_SECTORS * LAYRA_PKG_SECTOR_SIZE);
+    uint64_t last = (offset + size - 1) / LAYRA_PKG_SECTOR_SIZE;
+    size_t done = 0;
+    while (done < size) {
+        uint64_t position = offset + done;
+        uint64_t first = position / LAYRA_PKG_SECTOR_SIZE;
+        size_t skip = (size_t)(position - first * LAYRA_PKG_SECTOR_SIZE);
+        size_t chunk;
+        if (ctx->cached) {
+            chunk = LAYRA_PKG_SECTOR_SIZE - skip < size - done ? LAYRA_PKG_SECTOR_SIZE - skip
+                                                               : size - done;
+            if (vfs_sector_cache_read(ctx->cache_source, first, (uint8_t*)buffer + done, skip,
+                                      chunk) == 0) {
+                done += chunk;
+                continue;
+            }
+        }
+        // Fetch the run of missing sectors in one call so it decrypts as a batch. The
+        // read above counted the first miss, the probes count the rest.
+        uint32_t count = 1;
+        while (count < VFS_PKG_READ_SECTORS && first + count <= last &&
+               !(ctx->cached && vfs_sector_cache_contains(ctx->cache_source, first + count))) {
+            count++;
+        }
+        if (layra_pkg_read_pfs_sectors(ctx->pkg, first, count, sectors.data()) != 0) {
+            break;
+        }
+        if (ctx->cached) {
+            for (uint32_t i = 0; i < count; i++) {
+                vfs_sector_cache_insert(ctx->cache_source, first + i,
+                                        sectors.data() + (size_t)i * LAYRA_PKG_SECTOR_SIZE);
+            }
+        }
+        chunk = (size_t)count * LAYRA_PKG_SECTOR_SIZE - skip;
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+        memcpy((uint8_t*)buffer + done, sectors.data() + skip, chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+static int vfs_pkg_read_inode(vfs_pkg_ctx_t* ctx, int64_t ino, layra_pfs_inode_t* inode) {
+    // Inode blocks follow the superblock, inodes never straddle a block
+    uint64_t per_block = ctx->block_size / LAYRA_PFS_INODE_SIZE;
+    if (ino < 0) {
+        return -1;
+    }
+    uint64_t offset = ctx->block_size * (1 + (uint64_t)ino / per_block) +
+                      ((uint64_t)ino % per_block) * LAYRA_PFS_INODE_SIZE;
+    return vfs_pkg_read_image(ctx, inode, sizeof(*inode), offset) == sizeof(*inode) ? 0 : -1;
+}
+
+// Visit the entries of a directory, stops when the callback returns non-zero
+template <typename Callback>
+static int vfs_pkg_for_each_dirent(vfs_pkg_ctx_t* ctx, int64_t dir_ino, Callback callback) {
+    layra_pfs_inode_t inode;
+    if (vfs_pkg_read_inode(ctx, dir_ino, &inode) != 0 || inode.size <= 0) {
+        return -1;
+    }
+    uint64_t offset = (uint64_t)inode.loc * ctx->block_size;
+    if (offset >= ctx->image_size) {
+        return -1;
+    }
+    uint64_t length = (uint64_t)inode.blocks * ctx->block_size;
+    if (length < (uint64_t)inode.size) {
+        length = (uint64_t)inode.size;
+    }
+    // A corrupt inode can claim any size, nothing past the image is read anyway
+    if (length > ctx->image_size - offset) {
+        length = ctx->image_size - offset;
+    }
+    std::vector<uint8_t> data(length);
+    if (vfs_pkg_read_image(ctx, data.data(), data.size(), offset) != data.size()) {
+        return -1;
+    }
+    // Entries never cross a block, a zero-sized entry ends the block
+    for (uint64_t block = 0; block < length; block += ctx->block_size) {
+        uint64_t end = block + ctx->block_size < length ? block + ctx->block_size : length;
+        uint64_t pos = block;
+        while (pos + sizeof(layra_pfs_dirent_t) <= end) {
+            layra_pfs_dirent_t dirent;
+            memcpy(&dirent, data.data() + pos, sizeof(dirent));
+            if (dirent.entsize <= 0 || dirent.namelen <= 0 ||
+                pos + sizeof(dirent) + (uint64_t)dirent.namelen > end) {
+                break;
+            }
+            std::string name((const char*)data.data() + pos + sizeof(dirent), dirent.namelen);
+            if (callback(dirent, name)) {
+                return 0;
+            }
+            pos += (uint64_t)dirent.entsize;
+        }
+    }
+    return 0;
+}
+
+// Each directory is walked once, so entries pointing back at a directory or an ancestor
+// cannot make a corrupt image take exponential time to mount
+static void vfs_pkg_add_tree(vfs_pkg_ctx_t* ctx, int64_t dir_ino, const std::string& prefix,
+                             int depth, std::unordered_set<int64_t>* visited) {
+    if (depth > VFS_PKG_MAX_DEPTH || !visited->insert(dir_ino).second) {
+        return;
+    }
+    vfs_pkg_for_each_dirent(ctx, dir_ino, [&](const layra_pfs_dirent_t& dirent,
+                                              const std::string& name) {
+        if (dirent.type != LAYRA_PFS_DIRENT_FILE && dirent.type != LAYRA_PFS_DIRENT_DIRECTORY) {
+            return 0;
+        }
+        layra_pfs_inode_t inode;
+        if (vfs_pkg_read_inode(ctx, dirent.ino, &inode) != 0) {
+            return 0;
+        }
+        std::string path = prefix.empty() ? name : prefix + "/" + name;
+        vfs_pkg_node_t node;
+        node.offset = (uint64_t)inode.loc * ctx->block_size;
+        node.size = inode.size > 0 ? (uint64_t)inode.size : 0;
+        node.is_directory = dirent.type == LAYRA_PFS_DIRENT_DIRECTORY;
+        node.is_compressed = (inode.flags & LAYRA_PFS_INODE_COMPRESSED) != 0;
+        ctx->nodes[path] = node;
+        if (node.is_directory) {
+            vfs_pkg_add_tree(ctx, dirent.ino, path, depth + 1, visited);
+        }
+        return 0;
+    });
+}
+
+static int vfs_pkg_build_index(vfs_pkg_ctx_t* ctx) {
+    // The superblock sector is stored in the clear
+    layra_pfs_header_t header;
+    if (vfs_pkg_read_image(ctx, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != LAYRA_PFS_MAGIC || header.block_size < LAYRA_PKG_SECTOR_SIZE ||
+        (header.block_size & (header.block_size - 1)) != 0) {
+        return -1;
+    }
+    ctx->block_size = (uint64_t)header.block_size;
+
+    // Application files live under "uroot" in the super-root
+    int64_t root_ino = header.superroot_ino;
+    vfs_pkg_for_each_dirent(ctx, header.superroot_ino, [&](const layra_pfs_dirent_t& dirent,
+                                                           const std::string& name) {
+        if (dirent.type == LAYRA_PFS_DIRENT_DIRECTORY && name == "uroot") {
+            root_ino = dirent.ino;
+            return 1;
+        }
+        return 0;
+    });
+    vfs_pkg_node_t root = {0, 0, 1, 0};
+    ctx->nodes[""] = root;
+    std::unordered_set<int64_t> visited;
+    vfs_pkg_add_tree(ctx, root_ino, "", 0, &visited);
+    return 0;
+}
+
+static void* vfs_pkg_open(void* ctx, const char* relative_path, const char*) {
+    vfs_pkg_ctx_t* pkg_ctx = (vfs_pkg_ctx_t*)ctx;
+    auto it = pkg_ctx->nodes.find(relative_path);
+    if (it == pkg_ctx->nodes.end() || it->second.is_directory || it->second.is_compressed) {
+        return NULL;
+    }
+    // The index is immutable after mount, so nodes double as file handles
+    return &it->second;
+}
+
+static size_t vfs_pkg_read(void* ctx, void* file, void* buffer, size_t size, uint64_t offset) {
+    const vfs_pkg_node_t* node = (const vfs_pkg_node_t*)file;
+    if (offset >= node->size) {
+        return 0;
+    }
+    if (size > node->size - offset) {
+        size = (size_t)(node->size - offset);
+    }
+    return vfs_pkg_read_image((vfs_pkg_ctx_t*)ctx, buffer, size, node->offset + offset);
+}
+
+static uint64_t vfs_pkg_size(void*, void* file) {
+    return ((const vfs_pkg_node_t*)file)->size;
+}
+
+static void vfs_pkg_destroy(void* ctx) {
+    vfs_pkg_ctx_t* pkg_ctx = (vfs_pkg_ctx_t*)ctx;
+    if (pkg_ctx->cached) {
+        vfs_sector_cache_drop_source(pkg_ctx->cache_source);
+    }
+    layra_pkg_close(pkg_ctx->pkg);
+    delete pkg_ctx;
+}
+
+int vfs_pkg_handler_create(layra_pkg_t* pkg, layra_vfs_handler_t* handler) {
+    if (!pkg || !handler) {
+        layra_pkg_close(pkg);
+        return -1;
+    }
+    vfs_pkg_ctx_t* ctx = new vfs_pkg_ctx_t();
+    ctx->pkg = pkg;
+    ctx->image_size = layra_pkg_get_pfs_size(pkg);
+    ctx->block_size = LAYRA_PKG_SECTOR_SIZE;
+    ctx->cached = layra_pkg_has_pfs_keys(pkg);
+    ctx->cache_source = vfs_sector_cache_new_source();
+    if (vfs_pkg_build_index(ctx) != 0) {
+        vfs_pkg_destroy(ctx);
+        return -1;
+    }
+    handler->ctx = ctx;
+    handler->open = vfs_pkg_open;
+    handler->close = NULL;
+    handler->read = vfs_pkg_read;
+    handler->write = NULL;
+    handler->size = vfs_pkg_size;
+    handler->host_path = NULL;
+    handler->native_fd = NULL;
+    handler->destroy = vfs_pkg_destroy;
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string.h>
+#include <unordered_map>
+#include "layra_vfs.h"
+#include "vfs_sector_cache.h"
+
+typedef struct {
+    uint64_t source;
+    uint64_t sector;
+} vfs_sector_key_t;
+
+static inline bool operator==(const vfs_sector_key_t& a, const vfs_sector_key_t& b) {
+    return a.source == b.source && a.sector == b.sector;
+}
+
+// Mixes both halves so neighbouring sectors land on different shards
+static inline uint64_t vfs_sector_key_hash(const vfs_sector_key_t& key) {
+    uint64_t hash = key.sector * 0x9E3779B97F4A7C15ull ^ key.source * 0xC2B2AE3D27D4EB4Full;
+    return hash ^ (hash >> 29);
+}
+
+struct vfs_sector_key_hasher {
+    size_t operator()(const vfs_sector_key_t& key) const {
+        return (size_t)vfs_sector_key_hash(key);
+    }
+};
+
+typedef struct {
+    vfs_sector_key_t key;
+    uint8_t data[VFS_SECTOR_CACHE_SECTOR_SIZE];
+} vfs_sector_entry_t;
+
+typedef std::list<vfs_sector_entry_t> vfs_sector_lru_t;
+
+// Each shard is an independent LRU with its own lock and a slice of the budget
+typedef struct {
+    std::mutex mutex;
+    // Most recently used first. Evicted entries are recycled in place, so a warm
+    // cache inserts without allocating.
+    vfs_sector_lru_t lru;
+    std::unordered_map<vfs_sector_key_t, vfs_sector_lru_t::iterator, vfs_sector_key_hasher> index;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} vfs_sector_shard_t;
+
+static vfs_sector_shard_t g_shards[VFS_SECTOR_CACHE_SHARDS];
+static std::atomic<uint64_t> g_budget{VFS_SECTOR_CACHE_DEFAULT_BUDGET};
+static std::atomic<uint64_t> g_next_source{1};
+
+static inline vfs_sector_shard_t* vfs_sector_shard(const vfs_sector_key_t& key) {
+    return &g_shards[(vfs_sector_key_hash(key) >> 32) % VFS_SECTOR_CACHE_SHARDS];
+}
+
+static inline size_t vfs_sector_shard_capacity(void) {
+    return (size_t)(g_budget.load(std::memory_order_relaxed) / VFS_SECTOR_CACHE_SHARDS /
+                    VFS_SECTOR_CACHE_SECTOR_SIZE);
+}
+
+// Caller holds the shard lock
+static void vfs_sector_shard_trim(vfs_sector_shard_t* shard, size_t capacity) {
+    while (shard->lru.size() > capacity) {
+        shard->index.erase(shard->lru.back().key);
+        shard->lru.pop_back();
+        shard->evictions++;
+    }
+}
+
+uint64_t vfs_sector_cache_new_source(void) {
+    return g_next_source.fetch_add(1, std::memory_order_relaxed);
+}
+
+void vfs_sector_cache_drop_source(uint64_t source) {
+    for (vfs_sector_shard_t& shard : g_shards) {
+        std::scoped_lock lock{shard.mutex};
+        for (auto it = shard.lru.begin(); it != shard.lru.end();) {
+            if (it->key.source == source) {
+                shard.index.erase(it->key);
+                it = shard.lru.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+int vfs_sector_cache_read(uint64_t source, uint64_t sector, void* buffer, size_t offset,
+                          size_t size) {
+    vfs_sector_key_t key = {source, sector};
+    vfs_sector_shard_t* shard = vfs_sector_shard(key);
+    std::scoped_lock lock{shard->mutex};
+    auto it = shard->index.find(key);
+    if (it == shard->index.end()) {
+        shard->misses++;
+        return -1;
+    }
+    shard->lru.splice(shard->lru.begin(), shard->lru, it->second);
+    memcpy(buffer, it->second->data + offset, size);
+    shard->hits++;
+    return 0;
+}
+
+int vfs_sector_cache_contains(uint64_t source, uint64_t sector) {
+    vfs_sector_key_t key = {source, sector};
+    vfs_sector_shard_t* shard = vfs_sector_shard(key);
+    std::scoped_lock lock{shard->mutex};
+    if (shard->index.find(key) == shard->index.end()) {
+        shard->misses++;
+        return 0;
+    }
+    return 1;
+}
+
+void vfs_sector_cache_insert(uint64_t source, uint64_t sector, const void* data) {
+    size_t capacity = vfs_sector_shard_capacity();
+    if (capacity == 0) {
+        return;
+    }
+    vfs_sector_key_t key = {source, sector};
+    vfs_sector_shard_t* shard = vfs_sector_shard(key);
+    std::scoped_lock lock{shard->mutex};
+    auto it = shard->index.find(key);
+    if (it != shard->index.end()) {
+        shard->lru.splice(shard->lru.begin(), shard->lru, it->second);
+        return;
+    }
+    vfs_sector_shard_trim(shard, capacity);
+    if (shard->lru.size() == capacity) {
+        // Full: reuse the least recently used entry for the new sector
+        shard->index.erase(shard->lru.back().key);
+        shard->lru.splice(shard->lru.begin(), shard->lru, std::prev(shard->lru.end()));
+        shard->evictions++;
+    } else {
+        shard->lru.emplace_front();
+    }
+    vfs_sector_entry_t& entry = shard->lru.front();
+    entry.key = key;
+    memcpy(entry.data, data, VFS_SECTOR_CACHE_SECTOR_SIZE);
+    shard->index[key] = shard->lru.begin();
+}
+
+void layra_vfs_set_sector_cache_budget(uint64_t bytes) {
+    g_budget.store(bytes, std::memory_order_relaxed);
+    size_t capacity = vfs_sector_shard_capacity();
+    for (vfs_sector_shard_t& shard : g_shards) {
+        std::scoped_lock lock{shard.mutex};
+        vfs_sector_shard_trim(&shard, capacity);
+    }
+}
+
+void layra_vfs_get_sector_cache_stats(layra_vfs_cache_stats_t* stats) {
+    if (!stats) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    for (vfs_sector_shard_t& shard : g_shards) {
+        std::scoped_lock lock{shard.mutex};
+        stats->hits += shard.hits;
+        stats->misses += shard.misses;
+        stats->evictions += shard.evictions;
+        stats->used_bytes += (uint64_t)shard.lru.size() * VFS_SECTOR_CACHE_SECTOR_SIZE;
+    }
+    stats->budget_bytes = g_budget.load(std::memory_order_relaxed);
+}
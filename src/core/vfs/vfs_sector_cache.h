@@ -0,0 +1,25 @@
+#ifndef VFS_SECTOR_CACHE_H
+#define VFS_SECTOR_CACHE_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Process-wide LRU cache of decrypted image sectors shared by all package mounts.
+// Entries are keyed by (source, sector); each mount takes its own source id so a
+// remount never sees stale data from a previous package.
+#define VFS_SECTOR_CACHE_SECTOR_SIZE 0x1000
+#define VFS_SECTOR_CACHE_SHARDS 16
+#define VFS_SECTOR_CACHE_DEFAULT_BUDGET (64ull * 1024 * 1024)
+
+uint64_t vfs_sector_cache_new_source(void);
+// Drop every sector of a source, called when its mount goes away
+void vfs_sector_cache_drop_source(uint64_t source);
+// Copy size bytes at offset within a cached sector, returns 0 on hit and -1 on miss
+int vfs_sector_cache_read(uint64_t source, uint64_t sector, void* buffer, size_t offset,
+                          size_t size);
+// Check for a sector without copying it. Callers probe sectors they are about to fetch,
+// so an absent one counts as a miss; a present one is counted when it is read.
+int vfs_sector_cache_contains(uint64_t source, uint64_t sector);
+// Store a full decrypted sector, evicting the least recently used ones over budget
+void vfs_sector_cache_insert(uint64_t source, uint64_t sector, const void* data);
+
+#endif // VFS_SECTOR_CACHE_H
@@ -0,0 +1,64 @@
+#include <cstring>
+#include "cpublockcache.h"
+#include "memorymanager.h"
+
+TranslatedBlock* BlockCache::lookup(uint64_t pc) const {
+    auto it = blocks.find(pc);
+    return it != blocks.end() ? it->second.get() : nullptr;
+}
+
+TranslatedBlock* BlockCache::translate(uint64_t pc, MemoryManager* memory, bool fastmem) {
+    auto block = std::make_unique<TranslatedBlock>();
+    block->start_pc = pc;
+    block->next = nullptr;
+
+    // Decode up to and including the first block terminator, or to the size limit
+    uint64_t cur = pc;
+    while (block->ops.size() < MAX_BLOCK_INSTRUCTIONS) {
+        const uint8_t* code = memory->getHostPointer(cur, sizeof(uint32_t), PAGE_EXECUTE);
+        if (!code) {
+            break;
+        }
+        uint32_t instruction;
+        std::memcpy(&instruction, code, sizeof(instruction));
+        MicroOp op = decodeInstruction(instruction, fastmem);
+        block->ops.push_back(op);
+        cur += 4;
+        if (endsBasicBlock(op)) {
+            // Blocks end where the interpreter's do, so the successor starts at cur
+            break;
+        }
+    }
+    if (block->ops.empty()) {
+        return nullptr;
+    }
+    block->end_pc = cur;
+
+    TranslatedBlock* result = block.get();
+    blocks[pc] = std::move(block);
+    return result;
+}
+
+void BlockCache::invalidateRange(uint64_t start, uint64_t end) {
+    bool removed = false;
+    for (auto it = blocks.begin(); it != blocks.end();) {
+        const TranslatedBlock& block = *it->second;
+        if (block.start_pc < end && block.end_pc > start) {
+            it = blocks.erase(it);
+            removed = true;
+        } else {
+            ++it;
+        }
+    }
+    if (!removed) {
+        return;
+    }
+    // Unchain every block, links into erased blocks are now dangling
+    for (auto& entry : blocks) {
+        entry.second->next = nullptr;
+    }
+}
+
+void BlockCache::clear() {
+    blocks.clear();
+}
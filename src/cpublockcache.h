@@ -0,0 +1,36 @@
+#ifndef CPU_BLOCK_CACHE_H
+#define CPU_BLOCK_CACHE_H
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "cpudecoder.h"
+
+class MemoryManager;
+
+// Longest basic block we translate in one go
+constexpr uint32_t MAX_BLOCK_INSTRUCTIONS = 256;
+
+// Guest basic block translated into threaded code
+struct TranslatedBlock {
+    uint64_t start_pc;
+    uint64_t end_pc;
+    std::vector<MicroOp> ops;
+    // Successor block the last exit went to, looked up again when the exit pc differs
+    TranslatedBlock* next;
+};
+
+class BlockCache {
+public:
+    // Find the block starting at a guest address
+    TranslatedBlock* lookup(uint64_t pc) const;
+    // Discover and translate the basic block starting at a guest address
+    TranslatedBlock* translate(uint64_t pc, MemoryManager* memory, bool fastmem);
+    // Drop every block overlapping [start, end)
+    void invalidateRange(uint64_t start, uint64_t end);
+    void clear();
+private:
+    std::unordered_map<uint64_t, std::unique_ptr<TranslatedBlock>> blocks;
+};
+
+#endif  // CPU_BLOCK_CACHE_H
@@ -0,0 +1,266 @@
+#include <cstring>
+#include "cpucore.h"
+#include "memorymanager.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+void CPUCore::init(uint32_t core_id, MemoryManager* memory_manager, int watcher) {
+    // Initialize the core
+    id = core_id;
+    code_watcher = watcher;
+    cpu_state = CPUState();
+    cpu_state.pc = 0x10000000;
+    cpu_state.sp = 0x10000000;
+    memory = memory_manager;
+    fastmem = memory->getFastmemBase() != nullptr;
+    cpu_state.memory = memory;
+    cpu_state.fastmem_base = memory->getFastmemBase();
+    decode_cache.clear();
+    block_cache.clear();
+    block_heat.clear();
+}
+
+void CPUCore::executeInstruction(uint32_t instruction) {
+    // Execute the instruction (outside a run, so always on the slow path)
+    MicroOp op = decodeInstruction(instruction);
+    op.handler(&cpu_state, op);
+}
+
+const MicroOp* CPUCore::fetchMicroOp(uint64_t pc) {
+    if (const MicroOp* op = decode_cache.lookup(pc)) {
+        return op;
+    }
+    // Decode once, later visits reuse the cached micro-op
+    const uint8_t* code = memory->getHostPointer(pc, sizeof(uint32_t), PAGE_EXECUTE);
+    if (!code) {
+        return nullptr;
+    }
+    uint32_t instruction;
+    std::memcpy(&instruction, code, sizeof(instruction));
+    memory->watchWrites(code_watcher, pc, sizeof(instruction));
+    return decode_cache.insert(pc, decodeInstruction(instruction, fastmem));
+}
+
+uint32_t CPUCore::interpretBlock(CPUState* state) {
+    // Interpret until the end of the current basic block
+    uint32_t executed = 0;
+    while (executed < MAX_BLOCK_INSTRUCTIONS) {
+        const MicroOp* op = fetchMicroOp(state->pc);
+        if (!op) {
+            // Instruction fetch from non-executable memory
+            state->page_fault = true;
+            state->fault_address = state->pc;
+            break;
+        }
+        // pc must name the executing instruction in case it faults
+        op->handler(state, *op);
+        if (state->page_fault) {
+            break;
+        }
+        state->pc += 4;
+        executed++;
+        if (endsBasicBlock(*op)) {
+            break;
+        }
+    }
+    return executed;
+}
+
+TranslatedBlock* CPUCore::findBlock(uint64_t pc) {
+    if (interpreter_only) {
+        return nullptr;
+    }
+    if (TranslatedBlock* block = block_cache.lookup(pc)) {
+        return block;
+    }
+    // Only translate code that has proven hot, cold code stays interpreted
+    if (++block_heat[pc] < BLOCK_TRANSLATE_THRESHOLD) {
+        return nullptr;
+    }
+    block_heat.erase(pc);
+    TranslatedBlock* block = block_cache.translate(pc, memory, fastmem);
+    if (block) {
+        memory->watchWrites(code_watcher, block->start_pc, block->end_pc - block->start_pc);
+    }
+    return block;
+}
+
+CPUExitReason CPUCore::runFor(uint64_t cycle_budget) {
+    return run(CPU_EVENT_ALL, cycle_budget);
+}
+
+CPUExitReason CPUCore::runUntil(uint32_t events) {
+    return run(events, UINT64_MAX);
+}
+
+CPUExitReason CPUCore::run(uint32_t events, uint64_t cycle_budget) {
+    // Keep guest state in a run-local copy, written back once on exit
+    run_state = cpu_state;
+    run_state.page_fault = false;
+    run_cycles = 0;
+    CPUExitReason reason = CPUExitReason::BudgetExhausted;
+
+    while (!runGuarded(events, cycle_budget, &reason)) {
+        // A fastmem access could not be fixed up in place
+        if (!retryOnSlowPath()) {
+            reason = CPUExitReason::PageFault;
+            break;
+        }
+    }
+
+    cpu_state = run_state;
+    cycle_count.fetch_add(run_cycles, std::memory_order_relaxed);
+    return reason;
+}
+
+#if defined(_MSC_VER)
+static int fastmemFilter(MemoryManager* memory, EXCEPTION_POINTERS* info) {
+    const EXCEPTION_RECORD* record = info->ExceptionRecord;
+    if (record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION &&
+        memory->isFastmemAddress(reinterpret_cast<void*>(record->ExceptionInformation[1]))) {
+        return EXCEPTION_EXECUTE_HANDLER;
+    }
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+#endif
+
+bool CPUCore::runGuarded(uint32_t events, uint64_t cycle_budget, CPUExitReason* reason) {
+    // runLoop must not own objects with destructors, a fault escape skips them
+#if defined(_MSC_VER)
+    __try {
+        *reason = runLoop(events, cycle_budget);
+    } __except (fastmemFilter(memory, GetExceptionInformation())) {
+        return false;
+    }
+    return true;
+#elif defined(_WIN32)
+    // Without SEH fastmem is disabled and every access takes the slow path
+    *reason = runLoop(events, cycle_budget);
+    return true;
+#else
+    FastmemRecovery recovery;
+    if (sigsetjmp(recovery.env, 0)) {
+        MemoryManager::setFastmemRecovery(nullptr);
+        return false;
+    }
+    MemoryManager::setFastmemRecovery(&recovery);
+    *reason = runLoop(events, cycle_budget);
+    MemoryManager::setFastmemRecovery(nullptr);
+    return true;
+#endif
+}
+
+bool CPUCore::retryOnSlowPath() {
+    const uint8_t* code = memory->getHostPointer(run_state.pc, sizeof(uint32_t), PAGE_EXECUTE);
+    if (!code) {
+        return false;
+    }
+    uint32_t instruction;
+    std::memcpy(&instruction, code, sizeof(instruction));
+    MicroOp op = decodeInstruction(instruction);
+    op.handler(&run_state, op);
+    if (run_state.page_fault) {
+        return false;
+    }
+    run_state.pc += 4;
+    run_cycles++;
+    return true;
+}
+
+CPUExitReason CPUCore::runLoop(uint32_t events, uint64_t cycle_budget) {
+    CPUState& state = run_state;
+    TranslatedBlock* block = nullptr;
+    uint64_t generation = code_generation;
+
+    while (run_cycles < cycle_budget) {
+        uint32_t raised = pending_events.load(std::memory_order_acquire) & events;
+        if (raised) {
+            pending_events.fetch_and(~raised, std::memory_order_acq_rel);
+            return (raised & CPU_EVENT_INTERRUPT) ? CPUExitReason::Interrupt
+                                                  : CPUExitReason::SyncPoint;
+        }
+        // Writes that faulted on any core reach the code caches here
+        memory->reportPendingWrites();
+        if (has_invalidations.load(std::memory_order_acquire)) {
+            applyInvalidations();
+        }
+        if (generation != code_generation) {
+            generation = code_generation;
+            block = nullptr;
+        }
+
+        if (!block) {
+            block = findBlock(state.pc);
+        }
+        if (!block) {
+            run_cycles += interpretBlock(&state);
+            if (state.page_fault) {
+                return CPUExitReason::PageFault;
+            }
+            continue;
+        }
+
+        // pc advances per instruction so a faulting access can be retried
+        for (const MicroOp& op : block->ops) {
+            op.handler(&state, op);
+            if (state.page_fault) {
+                return CPUExitReason::PageFault;
+            }
+            state.pc += 4;
+        }
+        run_cycles += block->ops.size();
+
+        // Follow the chain, linking the successor on first exit. A terminator can exit
+        // to different pcs, so the link is only taken when it still matches.
+        TranslatedBlock* next = block->next;
+        if (!next || next->start_pc != state.pc) {
+            next = block_cache.lookup(state.pc);
+            block->next = next;
+        }
+        block = next;
+    }
+    return CPUExitReason::BudgetExhausted;
+}
+
+void CPUCore::raiseEvent(uint32_t events) {
+    pending_events.fetch_or(events, std::memory_order_release);
+}
+
+uint64_t CPUCore::getCycleCount() const {
+    return cycle_count.load(std::memory_order_relaxed);
+}
+
+uint32_t CPUCore::getId() const {
+    return id;
+}
+
+CPUState* CPUCore::getState() {
+    return &cpu_state;
+}
+
+void CPUCore::setInterpreterOnly(bool enabled) {
+    interpreter_only = enabled;
+}
+
+void CPUCore::invalidateCode(uint64_t start, uint64_t end) {
+    // Caches belong to the core thread, so only queue the range here. Never called from
+    // the fault handler, taking the lock is fine.
+    std::scoped_lock lock{invalidation_mutex};
+    pending_invalidations.emplace_back(start, end);
+    has_invalidations.store(true, std::memory_order_release);
+}
+
+void CPUCore::applyInvalidations() {
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    {
+        std::scoped_lock lock{invalidation_mutex};
+        ranges.swap(pending_invalidations);
+        has_invalidations.store(false, std::memory_order_release);
+    }
+    for (const auto& range : ranges) {
+        decode_cache.invalidateRange(range.first, range.second);
+        block_cache.invalidateRange(range.first, range.second);
+    }
+    code_generation++;
+}
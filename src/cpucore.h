@@ -0,0 +1,99 @@
+#ifndef CPU_CORE_H
+#define CPU_CORE_H
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "cpublockcache.h"
+
+class MemoryManager;
+
+// Guest CPU register state
+struct CPUState {
+    uint64_t pc;
+    uint64_t sp;
+    uint64_t regs[16];
+    // Memory context used by load/store handlers
+    MemoryManager* memory;
+    uint8_t* fastmem_base;
+    // Set by the slow path when an access hits unmapped or protected memory
+    bool page_fault;
+    uint64_t fault_address;
+};
+
+// Interpreted runs of a block before it gets translated
+constexpr uint32_t BLOCK_TRANSLATE_THRESHOLD = 16;
+
+// Events that stop a batched run
+enum CPUEvent : uint32_t {
+    CPU_EVENT_INTERRUPT = 1 << 0,
+    CPU_EVENT_GPU_SYNC = 1 << 1,
+    CPU_EVENT_IO_SYNC = 1 << 2,
+    CPU_EVENT_STOP = 1 << 3,
+    CPU_EVENT_ALL = 0xFFFFFFFF,
+};
+
+// Why a batched run returned
+enum class CPUExitReason {
+    BudgetExhausted,
+    Interrupt,
+    SyncPoint,
+    PageFault,
+};
+
+// One emulated guest core with its own state and code caches
+class CPUCore {
+public:
+    // code_watcher is the write watcher that reports guest writes to decoded code
+    void init(uint32_t core_id, MemoryManager* memory_manager, int code_watcher);
+    void executeInstruction(uint32_t instruction);
+    // Run until the cycle budget is spent or any event is raised
+    CPUExitReason runFor(uint64_t cycle_budget);
+    // Run until one of the given events is raised
+    CPUExitReason runUntil(uint32_t events);
+    // Raise events from any thread, checked at block boundaries
+    void raiseEvent(uint32_t events);
+    uint64_t getCycleCount() const;
+    uint32_t getId() const;
+    CPUState* getState();
+    // Force every instruction through the interpreter (debugging)
+    void setInterpreterOnly(bool enabled);
+    // Queue a code invalidation, applied by the core at its next block boundary
+    void invalidateCode(uint64_t start, uint64_t end);
+private:
+    CPUExitReason run(uint32_t events, uint64_t cycle_budget);
+    // Run the loop behind a fastmem recovery point, false if it escaped through a fault
+    bool runGuarded(uint32_t events, uint64_t cycle_budget, CPUExitReason* reason);
+    CPUExitReason runLoop(uint32_t events, uint64_t cycle_budget);
+    // Redo the faulting instruction through the slow memory path
+    bool retryOnSlowPath();
+    uint32_t interpretBlock(CPUState* state);
+    const MicroOp* fetchMicroOp(uint64_t pc);
+    TranslatedBlock* findBlock(uint64_t pc);
+    void applyInvalidations();
+
+    uint32_t id = 0;
+    CPUState cpu_state{};
+    MemoryManager* memory = nullptr;
+    int code_watcher = -1;
+    DecodeCache decode_cache;
+    BlockCache block_cache;
+    std::unordered_map<uint64_t, uint32_t> block_heat;
+    bool interpreter_only = false;
+    bool fastmem = false;
+    // State and cycles of the current run; members so they survive a fault escape
+    CPUState run_state;
+    uint64_t run_cycles = 0;
+    std::atomic<uint64_t> cycle_count{0};
+    // Bumped whenever translated code is dropped, so runs stop following stale blocks
+    uint64_t code_generation = 0;
+    std::atomic<uint32_t> pending_events{0};
+
+    std::mutex invalidation_mutex;
+    std::vector<std::pair<uint64_t, uint64_t>> pending_invalidations;
+    std::atomic<bool> has_invalidations{false};
+};
+
+#endif  // CPU_CORE_H
@@ -0,0 +1,142 @@
+#include <cstring>
+#include "cpudecoder.h"
+#include "cpuemulator.h"
+#include "memorymanager.h"
+
+static void opNop(CPUState*, const MicroOp&) {
+    // Nothing to do
+}
+
+static void opAdd(CPUState* state, const MicroOp& op) {
+    state->regs[op.rd] = state->regs[op.rs] + state->regs[op.rt];
+}
+
+static void opSub(CPUState* state, const MicroOp& op) {
+    state->regs[op.rd] = state->regs[op.rs] - state->regs[op.rt];
+}
+
+static void raisePageFault(CPUState* state, uint64_t address) {
+    state->page_fault = true;
+    state->fault_address = address;
+}
+
+// Host address of a guest access, nullptr when it leaves the reservation. Inside it the
+// host protection of the page decides and the fault handler takes over.
+static inline uint8_t* fastmemPointer(CPUState* state, uint64_t address, uint64_t size) {
+    if (address > GUEST_ADDRESS_SPACE_SIZE - size) {
+        return nullptr;
+    }
+    return state->fastmem_base + address;
+}
+
+static void opLoadFast(CPUState* state, const MicroOp& op) {
+    uint64_t address = state->regs[op.rs] + op.imm;
+    uint8_t* host = fastmemPointer(state, address, sizeof(uint64_t));
+    if (!host) {
+        raisePageFault(state, address);
+        return;
+    }
+    std::memcpy(&state->regs[op.rd], host, sizeof(uint64_t));
+}
+
+static void opStoreFast(CPUState* state, const MicroOp& op) {
+    uint64_t address = state->regs[op.rs] + op.imm;
+    uint8_t* host = fastmemPointer(state, address, sizeof(uint64_t));
+    if (!host) {
+        raisePageFault(state, address);
+        return;
+    }
+    std::memcpy(host, &state->regs[op.rt], sizeof(uint64_t));
+}
+
+static void opLoadSlow(CPUState* state, const MicroOp& op) {
+    uint64_t address = state->regs[op.rs] + op.imm;
+    uint64_t value;
+    if (!state->memory->readMemory(address, &value, sizeof(value))) {
+        raisePageFault(state, address);
+        return;
+    }
+    state->regs[op.rd] = value;
+}
+
+static void opStoreSlow(CPUState* state, const MicroOp& op) {
+    uint64_t address = state->regs[op.rs] + op.imm;
+    if (!state->memory->writeMemory(address, &state->regs[op.rt], sizeof(uint64_t))) {
+        raisePageFault(state, address);
+    }
+}
+
+static void opUnknown(CPUState*, const MicroOp&) {
+    // Unimplemented instruction, treated as a NOP
+}
+
+MicroOp decodeInstruction(uint32_t instruction, bool fastmem) {
+    // Instruction layout: opcode[7:0] rd[11:8] rs[15:12] rt[19:16] imm[31:20]
+    MicroOp op;
+    op.opcode = instruction & 0xFF;
+    op.rd = (instruction >> 8) & 0xF;
+    op.rs = (instruction >> 12) & 0xF;
+    op.rt = (instruction >> 16) & 0xF;
+    op.imm = static_cast<int32_t>(instruction) >> 20;
+
+    switch (op.opcode) {
+        case OPCODE_NOP:
+            op.handler = opNop;
+            break;
+        case OPCODE_ADD:
+            op.handler = opAdd;
+            break;
+        case OPCODE_SUB:
+            op.handler = opSub;
+            break;
+        case OPCODE_LOAD:
+            op.handler = fastmem ? opLoadFast : opLoadSlow;
+            break;
+        case OPCODE_STORE:
+            op.handler = fastmem ? opStoreFast : opStoreSlow;
+            break;
+        default:
+            op.handler = opUnknown;
+            break;
+    }
+    return op;
+}
+
+bool endsBasicBlock(const MicroOp& op) {
+    // Anything we cannot decode may change control flow, so end the block there
+    return op.handler == opUnknown;
+}
+
+// Tag that never matches an instruction address (pc is 4-byte aligned)
+static const uint64_t INVALID_PC = ~0ull;
+
+DecodeCache::DecodeCache() : entries(DECODE_CACHE_SIZE) {
+    clear();
+}
+
+const MicroOp* DecodeCache::insert(uint64_t pc, const MicroOp& op) {
+    Entry& entry = entries[(pc >> 2) & (DECODE_CACHE_SIZE - 1)];
+    entry.pc = pc;
+    entry.op = op;
+    return &entry.op;
+}
+
+void DecodeCache::invalidateRange(uint64_t start, uint64_t end) {
+    // Large ranges cover every slot anyway
+    if (end - start >= uint64_t(DECODE_CACHE_SIZE) * 4) {
+        clear();
+        return;
+    }
+    for (uint64_t pc = start & ~3ull; pc < end; pc += 4) {
+        Entry& entry = entries[(pc >> 2) & (DECODE_CACHE_SIZE - 1)];
+        if (entry.pc == pc) {
+            entry.pc = INVALID_PC;
+        }
+    }
+}
+
+void DecodeCache::clear() {
+    for (Entry& entry : entries) {
+        entry.pc = INVALID_PC;
+    }
+}
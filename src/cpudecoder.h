@@ -0,0 +1,63 @@
+#ifndef CPU_DECODER_H
+#define CPU_DECODER_H
+#include <cstdint>
+#include <vector>
+
+struct CPUState;
+struct MicroOp;
+
+// Handler that executes one pre-decoded instruction
+typedef void (*MicroOpHandler)(CPUState* state, const MicroOp& op);
+
+// Guest opcodes (low byte of the instruction word)
+enum GuestOpcode : uint8_t {
+    OPCODE_NOP = 0x00,
+    OPCODE_ADD = 0x01,
+    OPCODE_SUB = 0x02,
+    OPCODE_LOAD = 0x03,
+    OPCODE_STORE = 0x04,
+};
+
+// Decoded instruction with its handler and pre-extracted operands
+struct MicroOp {
+    MicroOpHandler handler;
+    uint8_t opcode;
+    uint8_t rd;
+    uint8_t rs;
+    uint8_t rt;
+    int32_t imm;
+};
+
+// Decode an instruction word into a micro-op. With fastmem, loads and stores
+// access host memory directly and rely on the fault handler for the slow path.
+MicroOp decodeInstruction(uint32_t instruction, bool fastmem = false);
+
+// Check whether a micro-op terminates a basic block
+bool endsBasicBlock(const MicroOp& op);
+
+// Number of entries in the decoded-instruction cache (power of two)
+constexpr uint32_t DECODE_CACHE_SIZE = 0x10000;
+
+// Direct-mapped cache of decoded instructions keyed by guest pc
+class DecodeCache {
+public:
+    DecodeCache();
+    // Find the decoded instruction at a guest address
+    const MicroOp* lookup(uint64_t pc) const {
+        const Entry& entry = entries[(pc >> 2) & (DECODE_CACHE_SIZE - 1)];
+        return entry.pc == pc ? &entry.op : nullptr;
+    }
+    // Store a decoded instruction, replacing whatever shared its slot
+    const MicroOp* insert(uint64_t pc, const MicroOp& op);
+    // Drop every entry inside [start, end)
+    void invalidateRange(uint64_t start, uint64_t end);
+    void clear();
+private:
+    struct Entry {
+        uint64_t pc;
+        MicroOp op;
+    };
+    std::vector<Entry> entries;
+};
+
+#endif  // CPU_DECODER_H
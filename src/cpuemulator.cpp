@@ -1,28 +1,125 @@
-#include "cpu_emulator.h"
-void CPUEmulator::init() {
+#include <algorithm>
+#include "cpuemulator.h"
+#include "memorymanager.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Pin the calling thread to a single host CPU
+static void pinCurrentThread(uint32_t host_cpu) {
+#ifdef _WIN32
+    SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << host_cpu);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(host_cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+CPUEmulator::~CPUEmulator() {
+    stop();
+    // The callback points back at this emulator
+    if (memory) {
+        memory->unsubscribeWrites(code_watcher);
+    }
+}
+
+void CPUEmulator::init(MemoryManager* memory_manager, uint32_t core_count) {
     // Initialize the CPU emulator
-    cpu_state = new CPUState();
-    cpu_state->pc = 0x10000000;
-    cpu_state->sp = 0x10000000;
+    stop();
+    if (memory) {
+        memory->unsubscribeWrites(code_watcher);
+    }
+    memory = memory_manager;
+    cores.clear();
+    code_watcher = memory->subscribeWrites([this](uint64_t start, uint64_t end) {
+        invalidateCode(start, end);
+    });
+    for (uint32_t i = 0; i < core_count; i++) {
+        auto core = std::make_unique<CPUCore>();
+        core->init(i, memory, code_watcher);
+        cores.push_back(std::move(core));
+    }
 }
 
 void CPUEmulator::executeInstruction(uint32_t instruction) {
-    // Execute the instruction
-    switch (instruction) {
-        case 0x00000000: // NOP
-            break;
-        case 0x00000001: // ADD
-            // Handle ADD instruction
-            break;
-        case 0x00000002: // SUB
-            // Handle SUB instruction
-            break;
-        // ...
-    }
+    // Execute the instruction on the boot core
+    cores[0]->executeInstruction(instruction);
 }
 
 void CPUEmulator::update() {
     // Update the CPU emulator
-    executeInstruction(cpu_state->pc);
-    cpu_state->pc += 4;
+    if (running) {
+        return;
+    }
+    for (auto& core : cores) {
+        core->runFor(UPDATE_CYCLE_BUDGET);
+    }
+}
+
+void CPUEmulator::start() {
+    if (running.exchange(true)) {
+        return;
+    }
+    for (auto& core : cores) {
+        threads.emplace_back(&CPUEmulator::coreThread, this, core.get());
+    }
+}
+
+void CPUEmulator::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    broadcastEvent(CPU_EVENT_STOP);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+bool CPUEmulator::isRunning() const {
+    return running;
+}
+
+void CPUEmulator::coreThread(CPUCore* core) {
+    // Leave host CPU 0 to the main thread when there are enough host CPUs
+    uint32_t host_cpus = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t offset = host_cpus > cores.size() ? 1 : 0;
+    pinCurrentThread((core->getId() + offset) % host_cpus);
+
+    while (running.load(std::memory_order_acquire)) {
+        core->runFor(CORE_SLICE_BUDGET);
+    }
+}
+
+void CPUEmulator::sendEvent(uint32_t core_id, uint32_t events) {
+    // Event delivery is release/acquire, so guest writes made before sending
+    // are visible to the target core once it observes the event
+    if (core_id < cores.size()) {
+        cores[core_id]->raiseEvent(events);
+    }
+}
+
+void CPUEmulator::broadcastEvent(uint32_t events) {
+    for (auto& core : cores) {
+        core->raiseEvent(events);
+    }
+}
+
+CPUCore* CPUEmulator::getCore(uint32_t core_id) {
+    return core_id < cores.size() ? cores[core_id].get() : nullptr;
+}
+
+uint32_t CPUEmulator::getCoreCount() const {
+    return static_cast<uint32_t>(cores.size());
+}
+
+void CPUEmulator::invalidateCode(uint64_t start, uint64_t end) {
+    for (auto& core : cores) {
+        core->invalidateCode(start, end);
+    }
 }
@@ -1,12 +1,48 @@
 #ifndef CPU_EMULATOR_H
 #define CPU_EMULATOR_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "cpucore.h"
+
+class MemoryManager;
+
+// Number of guest cores (the PS4 has eight Jaguar cores)
+constexpr uint32_t CPU_CORE_COUNT = 8;
+// Cycle budget of a single update() call
+constexpr uint64_t UPDATE_CYCLE_BUDGET = 0x4000;
+// Cycles a core thread runs between checks of the stop flag
+constexpr uint64_t CORE_SLICE_BUDGET = 0x100000;
+
 class CPUEmulator {
 public:
-    void init();
+    ~CPUEmulator();
+    void init(MemoryManager* memory_manager, uint32_t core_count = CPU_CORE_COUNT);
     void executeInstruction(uint32_t instruction);
+    // Step every core once from the calling thread (used while threads are stopped)
     void update();
+    // Run each core on its own host thread, pinned to its own host CPU
+    void start();
+    void stop();
+    bool isRunning() const;
+    // Raise events on one core or on every core
+    void sendEvent(uint32_t core_id, uint32_t events);
+    void broadcastEvent(uint32_t events);
+    CPUCore* getCore(uint32_t core_id);
+    uint32_t getCoreCount() const;
+    // Drop translated code overlapping a guest range on every core
+    void invalidateCode(uint64_t start, uint64_t end);
 private:
-    CPUState* cpu_state;
+    void coreThread(CPUCore* core);
+
+    MemoryManager* memory = nullptr;
+    // Write watcher shared by the code caches of every core
+    int code_watcher = -1;
+    std::vector<std::unique_ptr<CPUCore>> cores;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{false};
 };
 
 #endif  // CPU_EMULATOR_H
@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "xts_kernels.h"
+#if defined(LAYRA_XTS_HAVE_X86_KERNELS)
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Sectors handed to a worker at a time (64 KiB)
+#define XTS_CHUNK_SECTORS 16
+// Smaller requests are not worth waking the pool for
+#define XTS_PARALLEL_MIN_SECTORS (XTS_CHUNK_SECTORS * 2)
+
+typedef struct {
+    uint8_t sbox[256];
+    uint8_t inv_sbox[256];
+} aes_tables_t;
+
+static inline uint8_t aes_rotl8(uint8_t value, int shift) {
+    return (uint8_t)((value << shift) | (value >> (8 - shift)));
+}
+
+static inline uint8_t aes_xtime(uint8_t value) {
+    return (uint8_t)((value << 1) ^ (value & 0x80 ? 0x1B : 0));
+}
+
+static uint8_t aes_gmul(uint8_t a, uint8_t b) {
+    uint8_t result = 0;
+    while (b) {
+        if (b & 1) {
+            result ^= a;
+        }
+        a = aes_xtime(a);
+        b >>= 1;
+    }
+    return result;
+}
+
+static const aes_tables_t* aes_get_tables(void) {
+    // Generate the S-boxes from the field inverse and affine map instead of storing them
+    static const aes_tables_t tables = [] {
+        aes_tables_t t;
+        uint8_t p = 1;
+        uint8_t q = 1;
+        do {
+            p = p ^ (uint8_t)(p << 1) ^ (p & 0x80 ? 0x1B : 0);
+            q ^= q << 1;
+            q ^= q << 2;
+            q ^= q << 4;
+            if (q & 0x80) {
+                q ^= 0x09;
+            }
+            uint8_t x = q ^ aes_rotl8(q, 1) ^ aes_rotl8(q, 2) ^ aes_rotl8(q, 3) ^ aes_rotl8(q, 4);
+            t.sbox[p] = x ^ 0x63;
+        } while (p != 1);
+        t.sbox[0] = 0x63;
+        for (int i = 0; i < 256; i++) {
+            t.inv_sbox[t.sbox[i]] = (uint8_t)i;
+        }
+        return t;
+    }();
+    return &tables;
+}
+
+static void aes_expand_key(const uint8_t key[16], uint8_t round_keys[LAYRA_AES_ROUND_KEYS][16]) {
+    const aes_tables_t* t = aes_get_tables();
+    memcpy(round_keys[0], key, 16);
+    uint8_t rcon = 1;
+    for (int round = 1; round < LAYRA_AES_ROUND_KEYS; round++) {
+        const uint8_t* prev = round_keys[round - 1];
+        uint8_t* cur = round_keys[round];
+        uint8_t word[4] = {t->sbox[prev[13]], t->sbox[prev[14]], t->sbox[prev[15]],
+                           t->sbox[prev[12]]};
+        word[0] ^= rcon;
+        rcon = aes_xtime(rcon);
+        for (int i = 0; i < 16; i++) {
+            cur[i] = prev[i] ^ (i < 4 ? word[i] : cur[i - 4]);
+        }
+    }
+}
+
+static void aes_inv_mix_column(uint8_t* column) {
+    uint8_t a0 = column[0], a1 = column[1], a2 = column[2], a3 = column[3];
+    column[0] = aes_gmul(a0, 14) ^ aes_gmul(a1, 11) ^ aes_gmul(a2, 13) ^ aes_gmul(a3, 9);
+    column[1] = aes_gmul(a0, 9) ^ aes_gmul(a1, 14) ^ aes_gmul(a2, 11) ^ aes_gmul(a3, 13);
+    column[2] = aes_gmul(a0, 13) ^ aes_gmul(a1, 9) ^ aes_gmul(a2, 14) ^ aes_gmul(a3, 11);
+    column[3] = aes_gmul(a0, 11) ^ aes_gmul(a1, 13) ^ aes_gmul(a2, 9) ^ aes_gmul(a3, 14);
+}
+
+static void aes_encrypt_block(const uint8_t round_keys[LAYRA_AES_ROUND_KEYS][16],
+                              uint8_t block[16]) {
+    const aes_tables_t* t = aes_get_tables();
+    for (int i = 0; i < 16; i++) {
+        block[i] ^= round_keys[0][i];
+    }
+    for (int round = 1; round < LAYRA_AES_ROUND_KEYS; round++) {
+        // SubBytes and ShiftRows, state is column-major
+        uint8_t state[16];
+        for (int i = 0; i < 16; i++) {
+            state[i] = t->sbox[block[(i + 4 * (i % 4)) % 16]];
+        }
+        if (round != LAYRA_AES_ROUND_KEYS - 1) {
+            for (int c = 0; c < 4; c++) {
+                uint8_t* col = state + 4 * c;
+                uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+                uint8_t first = col[0];
+                col[0] ^= all ^ aes_xtime(col[0] ^ col[1]);
+                col[1] ^= all ^ aes_xtime(col[1] ^ col[2]);
+                col[2] ^= all ^ aes_xtime(col[2] ^ col[3]);
+                col[3] ^= all ^ aes_xtime(col[3] ^ first);
+            }
+        }
+        for (int i = 0; i < 16; i++) {
+            block[i] = state[i] ^ round_keys[round][i];
+        }
+    }
+}
+
+static void aes_decrypt_block(const uint8_t round_keys[LAYRA_AES_ROUND_KEYS][16],
+                              uint8_t block[16]) {
+    const aes_tables_t* t = aes_get_tables();
+    for (int i = 0; i < 16; i++) {
+        block[i] ^= round_keys[LAYRA_AES_ROUND_KEYS - 1][i];
+    }
+    for (int round = LAYRA_AES_ROUND_KEYS - 2; round >= 0; round--) {
+        // InvShiftRows and InvSubBytes
+        uint8_t state[16];
+        for (int i = 0; i < 16; i++) {
+            state[(i + 4 * (i % 4)) % 16] = t->inv_sbox[block[i]];
+        }
+        for (int i = 0; i < 16; i++) {
+            block[i] = state[i] ^ round_keys[round][i];
+        }
+        if (round != 0) {
+            for (int c = 0; c < 4; c++) {
+                aes_inv_mix_column(block + 4 * c);
+            }
+        }
+    }
+}
+
+// Multiply the tweak by x in GF(2^128), little-endian as XTS defines it
+static inline void xts_mul_alpha(uint8_t tweak[16]) {
+    uint8_t carry = 0;
+    for (int i = 0; i < 16; i++) {
+        uint8_t next = tweak[i] >> 7;
+        tweak[i] = (uint8_t)((tweak[i] << 1) | carry);
+        carry = next;
+    }
+    if (carry) {
+        tweak[0] ^= 0x87;
+    }
+}
+
+void xts_decrypt_scalar(const layra_xts_key_t* key, uint64_t first_sector, uint32_t count,
+                        uint8_t* data) {
+    for (uint32_t s = 0; s < count; s++) {
+        uint8_t tweak[16] = {};
+        uint64_t sector = first_sector + s;
+        for (int i = 0; i < 8; i++) {
+            tweak[i] = (uint8_t)(sector >> (8 * i));
+        }
+        aes_encrypt_block(key->tweak_enc, tweak);
+        uint8_t* block = data + (size_t)s * LAYRA_XTS_SECTOR_SIZE;
+        for (int b = 0; b < LAYRA_XTS_SECTOR_SIZE / 16; b++, block += 16) {
+            for (int i = 0; i < 16; i++) {
+                block[i] ^= tweak[i];
+            }
+            aes_decrypt_block(key->data_enc, block);
+            for (int i = 0; i < 16; i++) {
+                block[i] ^= tweak[i];
+            }
+            xts_mul_alpha(tweak);
+        }
+    }
+}
+
+void layra_xts_init_key(layra_xts_key_t* key, const uint8_t data_key[LAYRA_XTS_KEY_SIZE],
+                        const uint8_t tweak_key[LAYRA_XTS_KEY_SIZE]) {
+    aes_expand_key(data_key, key->data_enc);
+    aes_expand_key(tweak_key, key->tweak_enc);
+    // Equivalent inverse cipher schedule, what AESDEC expects
+    memcpy(key->data_dec[0], key->data_enc[LAYRA_AES_ROUND_KEYS - 1], 16);
+    for (int round = 1; round < LAYRA_AES_ROUND_KEYS - 1; round++) {
+        memcpy(key->data_dec[round], key->data_enc[LAYRA_AES_ROUND_KEYS - 1 - round], 16);
+        for (int c = 0; c < 4; c++) {
+            aes_inv_mix_column(key->data_dec[round] + 4 * c);
+        }
+    }
+    memcpy(key->data_dec[LAYRA_AES_ROUND_KEYS - 1], key->data_enc[0], 16);
+}
+
+typedef struct {
+    xts_kernel_t kernel;
+    const char* name;
+} xts_dispatch_t;
+
+static xts_dispatch_t xts_select_kernel(void) {
+#if defined(LAYRA_XTS_HAVE_X86_KERNELS)
+    unsigned int regs[4] = {};
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    memcpy(regs, info, sizeof(regs));
+#else
+    __get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+    int aesni = (regs[2] >> 25) & 1;
+    int osxsave = (regs[2] >> 27) & 1;
+    int ymm_enabled = 0;
+    if (osxsave) {
+#if defined(_MSC_VER)
+        ymm_enabled = (_xgetbv(0) & 6) == 6;
+#else
+        unsigned int xcr0_low, xcr0_high;
+        __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+        ymm_enabled = (xcr0_low & 6) == 6;
+#endif
+    }
+    unsigned int ext[4] = {};
+#if defined(_MSC_VER)
+    __cpuidex(info, 7, 0);
+    memcpy(ext, info, sizeof(ext));
+#else
+    __get_cpuid_count(7, 0, &ext[0], &ext[1], &ext[2], &ext[3]);
+#endif
+    int avx2 = (ext[1] >> 5) & 1;
+    int vaes = (ext[2] >> 9) & 1;
+    if (aesni && vaes && avx2 && ymm_enabled) {
+        return xts_dispatch_t{xts_decrypt_vaes, "vaes"};
+    }
+    if (aesni) {
+        return xts_dispatch_t{xts_decrypt_aesni, "aesni"};
+    }
+#endif
+    return xts_dispatch_t{xts_decrypt_scalar, "scalar"};
+}
+
+static const xts_dispatch_t* xts_get_dispatch(void) {
+    static const xts_dispatch_t dispatch = xts_select_kernel();
+    return &dispatch;
+}
+
+void layra_xts_decrypt_sectors(const layra_xts_key_t* key, uint64_t first_sector,
+                               uint32_t count, uint8_t* data) {
+    if (count) {
+        xts_get_dispatch()->kernel(key, first_sector, count, data);
+    }
+}
+
+const char* layra_xts_get_kernel_name(void) {
+    return xts_get_dispatch()->name;
+}
+
+// One parallel request, workers claim chunks of it until none are left
+struct xts_job_t {
+    const layra_xts_key_t* key;
+    uint64_t first_sector;
+    uint32_t count;
+    uint8_t* data;
+    std::atomic<uint32_t> next{0};
+    std::atomic<uint32_t> done{0};
+};
+
+static bool xts_run_chunk(xts_job_t* job) {
+    uint32_t start = job->next.fetch_add(XTS_CHUNK_SECTORS, std::memory_order_relaxed);
+    if (start >= job->count) {
+        return false;
+    }
+    uint32_t count = std::min<uint32_t>(XTS_CHUNK_SECTORS, job->count - start);
+    layra_xts_decrypt_sectors(job->key, job->first_sector + start, count,
+                              job->data + (size_t)start * LAYRA_XTS_SECTOR_SIZE);
+    job->done.fetch_add(count, std::memory_order_release);
+    return true;
+}
+
+// Workers shared by every package, started on first use and kept for the process lifetime
+class xts_worker_pool {
+public:
+    explicit xts_worker_pool(uint32_t worker_count) {
+        for (uint32_t i = 0; i < worker_count; i++) {
+            workers.emplace_back(&xts_worker_pool::worker_thread, this);
+        }
+    }
+    ~xts_worker_pool() {
+        {
+            std::scoped_lock lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    bool has_workers() const {
+        return !workers.empty();
+    }
+    void run(const std::shared_ptr<xts_job_t>& job) {
+        {
+            std::scoped_lock lock{mutex};
+            jobs.push_back(job);
+        }
+        wake.notify_all();
+        // The caller works on its own request too, then waits for chunks still in flight
+        while (xts_run_chunk(job.get())) {
+        }
+        remove(job.get());
+        while (job->done.load(std::memory_order_acquire) < job->count) {
+            std::this_thread::yield();
+        }
+    }
+private:
+    void remove(xts_job_t* job) {
+        std::scoped_lock lock{mutex};
+        auto it = std::find_if(jobs.begin(), jobs.end(),
+                               [job](const std::shared_ptr<xts_job_t>& j) { return j.get() == job; });
+        if (it != jobs.end()) {
+            jobs.erase(it);
+        }
+    }
+    void worker_thread() {
+        for (;;) {
+            std::shared_ptr<xts_job_t> job;
+            {
+                std::unique_lock lock{mutex};
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = jobs.front();
+            }
+            while (xts_run_chunk(job.get())) {
+            }
+            remove(job.get());
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<xts_job_t>> jobs;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+};
+
+static xts_worker_pool* xts_get_pool(void) {
+    // One worker per host CPU besides the caller
+    static xts_worker_pool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return &pool;
+}
+
+void layra_xts_decrypt_sectors_parallel(const layra_xts_key_t* key, uint64_t first_sector,
+                                        uint32_t count, uint8_t* data) {
+    xts_worker_pool* pool = count >= XTS_PARALLEL_MIN_SECTORS ? xts_get_pool() : NULL;
+    if (!pool || !pool->has_workers()) {
+        layra_xts_decrypt_sectors(key, first_sector, count, data);
+        return;
+    }
+    auto job = std::make_shared<xts_job_t>();
+    job->key = key;
+    job->first_sector = first_sector;
+    job->count = count;
+    job->data = data;
+    pool->run(job);
+}
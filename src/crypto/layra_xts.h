@@ -0,0 +1,30 @@
+#ifndef LAYRA_XTS_H
+#define LAYRA_XTS_H
+#include <stdint.h>
+
+// XTS-AES-128 as used for PKG/PFS images: one tweak per 0x1000-byte sector
+#define LAYRA_XTS_SECTOR_SIZE 0x1000
+#define LAYRA_XTS_KEY_SIZE 16
+#define LAYRA_AES_ROUND_KEYS 11
+
+// Expanded data and tweak keys, shared read-only by every kernel
+typedef struct {
+    // Encryption schedule of the data key, and the equivalent inverse cipher schedule
+    uint8_t data_enc[LAYRA_AES_ROUND_KEYS][16];
+    uint8_t data_dec[LAYRA_AES_ROUND_KEYS][16];
+    // Encryption schedule of the tweak key
+    uint8_t tweak_enc[LAYRA_AES_ROUND_KEYS][16];
+} layra_xts_key_t;
+
+void layra_xts_init_key(layra_xts_key_t* key, const uint8_t data_key[LAYRA_XTS_KEY_SIZE],
+                        const uint8_t tweak_key[LAYRA_XTS_KEY_SIZE]);
+// Decrypt consecutive sectors in place on the calling thread, numbered from first_sector
+void layra_xts_decrypt_sectors(const layra_xts_key_t* key, uint64_t first_sector,
+                               uint32_t count, uint8_t* data);
+// Same, spread across the crypto worker pool when there is enough work
+void layra_xts_decrypt_sectors_parallel(const layra_xts_key_t* key, uint64_t first_sector,
+                                        uint32_t count, uint8_t* data);
+// Kernel picked for this host: "vaes", "aesni" or "scalar"
+const char* layra_xts_get_kernel_name(void);
+
+#endif // LAYRA_XTS_H
@@ -0,0 +1,108 @@
+#include "xts_kernels.h"
+#if defined(LAYRA_XTS_HAVE_X86_KERNELS)
+#include <immintrin.h>
+
+// Kernels are compiled for their instruction sets here and only called after the
+// CPUID check in layra_xts.cpp, so the rest of the build needs no extra flags
+#if defined(_MSC_VER) && !defined(__clang__)
+#define XTS_TARGET_AESNI
+#define XTS_TARGET_VAES
+#else
+#define XTS_TARGET_AESNI __attribute__((target("aes,sse4.1")))
+#define XTS_TARGET_VAES __attribute__((target("aes,sse4.1,avx2,vaes")))
+#endif
+
+// Blocks decrypted together to hide AESDEC latency
+#define XTS_AESNI_LANES 8
+#define XTS_VAES_PAIRS 8
+#define XTS_BLOCKS_PER_SECTOR (LAYRA_XTS_SECTOR_SIZE / 16)
+
+// Tweak times x in GF(2^128): shift every dword left and carry the top bits into the
+// next dword, the bit leaving the top of the block folds back in as 0x87
+XTS_TARGET_AESNI static inline __m128i xts_mul_alpha(__m128i tweak) {
+    __m128i carry = _mm_srai_epi32(tweak, 31);
+    carry = _mm_and_si128(carry, _mm_set_epi32(0x87, 1, 1, 1));
+    carry = _mm_shuffle_epi32(carry, 0x93);
+    return _mm_xor_si128(_mm_slli_epi32(tweak, 1), carry);
+}
+
+XTS_TARGET_AESNI static inline __m128i xts_sector_tweak(const __m128i* tweak_keys,
+                                                        uint64_t sector) {
+    __m128i tweak = _mm_xor_si128(_mm_set_epi64x(0, (long long)sector), tweak_keys[0]);
+    for (int round = 1; round < LAYRA_AES_ROUND_KEYS - 1; round++) {
+        tweak = _mm_aesenc_si128(tweak, tweak_keys[round]);
+    }
+    return _mm_aesenclast_si128(tweak, tweak_keys[LAYRA_AES_ROUND_KEYS - 1]);
+}
+
+XTS_TARGET_AESNI void xts_decrypt_aesni(const layra_xts_key_t* key, uint64_t first_sector,
+                                        uint32_t count, uint8_t* data) {
+    __m128i dec_keys[LAYRA_AES_ROUND_KEYS];
+    __m128i tweak_keys[LAYRA_AES_ROUND_KEYS];
+    for (int round = 0; round < LAYRA_AES_ROUND_KEYS; round++) {
+        dec_keys[round] = _mm_loadu_si128((const __m128i*)key->data_dec[round]);
+        tweak_keys[round] = _mm_loadu_si128((const __m128i*)key->tweak_enc[round]);
+    }
+    for (uint32_t s = 0; s < count; s++) {
+        __m128i tweak = xts_sector_tweak(tweak_keys, first_sector + s);
+        __m128i* blocks = (__m128i*)(data + (size_t)s * LAYRA_XTS_SECTOR_SIZE);
+        for (int b = 0; b < XTS_BLOCKS_PER_SECTOR; b += XTS_AESNI_LANES) {
+            __m128i tweaks[XTS_AESNI_LANES];
+            __m128i state[XTS_AESNI_LANES];
+            for (int i = 0; i < XTS_AESNI_LANES; i++) {
+                tweaks[i] = tweak;
+                tweak = xts_mul_alpha(tweak);
+                state[i] = _mm_xor_si128(_mm_loadu_si128(blocks + b + i), tweaks[i]);
+                state[i] = _mm_xor_si128(state[i], dec_keys[0]);
+            }
+            for (int round = 1; round < LAYRA_AES_ROUND_KEYS - 1; round++) {
+                for (int i = 0; i < XTS_AESNI_LANES; i++) {
+                    state[i] = _mm_aesdec_si128(state[i], dec_keys[round]);
+                }
+            }
+            for (int i = 0; i < XTS_AESNI_LANES; i++) {
+                state[i] = _mm_aesdeclast_si128(state[i], dec_keys[LAYRA_AES_ROUND_KEYS - 1]);
+                _mm_storeu_si128(blocks + b + i, _mm_xor_si128(state[i], tweaks[i]));
+            }
+        }
+    }
+}
+
+XTS_TARGET_VAES void xts_decrypt_vaes(const layra_xts_key_t* key, uint64_t first_sector,
+                                      uint32_t count, uint8_t* data) {
+    // Each 256-bit register holds two consecutive blocks
+    __m256i dec_keys[LAYRA_AES_ROUND_KEYS];
+    __m128i tweak_keys[LAYRA_AES_ROUND_KEYS];
+    for (int round = 0; round < LAYRA_AES_ROUND_KEYS; round++) {
+        dec_keys[round] =
+            _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)key->data_dec[round]));
+        tweak_keys[round] = _mm_loadu_si128((const __m128i*)key->tweak_enc[round]);
+    }
+    for (uint32_t s = 0; s < count; s++) {
+        __m128i tweak = xts_sector_tweak(tweak_keys, first_sector + s);
+        __m256i* blocks = (__m256i*)(data + (size_t)s * LAYRA_XTS_SECTOR_SIZE);
+        for (int b = 0; b < XTS_BLOCKS_PER_SECTOR / 2; b += XTS_VAES_PAIRS) {
+            __m256i tweaks[XTS_VAES_PAIRS];
+            __m256i state[XTS_VAES_PAIRS];
+            for (int i = 0; i < XTS_VAES_PAIRS; i++) {
+                __m128i low = tweak;
+                __m128i high = xts_mul_alpha(low);
+                tweak = xts_mul_alpha(high);
+                tweaks[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+                state[i] = _mm256_xor_si256(_mm256_loadu_si256(blocks + b + i), tweaks[i]);
+                state[i] = _mm256_xor_si256(state[i], dec_keys[0]);
+            }
+            for (int round = 1; round < LAYRA_AES_ROUND_KEYS - 1; round++) {
+                for (int i = 0; i < XTS_VAES_PAIRS; i++) {
+                    state[i] = _mm256_aesdec_epi128(state[i], dec_keys[round]);
+                }
+            }
+            for (int i = 0; i < XTS_VAES_PAIRS; i++) {
+                state[i] = _mm256_aesdeclast_epi128(state[i], dec_keys[LAYRA_AES_ROUND_KEYS - 1]);
+                _mm256_storeu_si256(blocks + b + i, _mm256_xor_si256(state[i], tweaks[i]));
+            }
+        }
+    }
+}
+
+#endif
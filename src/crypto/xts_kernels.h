@@ -0,0 +1,19 @@
+#ifndef XTS_KERNELS_H
+#define XTS_KERNELS_H
+#include "layra_xts.h"
+
+// Decrypt count sectors in place, each kernel handles whole sectors
+typedef void (*xts_kernel_t)(const layra_xts_key_t* key, uint64_t first_sector, uint32_t count,
+                             uint8_t* data);
+
+void xts_decrypt_scalar(const layra_xts_key_t* key, uint64_t first_sector, uint32_t count,
+                        uint8_t* data);
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LAYRA_XTS_HAVE_X86_KERNELS 1
+void xts_decrypt_aesni(const layra_xts_key_t* key, uint64_t first_sector, uint32_t count,
+                       uint8_t* data);
+void xts_decrypt_vaes(const layra_xts_key_t* key, uint64_t first_sector, uint32_t count,
+                      uint8_t* data);
+#endif
+
+#endif // XTS_KERNELS_H
@@ -0,0 +1,74 @@
+#ifndef GPU_COMMAND_RING_H
+#define GPU_COMMAND_RING_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Entries in the submission ring (power of two)
+constexpr uint32_t GPU_COMMAND_RING_SIZE = 0x400;
+
+enum class GPUCommandType : uint32_t {
+    // Execute a guest command buffer
+    CommandBuffer,
+    // Write a fence value to guest memory once everything before it is done
+    WriteFence,
+    // Present the current render target
+    Flip,
+};
+
+// One submission from the guest to the command processor
+struct GPUCommand {
+    GPUCommandType type;
+    // Guest address and size of the command buffer, or the fence destination
+    uint64_t address;
+    uint64_t size;
+    // Guest value stored by WriteFence
+    uint64_t value;
+    // Host fence signalled once the command has been processed
+    uint64_t fence;
+};
+
+// Lock-free ring between one submitting thread and the command processor thread
+class GPUCommandRing {
+public:
+    // Producer side, false if the ring is full
+    bool tryPush(const GPUCommand& command) {
+        uint32_t tail = write_index.load(std::memory_order_relaxed);
+        if (tail - cached_read_index == GPU_COMMAND_RING_SIZE) {
+            // Only reload the consumer's index when the cached one says we are full
+            cached_read_index = read_index.load(std::memory_order_acquire);
+            if (tail - cached_read_index == GPU_COMMAND_RING_SIZE) {
+                return false;
+            }
+        }
+        entries[tail & (GPU_COMMAND_RING_SIZE - 1)] = command;
+        write_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    // Consumer side, false if the ring is empty
+    bool tryPop(GPUCommand* command) {
+        uint32_t head = read_index.load(std::memory_order_relaxed);
+        if (head == cached_write_index) {
+            cached_write_index = write_index.load(std::memory_order_acquire);
+            if (head == cached_write_index) {
+                return false;
+            }
+        }
+        *command = entries[head & (GPU_COMMAND_RING_SIZE - 1)];
+        read_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    bool empty() const {
+        return read_index.load(std::memory_order_acquire) ==
+               write_index.load(std::memory_order_acquire);
+    }
+private:
+    // Producer and consumer state live on separate cache lines
+    alignas(64) std::atomic<uint32_t> write_index{0};
+    uint32_t cached_read_index = 0;
+    alignas(64) std::atomic<uint32_t> read_index{0};
+    uint32_t cached_write_index = 0;
+    alignas(64) GPUCommand entries[GPU_COMMAND_RING_SIZE];
+};
+
+#endif  // GPU_COMMAND_RING_H
@@ -1,8 +1,23 @@
-#include "gpu_emulator.h"
-void GPUEmulator::init() {
+#include <cstring>
+#include "gpuemulator.h"
+#include "memorymanager.h"
+
+GPUEmulator::~GPUEmulator() {
+    stop();
+    delete gpu_state;
+}
+
+void GPUEmulator::init(MemoryManager* memory_manager) {
     // Initialize the GPU emulator
+    stop();
+    memory = memory_manager;
+    delete gpu_state;
     gpu_state = new GPUState();
     gpu_state->render_target = 0x10000000;
+    gpu_state->frame_count = 0;
+    // Stored shaders load in the background while the guest boots
+    shader_cache.init(SHADER_CACHE_DIRECTORY);
+    shader_cache.startPreload();
 }
 
 void GPUEmulator::renderFrame() {
@@ -12,5 +27,173 @@ void GPUEmulator::renderFrame() {
 
 void GPUEmulator::update() {
     // Update the GPU emulator
-    renderFrame();
+    // With the processor thread running, rendering no longer happens here
+    if (running) {
+        return;
+    }
+    processCommands();
+}
+
+void GPUEmulator::start() {
+    if (running.exchange(true)) {
+        return;
+    }
+    thread = std::thread(&GPUEmulator::commandProcessorThread, this);
+}
+
+void GPUEmulator::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::scoped_lock lock{wake_mutex};
+        wake_cv.notify_one();
+    }
+    thread.join();
+    // Fence waiters fall back to draining the ring themselves
+    std::scoped_lock lock{fence_mutex};
+    fence_cv.notify_all();
+}
+
+bool GPUEmulator::isRunning() const {
+    return running;
+}
+
+uint64_t GPUEmulator::submitCommandBuffer(uint64_t address, uint64_t size) {
+    return submit(GPUCommandType::CommandBuffer, address, size, 0);
+}
+
+uint64_t GPUEmulator::submitFence(uint64_t address, uint64_t value) {
+    return submit(GPUCommandType::WriteFence, address, sizeof(value), value);
+}
+
+uint64_t GPUEmulator::submitFlip() {
+    return submit(GPUCommandType::Flip, 0, 0, 0);
+}
+
+uint64_t GPUEmulator::submit(GPUCommandType type, uint64_t address, uint64_t size,
+                             uint64_t value) {
+    GPUCommand command{type, address, size, value, next_fence++};
+    while (!ring.tryPush(command)) {
+        // Full ring: wait for the processor, or make room ourselves when it is stopped
+        if (running.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        } else {
+            processCommands();
+        }
+    }
+    // Pairs with the fence in commandProcessorThread so a wakeup is never lost
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        std::scoped_lock lock{wake_mutex};
+        wake_cv.notify_one();
+    }
+    return command.fence;
+}
+
+uint64_t GPUEmulator::getCompletedFence() const {
+    return completed_fence.load(std::memory_order_acquire);
+}
+
+void GPUEmulator::waitForFence(uint64_t fence) {
+    while (completed_fence.load(std::memory_order_acquire) < fence) {
+        if (!running.load(std::memory_order_acquire)) {
+            if (!processCommands()) {
+                // Nothing left that could complete it
+                return;
+            }
+            continue;
+        }
+        std::unique_lock lock{fence_mutex};
+        fence_waiters.fetch_add(1);
+        fence_cv.wait(lock, [this, fence] {
+            return completed_fence.load() >= fence || !running.load(std::memory_order_acquire);
+        });
+        fence_waiters.fetch_sub(1);
+    }
+}
+
+void GPUEmulator::setFenceCallback(GPUFenceCallback callback) {
+    fence_callback = std::move(callback);
+}
+
+ShaderCache* GPUEmulator::getShaderCache() {
+    return &shader_cache;
+}
+
+bool GPUEmulator::processCommands() {
+    // The ring has a single consumer, which is the processor thread or, while it is
+    // stopped, whichever of update(), submit() and waitForFence() gets here first
+    std::scoped_lock lock{consume_mutex};
+    bool processed = false;
+    GPUCommand command;
+    while (ring.tryPop(&command)) {
+        executeCommand(command);
+        completed_fence.store(command.fence);
+        if (fence_waiters.load()) {
+            std::scoped_lock lock{fence_mutex};
+            fence_cv.notify_all();
+        }
+        if (fence_callback) {
+            fence_callback(command.fence);
+        }
+        processed = true;
+    }
+    return processed;
+}
+
+void GPUEmulator::executeCommand(const GPUCommand& command) {
+    switch (command.type) {
+        case GPUCommandType::CommandBuffer:
+            executeCommandBuffer(command.address, command.size);
+            break;
+        case GPUCommandType::WriteFence:
+            // Goes through the slow path so write watchers see the guest update
+            memory->writeMemory(command.address, &command.value, sizeof(command.value));
+            break;
+        case GPUCommandType::Flip:
+            renderFrame();
+            gpu_state->frame_count++;
+            break;
+    }
+}
+
+void GPUEmulator::executeCommandBuffer(uint64_t address, uint64_t size) {
+    const uint8_t* data = memory->getHostPointer(address, size, PAGE_READ);
+    if (!data) {
+        return;
+    }
+    // Walk the PM4 packets: header type[31:30] count[29:16] opcode[15:8]
+    uint64_t dword_count = size / sizeof(uint32_t);
+    for (uint64_t i = 0; i < dword_count;) {
+        uint32_t header;
+        std::memcpy(&header, data + i * sizeof(uint32_t), sizeof(header));
+        uint32_t type = header >> 30;
+        if (type == 2) {
+            // Filler
+            i++;
+            continue;
+        }
+        if (type != 0 && type != 3) {
+            // Malformed buffer, drop the rest
+            break;
+        }
+        // Packet execution comes with the renderer, skip the body for now
+        i += ((header >> 16) & 0x3FFF) + 2;
+    }
+}
+
+void GPUEmulator::commandProcessorThread() {
+    while (running.load(std::memory_order_acquire)) {
+        if (processCommands()) {
+            continue;
+        }
+        std::unique_lock lock{wake_mutex};
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wake_cv.wait(lock, [this] {
+            return !ring.empty() || !running.load(std::memory_order_acquire);
+        });
+        sleeping.store(false, std::memory_order_relaxed);
+    }
 }
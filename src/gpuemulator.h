@@ -1,12 +1,76 @@
 #ifndef GPU_EMULATOR_H
 #define GPU_EMULATOR_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "gpucommandring.h"
+#include "shadercache.h"
+
+class MemoryManager;
+
+// Called on the command processor thread with each completed host fence
+typedef std::function<void(uint64_t fence)> GPUFenceCallback;
+
+// GPU state owned by the command processor
+struct GPUState {
+    uint64_t render_target;
+    uint64_t frame_count;
+};
+
 class GPUEmulator {
 public:
-    void init();
+    ~GPUEmulator();
+    void init(MemoryManager* memory_manager);
     void renderFrame();
+    // Process queued commands from the calling thread (used while the thread is stopped)
     void update();
+    // Run the command processor on its own host thread
+    void start();
+    void stop();
+    bool isRunning() const;
+    // Queue work for the command processor. Only one thread may submit.
+    // Each returns the host fence that completes once the command has run.
+    uint64_t submitCommandBuffer(uint64_t address, uint64_t size);
+    // Store a 64-bit value at a guest address after all earlier work
+    uint64_t submitFence(uint64_t address, uint64_t value);
+    uint64_t submitFlip();
+    uint64_t getCompletedFence() const;
+    // Block until a host fence has completed
+    void waitForFence(uint64_t fence);
+    // Set before start(), e.g. to raise CPU_EVENT_GPU_SYNC on the waiting core
+    void setFenceCallback(GPUFenceCallback callback);
+    ShaderCache* getShaderCache();
 private:
-    GPUState* gpu_state;
+    uint64_t submit(GPUCommandType type, uint64_t address, uint64_t size, uint64_t value);
+    // Run every queued command, false if there was none
+    bool processCommands();
+    void executeCommand(const GPUCommand& command);
+    void executeCommandBuffer(uint64_t address, uint64_t size);
+    void commandProcessorThread();
+
+    GPUState* gpu_state = nullptr;
+    MemoryManager* memory = nullptr;
+    GPUCommandRing ring;
+    // Serializes draining the ring, which several threads do while the processor is stopped
+    std::mutex consume_mutex;
+    ShaderCache shader_cache;
+    // Only touched by the submitting thread
+    uint64_t next_fence = 1;
+    std::atomic<uint64_t> completed_fence{0};
+    GPUFenceCallback fence_callback;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    // The processor sleeps here while the ring is empty
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::atomic<bool> sleeping{false};
+    // Threads in waitForFence sleep here
+    std::mutex fence_mutex;
+    std::condition_variable fence_cv;
+    std::atomic<uint32_t> fence_waiters{0};
 };
 
 #endif  // GPU_EMULATOR_H
@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <set>
+#include "guestheap.h"
+#include "memorymanager.h"
+
+static const uint32_t g_class_sizes[HEAP_SIZE_CLASS_COUNT] = {
+    16,    32,    48,    64,    80,    96,    112,   128,   160,   192,
+    224,   256,   320,   384,   448,   512,   640,   768,   896,   1024,
+    1280,  1536,  1792,  2048,  2560,  3072,  3584,  4096,  5120,  6144,
+    7168,  8192,  10240, 12288, 14336, 16384, 20480, 24576, 28672, 32768,
+};
+
+// Size class for every 16-byte step up to HEAP_MAX_SMALL_SIZE
+static const std::array<uint8_t, HEAP_MAX_SMALL_SIZE / 16 + 1> g_class_lookup = [] {
+    std::array<uint8_t, HEAP_MAX_SMALL_SIZE / 16 + 1> lookup{};
+    uint8_t size_class = 0;
+    for (size_t i = 0; i < lookup.size(); i++) {
+        while (g_class_sizes[size_class] < i * 16) {
+            size_class++;
+        }
+        lookup[i] = size_class;
+    }
+    return lookup;
+}();
+
+static uint32_t getSizeClass(uint64_t size) {
+    return g_class_lookup[(size + 15) / 16];
+}
+
+// Objects moved between a thread cache and the central list at once
+static uint32_t getBatchSize(uint32_t size_class) {
+    return std::clamp<uint32_t>(HEAP_SPAN_SIZE / g_class_sizes[size_class] / 4, 1, 32);
+}
+
+// Heaps that thread caches may still hand objects back to
+static std::mutex g_live_heaps_mutex;
+static std::set<uint64_t> g_live_heaps;
+static uint64_t g_next_heap_id = 1;
+
+struct GuestHeap::ThreadCache {
+    GuestHeap* owner = nullptr;
+    uint64_t owner_id = 0;
+    uint64_t heads[HEAP_SIZE_CLASS_COUNT] = {};
+    uint32_t counts[HEAP_SIZE_CLASS_COUNT] = {};
+
+    ~ThreadCache() {
+        flush();
+    }
+
+    // Return every cached object to the owning heap
+    void flush() {
+        if (owner) {
+            std::scoped_lock lock{g_live_heaps_mutex};
+            if (g_live_heaps.count(owner_id)) {
+                for (uint32_t i = 0; i < HEAP_SIZE_CLASS_COUNT; i++) {
+                    if (!heads[i]) {
+                        continue;
+                    }
+                    uint64_t tail = heads[i];
+                    while (uint64_t next = owner->loadNext(tail)) {
+                        tail = next;
+                    }
+                    owner->releaseBatch(i, heads[i], tail);
+                }
+            }
+        }
+        owner = nullptr;
+        std::fill(std::begin(heads), std::end(heads), 0);
+        std::fill(std::begin(counts), std::end(counts), 0);
+    }
+};
+
+static thread_local GuestHeap::ThreadCache t_heap_cache;
+
+GuestHeap::GuestHeap() {
+    std::scoped_lock lock{g_live_heaps_mutex};
+    id = g_next_heap_id++;
+    g_live_heaps.insert(id);
+}
+
+GuestHeap::~GuestHeap() {
+    std::scoped_lock lock{g_live_heaps_mutex};
+    g_live_heaps.erase(id);
+}
+
+bool GuestHeap::init(MemoryManager* memory_manager) {
+    // Initialize the guest heap
+    memory = memory_manager;
+    host_base = memory->getHostBase();
+    spans = std::make_unique<SpanInfo[]>(HEAP_SPAN_COUNT);
+    span_mapped = std::make_unique<bool[]>(HEAP_SPAN_COUNT);
+    for (uint64_t i = 0; i < HEAP_SPAN_COUNT; i++) {
+        spans[i] = SpanInfo{SPAN_FREE, 0};
+        span_mapped[i] = false;
+    }
+    free_by_length.clear();
+    free_by_start.clear();
+    free_by_length.emplace(HEAP_SPAN_COUNT, 0);
+    free_by_start.emplace(0, HEAP_SPAN_COUNT);
+    return true;
+}
+
+GuestHeap::ThreadCache* GuestHeap::getThreadCache() {
+    ThreadCache* cache = &t_heap_cache;
+    if (cache->owner != this || cache->owner_id != id) {
+        cache->flush();
+        cache->owner = this;
+        cache->owner_id = id;
+    }
+    return cache;
+}
+
+uint64_t GuestHeap::loadNext(uint64_t address) const {
+    uint64_t next;
+    std::memcpy(&next, host_base + address, sizeof(next));
+    return next;
+}
+
+void GuestHeap::storeNext(uint64_t address, uint64_t next) {
+    std::memcpy(host_base + address, &next, sizeof(next));
+}
+
+uint64_t GuestHeap::allocate(uint64_t size) {
+    // Allocate guest memory
+    if (!spans) {
+        return 0;
+    }
+    if (size <= HEAP_MAX_SMALL_SIZE) {
+        return allocateSmall(getSizeClass(size));
+    }
+    uint64_t count = (size + HEAP_SPAN_SIZE - 1) >> HEAP_SPAN_SHIFT;
+    uint64_t first = allocateSpans(count, SPAN_LARGE);
+    return first == UINT64_MAX ? 0 : GUEST_HEAP_BASE + (first << HEAP_SPAN_SHIFT);
+}
+
+void GuestHeap::free(uint64_t address) {
+    // Free guest memory
+    if (!spans || address < GUEST_HEAP_BASE || address - GUEST_HEAP_BASE >= GUEST_HEAP_SIZE) {
+        return;
+    }
+    uint64_t span = (address - GUEST_HEAP_BASE) >> HEAP_SPAN_SHIFT;
+    const SpanInfo& info = spans[span];
+    if (info.size_class < HEAP_SIZE_CLASS_COUNT) {
+        freeSmall(address, info.size_class);
+    } else if (info.size_class == SPAN_LARGE && !(address & (HEAP_SPAN_SIZE - 1))) {
+        freeSpans(span, info.length);
+    }
+}
+
+uint64_t GuestHeap::getAllocationSize(uint64_t address) const {
+    if (!spans || address < GUEST_HEAP_BASE || address - GUEST_HEAP_BASE >= GUEST_HEAP_SIZE) {
+        return 0;
+    }
+    const SpanInfo& info = spans[(address - GUEST_HEAP_BASE) >> HEAP_SPAN_SHIFT];
+    if (info.size_class < HEAP_SIZE_CLASS_COUNT) {
+        return g_class_sizes[info.size_class];
+    }
+    return info.size_class == SPAN_LARGE ? uint64_t(info.length) << HEAP_SPAN_SHIFT : 0;
+}
+
+uint64_t GuestHeap::allocateSmall(uint32_t size_class) {
+    // Fast path: pop from this thread's cache without locking
+    ThreadCache* cache = getThreadCache();
+    if (!cache->heads[size_class]) {
+        cache->counts[size_class] =
+            fetchBatch(size_class, getBatchSize(size_class), &cache->heads[size_class]);
+        if (!cache->heads[size_class]) {
+            return 0;
+        }
+    }
+    uint64_t address = cache->heads[size_class];
+    cache->heads[size_class] = loadNext(address);
+    cache->counts[size_class]--;
+    return address;
+}
+
+void GuestHeap::freeSmall(uint64_t address, uint32_t size_class) {
+    ThreadCache* cache = getThreadCache();
+    storeNext(address, cache->heads[size_class]);
+    cache->heads[size_class] = address;
+    if (++cache->counts[size_class] <= HEAP_THREAD_CACHE_LIMIT) {
+        return;
+    }
+
+    // Cache is full, hand a batch back to the central list
+    uint32_t batch = getBatchSize(size_class);
+    uint64_t head = cache->heads[size_class];
+    uint64_t tail = head;
+    for (uint32_t i = 1; i < batch; i++) {
+        tail = loadNext(tail);
+    }
+    cache->heads[size_class] = loadNext(tail);
+    cache->counts[size_class] -= batch;
+    storeNext(tail, 0);
+    releaseBatch(size_class, head, tail);
+}
+
+uint32_t GuestHeap::fetchBatch(uint32_t size_class, uint32_t count, uint64_t* head) {
+    CentralList& list = central[size_class];
+    std::scoped_lock lock{list.mutex};
+    if (!list.head && !carveSlab(size_class)) {
+        *head = 0;
+        return 0;
+    }
+    *head = list.head;
+    uint64_t tail = list.head;
+    uint32_t fetched = 1;
+    while (fetched < count) {
+        uint64_t next = loadNext(tail);
+        if (!next) {
+            break;
+        }
+        tail = next;
+        fetched++;
+    }
+    list.head = loadNext(tail);
+    storeNext(tail, 0);
+    return fetched;
+}
+
+void GuestHeap::releaseBatch(uint32_t size_class, uint64_t head, uint64_t tail) {
+    CentralList& list = central[size_class];
+    std::scoped_lock lock{list.mutex};
+    storeNext(tail, list.head);
+    list.head = head;
+}
+
+bool GuestHeap::carveSlab(uint32_t size_class) {
+    // Called with the central list locked and empty
+    uint64_t span = allocateSpans(1, static_cast<uint8_t>(size_class));
+    if (span == UINT64_MAX) {
+        return false;
+    }
+    uint64_t base = GUEST_HEAP_BASE + (span << HEAP_SPAN_SHIFT);
+    uint32_t size = g_class_sizes[size_class];
+    uint64_t objects = HEAP_SPAN_SIZE / size;
+    for (uint64_t i = 0; i < objects; i++) {
+        uint64_t address = base + i * size;
+        storeNext(address, i + 1 < objects ? address + size : 0);
+    }
+    central[size_class].head = base;
+    return true;
+}
+
+uint64_t GuestHeap::allocateSpans(uint64_t count, uint8_t owner) {
+    std::scoped_lock lock{span_mutex};
+    // Best fit: the shortest free run that is long enough
+    auto it = free_by_length.lower_bound(count);
+    if (it == free_by_length.end()) {
+        return UINT64_MAX;
+    }
+    uint64_t length = it->first;
+    uint64_t first = it->second;
+
+    // Map spans the first time they are used, they stay mapped for reuse. The free run
+    // is only split once that worked, a failure leaves the index as it was.
+    uint64_t run_start = first;
+    for (uint64_t span = first; span <= first + count; span++) {
+        bool needs_map = span < first + count && !span_mapped[span];
+        if (needs_map) {
+            span_mapped[span] = true;
+            continue;
+        }
+        if (span > run_start) {
+            if (!memory->mapMemory(GUEST_HEAP_BASE + (run_start << HEAP_SPAN_SHIFT),
+                                   (span - run_start) << HEAP_SPAN_SHIFT,
+                                   PAGE_READ | PAGE_WRITE)) {
+                for (uint64_t i = run_start; i < span; i++) {
+                    span_mapped[i] = false;
+                }
+                return UINT64_MAX;
+            }
+        }
+        run_start = span + 1;
+    }
+
+    free_by_length.erase(it);
+    free_by_start.erase(first);
+    if (length > count) {
+        free_by_length.emplace(length - count, first + count);
+        free_by_start.emplace(first + count, length - count);
+    }
+
+    spans[first] = SpanInfo{owner, static_cast<uint32_t>(count)};
+    return first;
+}
+
+void GuestHeap::freeSpans(uint64_t first, uint64_t count) {
+    std::scoped_lock lock{span_mutex};
+    spans[first] = SpanInfo{SPAN_FREE, 0};
+
+    auto removeRun = [this](std::map<uint64_t, uint64_t>::iterator run) {
+        auto range = free_by_length.equal_range(run->second);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == run->first) {
+                free_by_length.erase(it);
+                break;
+            }
+        }
+        return free_by_start.erase(run);
+    };
+
+    // Coalesce with the free runs on either side
+    auto next = free_by_start.find(first + count);
+    if (next != free_by_start.end()) {
+        count += next->second;
+        removeRun(next);
+    }
+    auto prev = free_by_start.lower_bound(first);
+    if (prev != free_by_start.begin()) {
+        --prev;
+        if (prev->first + prev->second == first) {
+            first = prev->first;
+            count += prev->second;
+            removeRun(prev);
+        }
+    }
+    free_by_length.emplace(count, first);
+    free_by_start.emplace(first, count);
+}
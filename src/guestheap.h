@@ -0,0 +1,79 @@
+#ifndef GUEST_HEAP_H
+#define GUEST_HEAP_H
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+
+class MemoryManager;
+
+// Guest range reserved for heap allocations
+constexpr uint64_t GUEST_HEAP_BASE = 0x100000000;
+constexpr uint64_t GUEST_HEAP_SIZE = 0x400000000;
+// Heap memory is handed out in spans; slabs are one span, large blocks several
+constexpr uint64_t HEAP_SPAN_SHIFT = 16;
+constexpr uint64_t HEAP_SPAN_SIZE = 1ull << HEAP_SPAN_SHIFT;
+constexpr uint64_t HEAP_SPAN_COUNT = GUEST_HEAP_SIZE >> HEAP_SPAN_SHIFT;
+// Requests up to this size are served from size-class slabs
+constexpr uint64_t HEAP_MAX_SMALL_SIZE = 0x8000;
+constexpr uint32_t HEAP_SIZE_CLASS_COUNT = 40;
+// Most objects a thread cache keeps per size class before giving some back
+constexpr uint32_t HEAP_THREAD_CACHE_LIMIT = 64;
+
+// Guest heap allocator: size-class slabs with per-thread caches for small
+// requests, best-fit span allocation for large ones
+class GuestHeap {
+public:
+    GuestHeap();
+    ~GuestHeap();
+    bool init(MemoryManager* memory_manager);
+    // Returns a guest address, 0 when the heap is exhausted
+    uint64_t allocate(uint64_t size);
+    void free(uint64_t address);
+    // Usable size of an allocation
+    uint64_t getAllocationSize(uint64_t address) const;
+
+    struct ThreadCache;
+private:
+    // Owner tags of spans that do not hold a size-class slab
+    static constexpr uint8_t SPAN_FREE = 0xFF;
+    static constexpr uint8_t SPAN_LARGE = 0xFE;
+
+    struct SpanInfo {
+        uint8_t size_class;
+        uint32_t length;
+    };
+
+    // Shared free list of one size class
+    struct CentralList {
+        std::mutex mutex;
+        uint64_t head = 0;
+    };
+
+    uint64_t allocateSmall(uint32_t size_class);
+    void freeSmall(uint64_t address, uint32_t size_class);
+    // Move up to count objects from the central list into a thread cache list
+    uint32_t fetchBatch(uint32_t size_class, uint32_t count, uint64_t* head);
+    void releaseBatch(uint32_t size_class, uint64_t head, uint64_t tail);
+    bool carveSlab(uint32_t size_class);
+    uint64_t allocateSpans(uint64_t count, uint8_t owner);
+    void freeSpans(uint64_t first, uint64_t count);
+    ThreadCache* getThreadCache();
+
+    uint64_t loadNext(uint64_t address) const;
+    void storeNext(uint64_t address, uint64_t next);
+
+    MemoryManager* memory = nullptr;
+    uint8_t* host_base = nullptr;
+    uint64_t id = 0;
+    std::unique_ptr<SpanInfo[]> spans;
+    std::unique_ptr<bool[]> span_mapped;
+    CentralList central[HEAP_SIZE_CLASS_COUNT];
+
+    // Best-fit index of free span runs, keyed by length and by start for coalescing
+    std::mutex span_mutex;
+    std::multimap<uint64_t, uint64_t> free_by_length;
+    std::map<uint64_t, uint64_t> free_by_start;
+};
+
+#endif  // GUEST_HEAP_H
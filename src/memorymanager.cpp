@@ -1,17 +1,647 @@
-#include "memory_manager.h"
+#include <cstring>
+#include "memorymanager.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <sys/mman.h>
+#endif
+
+// The fault handler updates these, which is only signal safe without locks
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+// Memory manager whose reservation the fault handler serves
+static MemoryManager* g_fastmem_owner = nullptr;
+static thread_local FastmemRecovery* t_fastmem_recovery = nullptr;
+
+#ifdef _WIN32
+static LONG CALLBACK fastmemExceptionHandler(PEXCEPTION_POINTERS info) {
+    if (info->ExceptionRecord->ExceptionCode != EXCEPTION_ACCESS_VIOLATION || !g_fastmem_owner) {
+        return EXCEPTION_CONTINUE_SEARCH;
+    }
+    void* address = reinterpret_cast<void*>(info->ExceptionRecord->ExceptionInformation[1]);
+    if (g_fastmem_owner->handleFault(address)) {
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+    // Unfixable faults reach the __except filter around the core's run loop
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+#else
+static struct sigaction g_old_segv_action;
+static struct sigaction g_old_bus_action;
+
+static void fastmemSignalHandler(int sig, siginfo_t* info, void* context) {
+    MemoryManager* owner = g_fastmem_owner;
+    if (owner && owner->isFastmemAddress(info->si_addr)) {
+        if (owner->handleFault(info->si_addr)) {
+            return;
+        }
+        if (FastmemRecovery* recovery = MemoryManager::getFastmemRecovery()) {
+            recovery->fault_address =
+                static_cast<uint8_t*>(info->si_addr) - owner->getFastmemBase();
+            siglongjmp(recovery->env, 1);
+        }
+    }
+
+    // Not a fault we can handle, pass it on to the previous handler
+    struct sigaction* old_action = sig == SIGBUS ? &g_old_bus_action : &g_old_segv_action;
+    if (old_action->sa_flags & SA_SIGINFO) {
+        old_action->sa_sigaction(sig, info, context);
+    } else if (old_action->sa_handler == SIG_DFL || old_action->sa_handler == SIG_IGN) {
+        // Restore it and let the faulting access trap again
+        sigaction(sig, old_action, nullptr);
+    } else {
+        old_action->sa_handler(sig);
+    }
+}
+#endif
+
+MemoryManager::~MemoryManager() {
+    if (g_fastmem_owner == this) {
+        g_fastmem_owner = nullptr;
+    }
+    if (page_directory) {
+        for (uint64_t i = 0; i < PAGE_CHUNK_COUNT; i++) {
+            delete[] page_directory[i].load(std::memory_order_relaxed);
+        }
+    }
+    if (host_base) {
+#ifdef _WIN32
+        VirtualFree(host_base, 0, MEM_RELEASE);
+#else
+        munmap(host_base, GUEST_ADDRESS_SPACE_SIZE + FASTMEM_GUARD_SIZE);
+#endif
+    }
+}
+
 void MemoryManager::init() {
     // Initialize the memory manager
-    memory = new uint8_t[0x10000000];
+    // Reserve the whole guest address space without committing any of it
+#ifdef _WIN32
+    host_base = static_cast<uint8_t*>(VirtualAlloc(
+        nullptr, GUEST_ADDRESS_SPACE_SIZE + FASTMEM_GUARD_SIZE, MEM_RESERVE, PAGE_NOACCESS));
+#else
+    void* base = mmap(nullptr, GUEST_ADDRESS_SPACE_SIZE + FASTMEM_GUARD_SIZE, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    host_base = base == MAP_FAILED ? nullptr : static_cast<uint8_t*>(base);
+#endif
+    if (!host_base) {
+        return;
+    }
+    page_directory = std::make_unique<std::atomic<PageEntry*>[]>(PAGE_CHUNK_COUNT);
+    for (uint64_t i = 0; i < PAGE_CHUNK_COUNT; i++) {
+        page_directory[i].store(nullptr, std::memory_order_relaxed);
+    }
+    pending_chunks = std::make_unique<std::atomic<uint64_t>[]>(PAGE_CHUNK_COUNT / 64);
+    for (uint64_t i = 0; i < PAGE_CHUNK_COUNT / 64; i++) {
+        pending_chunks[i].store(0, std::memory_order_relaxed);
+    }
+    installFaultHandler();
+
+    mapMemory(GUEST_MEMORY_BASE, GUEST_MEMORY_SIZE, PAGE_READ | PAGE_WRITE | PAGE_EXECUTE);
+    heap.init(this);
+}
+
+void MemoryManager::installFaultHandler() {
+    g_fastmem_owner = this;
+    static bool installed = false;
+    if (installed) {
+        fastmem_enabled = true;
+        return;
+    }
+    installed = true;
+#ifdef _WIN32
+    AddVectoredExceptionHandler(1, fastmemExceptionHandler);
+#ifdef _MSC_VER
+    // Escaping from unfixable faults relies on SEH in the core run loop
+    fastmem_enabled = true;
+#endif
+#else
+    struct sigaction action = {};
+    action.sa_sigaction = fastmemSignalHandler;
+    // SA_NODEFER keeps the signal unblocked after siglongjmp leaves the handler
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &g_old_segv_action);
+    sigaction(SIGBUS, &action, &g_old_bus_action);
+    fastmem_enabled = true;
+#endif
 }
 
-void MemoryManager::allocateMemory(uint32_t size) {
+uint8_t* MemoryManager::allocateMemory(uint32_t size) {
     // Allocate memory
-    uint8_t* ptr = memory;
-    ptr += size;
-    return ptr;
+    uint64_t address = heap.allocate(size);
+    return address ? host_base + address : nullptr;
+}
+
+void MemoryManager::freeMemory(uint8_t* ptr) {
+    if (ptr && host_base) {
+        heap.free(ptr - host_base);
+    }
+}
+
+uint64_t MemoryManager::allocateGuestMemory(uint64_t size) {
+    return heap.allocate(size);
+}
+
+void MemoryManager::freeGuestMemory(uint64_t address) {
+    heap.free(address);
+}
+
+MemoryManager::PageEntry* MemoryManager::getPageEntry(uint64_t page, bool create) {
+    std::atomic<PageEntry*>& slot = page_directory[page / PAGES_PER_CHUNK];
+    PageEntry* chunk = slot.load(std::memory_order_acquire);
+    if (!chunk && create) {
+        // Chunks are only created under map_mutex and live until shutdown
+        chunk = new PageEntry[PAGES_PER_CHUNK];
+        for (uint64_t i = 0; i < PAGES_PER_CHUNK; i++) {
+            chunk[i].store(0, std::memory_order_relaxed);
+        }
+        slot.store(chunk, std::memory_order_release);
+    }
+    return chunk ? &chunk[page % PAGES_PER_CHUNK] : nullptr;
+}
+
+bool MemoryManager::applyHostProtection(uint64_t address, uint64_t size, uint8_t protection,
+                                        bool write_watched) {
+    // Execute access is only tracked in the page table, guest code is never run natively.
+    // Watched pages stay read-only so fastmem writes to them fault into handleFault.
+    bool accessible = (protection & PAGE_MAPPED) && !(protection & PAGE_MMIO);
+    bool writable = accessible && (protection & PAGE_WRITE) && !write_watched;
+    bool readable = accessible && (protection & (PAGE_READ | PAGE_WRITE | PAGE_EXECUTE));
+#ifdef _WIN32
+    DWORD host_protection = PAGE_NOACCESS;
+    if (writable) {
+        host_protection = PAGE_READWRITE;
+    } else if (readable) {
+        host_protection = PAGE_READONLY;
+    }
+    if (protection & PAGE_MAPPED) {
+        // Committed pages are only backed by physical memory once touched
+        if (!VirtualAlloc(host_base + address, size, MEM_COMMIT, host_protection)) {
+            return false;
+        }
+        DWORD old_protection;
+        return VirtualProtect(host_base + address, size, host_protection, &old_protection);
+    }
+    return VirtualFree(host_base + address, size, MEM_DECOMMIT);
+#else
+    int host_protection = PROT_NONE;
+    if (writable) {
+        host_protection = PROT_READ | PROT_WRITE;
+    } else if (readable) {
+        host_protection = PROT_READ;
+    }
+    if (!(protection & PAGE_MAPPED)) {
+        // Give the backing pages back to the host
+        madvise(host_base + address, size, MADV_DONTNEED);
+    }
+    // Anonymous memory is demand-zero, so pages are committed on first touch
+    return mprotect(host_base + address, size, host_protection) == 0;
+#endif
+}
+
+bool MemoryManager::mapMemory(uint64_t address, uint64_t size, uint8_t protection) {
+    if (!host_base || size == 0 || (address | size) & (GUEST_PAGE_SIZE - 1) ||
+        address >= GUEST_ADDRESS_SPACE_SIZE || size > GUEST_ADDRESS_SPACE_SIZE - address) {
+        return false;
+    }
+    std::scoped_lock lock{map_mutex};
+    uint8_t flags = (protection & (PAGE_READ | PAGE_WRITE | PAGE_EXECUTE)) | PAGE_MAPPED;
+    if (!applyHostProtection(address, size, flags)) {
+        return false;
+    }
+    for (uint64_t page = address >> GUEST_PAGE_SHIFT; page < (address + size) >> GUEST_PAGE_SHIFT;
+         page++) {
+        replacePageEntry(page, flags);
+    }
+    return true;
+}
+
+bool MemoryManager::mapMmio(uint64_t address, uint64_t size, MmioReadHandler read,
+                            MmioWriteHandler write) {
+    if (!host_base || size == 0 || (address | size) & (GUEST_PAGE_SIZE - 1) ||
+        address >= GUEST_ADDRESS_SPACE_SIZE || size > GUEST_ADDRESS_SPACE_SIZE - address) {
+        return false;
+    }
+    std::scoped_lock lock{map_mutex};
+    uint8_t flags = PAGE_READ | PAGE_WRITE | PAGE_MAPPED | PAGE_MMIO;
+    if (!applyHostProtection(address, size, flags)) {
+        return false;
+    }
+    mmio_regions[address] = MmioRegion{size, std::move(read), std::move(write)};
+    for (uint64_t page = address >> GUEST_PAGE_SHIFT; page < (address + size) >> GUEST_PAGE_SHIFT;
+         page++) {
+        replacePageEntry(page, flags);
+    }
+    return true;
+}
+
+bool MemoryManager::unmapMemory(uint64_t address, uint64_t size) {
+    if (!host_base || size == 0 || (address | size) & (GUEST_PAGE_SIZE - 1) ||
+        address >= GUEST_ADDRESS_SPACE_SIZE || size > GUEST_ADDRESS_SPACE_SIZE - address) {
+        return false;
+    }
+    std::scoped_lock lock{map_mutex};
+    for (uint64_t page = address >> GUEST_PAGE_SHIFT; page < (address + size) >> GUEST_PAGE_SHIFT;
+         page++) {
+        if (getPageEntry(page, false)) {
+            replacePageEntry(page, 0);
+        }
+    }
+    mmio_regions.erase(mmio_regions.lower_bound(address), mmio_regions.lower_bound(address + size));
+    return applyHostProtection(address, size, 0);
+}
+
+bool MemoryManager::protectMemory(uint64_t address, uint64_t size, uint8_t protection) {
+    if (!host_base || size == 0 || (address | size) & (GUEST_PAGE_SIZE - 1) ||
+        address >= GUEST_ADDRESS_SPACE_SIZE || size > GUEST_ADDRESS_SPACE_SIZE - address) {
+        return false;
+    }
+    std::scoped_lock lock{map_mutex};
+    uint64_t first = address >> GUEST_PAGE_SHIFT;
+    uint64_t last = (address + size) >> GUEST_PAGE_SHIFT;
+    for (uint64_t page = first; page < last; page++) {
+        uint8_t flags = loadPageFlags(page);
+        if (!(flags & PAGE_MAPPED) || (flags & PAGE_MMIO)) {
+            return false;
+        }
+    }
+    // Changing protection disarms every watcher, the caches re-arm what they use again
+    for (uint64_t page = first; page < last; page++) {
+        releaseWatchedPage(page);
+    }
+    uint8_t access = protection & (PAGE_READ | PAGE_WRITE | PAGE_EXECUTE);
+    if (!applyHostProtection(address, size, access | PAGE_MAPPED)) {
+        return false;
+    }
+    for (uint64_t page = first; page < last; page++) {
+        // Keep the dirty bits the release just set
+        PageEntry* entry = getPageEntry(page, false);
+        uint32_t dirty = entry->load(std::memory_order_acquire) & ~PAGE_FLAGS_MASK;
+        entry->store(dirty | access | PAGE_MAPPED, std::memory_order_release);
+    }
+    return true;
+}
+
+uint8_t MemoryManager::getPageFlags(uint64_t address) const {
+    if (!page_directory || address >= GUEST_ADDRESS_SPACE_SIZE) {
+        return 0;
+    }
+    return loadPageFlags(address >> GUEST_PAGE_SHIFT);
+}
+
+uint8_t* MemoryManager::getHostBase() const {
+    return host_base;
+}
+
+uint8_t* MemoryManager::getFastmemBase() const {
+    return fastmem_enabled ? host_base : nullptr;
+}
+
+MemoryManager::MmioRegion* MemoryManager::findMmio(uint64_t address, uint64_t size,
+                                                   uint64_t* offset) {
+    if (!(getPageFlags(address) & PAGE_MMIO)) {
+        return nullptr;
+    }
+    auto it = mmio_regions.upper_bound(address);
+    if (it == mmio_regions.begin()) {
+        return nullptr;
+    }
+    --it;
+    *offset = address - it->first;
+    if (*offset >= it->second.size || size > it->second.size - *offset) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+bool MemoryManager::readMemory(uint64_t address, void* data, uint64_t size) {
+    // Read guest memory
+    if (size == 0) {
+        return true;
+    }
+    uint64_t offset;
+    if (MmioRegion* region = findMmio(address, size, &offset)) {
+        if (!region->read) {
+            return false;
+        }
+        region->read(offset, data, size);
+        return true;
+    }
+    const uint8_t* src = getHostPointer(address, size, PAGE_READ);
+    if (!src) {
+        return false;
+    }
+    std::memcpy(data, src, size);
+    return true;
+}
+
+bool MemoryManager::writeMemory(uint64_t address, const void* data, uint64_t size) {
+    // Write guest memory
+    if (size == 0) {
+        return true;
+    }
+    uint64_t offset;
+    if (MmioRegion* region = findMmio(address, size, &offset)) {
+        if (!region->write) {
+            return false;
+        }
+        region->write(offset, data, size);
+        return true;
+    }
+    uint8_t* dst = getHostPointer(address, size, PAGE_WRITE);
+    if (!dst) {
+        return false;
+    }
+    // A write-protected watched page faults into handleFault like a fastmem store
+    std::memcpy(dst, data, size);
+    // Report the pages once they hold the new data
+    uint64_t last = (address + size - 1) >> GUEST_PAGE_SHIFT;
+    for (uint64_t page = address >> GUEST_PAGE_SHIFT; page <= last; page++) {
+        releaseWatchedPage(page);
+    }
+    reportPendingWrites();
+    return true;
+}
+
+uint8_t* MemoryManager::prepareHostWrite(uint64_t address, uint64_t size) {
+    uint8_t* dst = getHostPointer(address, size, PAGE_WRITE);
+    if (!dst) {
+        return nullptr;
+    }
+    // Watchers stay armed until finishHostWrite, only the host protection is lifted
+    uint64_t last = (address + size - 1) >> GUEST_PAGE_SHIFT;
+    std::scoped_lock lock{protect_mutex};
+    for (uint64_t page = address >> GUEST_PAGE_SHIFT; page <= last; page++) {
+        host_write_pages[page]++;
+        uint32_t value = getPageEntry(page, false)->load(std::memory_order_acquire);
+        if ((value >> PAGE_WATCH_SHIFT) & 0xFF) {
+            applyHostProtection(page << GUEST_PAGE_SHIFT, GUEST_PAGE_SIZE, value & PAGE_FLAGS_MASK);
+        }
+    }
+    return dst;
+}
+
+void MemoryManager::finishHostWrite(uint64_t address, uint64_t size) {
+    uint64_t first = address >> GUEST_PAGE_SHIFT;
+    uint64_t last = (address + size - 1) >> GUEST_PAGE_SHIFT;
+    {
+        std::scoped_lock lock{protect_mutex};
+        for (uint64_t page = first; page <= last; page++) {
+            auto it = host_write_pages.find(page);
+            if (it != host_write_pages.end() && --it->second == 0) {
+                host_write_pages.erase(it);
+            }
+        }
+    }
+    // Includes watchers that armed a page while it was being written
+    for (uint64_t page = first; page <= last; page++) {
+        releaseWatchedPage(page);
+    }
+}
+
+void MemoryManager::protectWatchedPage(uint64_t page) {
+    std::scoped_lock lock{protect_mutex};
+    uint32_t value = getPageEntry(page, false)->load(std::memory_order_acquire);
+    // Pages the host is writing stay writable, finishHostWrite releases them afterwards
+    if (((value >> PAGE_WATCH_SHIFT) & 0xFF) && (value & PAGE_WRITE) &&
+        !host_write_pages.count(page)) {
+        applyHostProtection(page << GUEST_PAGE_SHIFT, GUEST_PAGE_SIZE, value & PAGE_FLAGS_MASK,
+                            true);
+    }
+}
+
+bool MemoryManager::isFastmemAddress(const void* host_address) const {
+    const uint8_t* address = static_cast<const uint8_t*>(host_address);
+    return host_base && address >= host_base &&
+           address < host_base + GUEST_ADDRESS_SPACE_SIZE + FASTMEM_GUARD_SIZE;
+}
+
+bool MemoryManager::handleFault(void* host_address) {
+    // Runs in signal context: only touches the page table and host protection, watchers
+    // hear about the write from reportPendingWrites
+    if (!isFastmemAddress(host_address)) {
+        return false;
+    }
+    uint64_t address = static_cast<uint8_t*>(host_address) - host_base;
+    if (address >= GUEST_ADDRESS_SPACE_SIZE) {
+        return false;
+    }
+    uint64_t page = address >> GUEST_PAGE_SHIFT;
+    uint8_t flags = loadPageFlags(page);
+    if ((flags & PAGE_MMIO) || (flags & (PAGE_MAPPED | PAGE_WRITE)) != (PAGE_MAPPED | PAGE_WRITE)) {
+        // MMIO, unmapped or really protected, needs the slow path
+        return false;
+    }
+    // Watched pages are host-readable, so a fault on one is a guest write
+    releaseWatchedPage(page, true);
+    PageEntry* entry = getPageEntry(page, false);
+    if (!((entry->load(std::memory_order_acquire) >> PAGE_WATCH_SHIFT) & 0xFF)) {
+        // A protect that raced a release can leave the page read-only without watchers,
+        // give write access back or the store faults forever
+        applyHostProtection(page << GUEST_PAGE_SHIFT, GUEST_PAGE_SIZE, flags);
+        // A watcher that armed the page meanwhile just lost its protection, the retried
+        // store is a write to its page
+        releaseWatchedPage(page, true);
+    }
+    return true;
+}
+
+void MemoryManager::setFastmemRecovery(FastmemRecovery* recovery) {
+    t_fastmem_recovery = recovery;
+}
+
+FastmemRecovery* MemoryManager::getFastmemRecovery() {
+    return t_fastmem_recovery;
+}
+
+void MemoryManager::replacePageEntry(uint64_t page, uint32_t value) {
+    uint32_t old = getPageEntry(page, true)->exchange(value, std::memory_order_acq_rel);
+    // Pending watchers were disarmed already but not told yet
+    notifyWatchers(((old >> PAGE_WATCH_SHIFT) | (old >> PAGE_PENDING_SHIFT)) & 0xFF, page);
+}
+
+void MemoryManager::releaseWatchedPage(uint64_t page, bool deferred) {
+    PageEntry* entry = getPageEntry(page, false);
+    if (!entry) {
+        return;
+    }
+    uint32_t old = entry->load(std::memory_order_acquire);
+    uint32_t watchers;
+    uint32_t released;
+    do {
+        watchers = (old >> PAGE_WATCH_SHIFT) & 0xFF;
+        if (!watchers) {
+            return;
+        }
+        released = (old & ~(0xFFu << PAGE_WATCH_SHIFT)) | (watchers << PAGE_DIRTY_SHIFT);
+        if (deferred) {
+            released |= watchers << PAGE_PENDING_SHIFT;
+        }
+    } while (!entry->compare_exchange_weak(old, released, std::memory_order_acq_rel,
+                                           std::memory_order_acquire));
+
+    if (old & PAGE_WRITE) {
+        applyHostProtection(page << GUEST_PAGE_SHIFT, GUEST_PAGE_SIZE, old & PAGE_FLAGS_MASK);
+    }
+    if (deferred) {
+        // A watcher that re-armed the page meanwhile may have lost its protection above.
+        // The fault handler cannot take protect_mutex, reportPendingWrites releases the
+        // page again instead.
+        uint64_t chunk = page / PAGES_PER_CHUNK;
+        pending_chunks[chunk / 64].fetch_or(1ull << (chunk % 64), std::memory_order_release);
+        pending_writes.store(true, std::memory_order_release);
+        return;
+    }
+    uint32_t rearmed = (entry->load(std::memory_order_acquire) >> PAGE_WATCH_SHIFT) & 0xFF;
+    if ((old & PAGE_WRITE) && rearmed) {
+        // A watcher re-armed the page before it was unprotected
+        protectWatchedPage(page);
+    }
+    notifyWatchers(watchers, page);
+}
+
+void MemoryManager::reportPendingWritesSlow() {
+    // The flag goes first: pages marked after this are seen here or raise it again
+    if (!pending_writes.exchange(false, std::memory_order_acq_rel)) {
+        return;
+    }
+    for (uint64_t word = 0; word < PAGE_CHUNK_COUNT / 64; word++) {
+        uint64_t chunks = pending_chunks[word].exchange(0, std::memory_order_acq_rel);
+        for (uint64_t bit = 0; chunks; bit++, chunks >>= 1) {
+            if (!(chunks & 1)) {
+                continue;
+            }
+            uint64_t first_page = (word * 64 + bit) * PAGES_PER_CHUNK;
+            PageEntry* chunk = page_directory[word * 64 + bit].load(std::memory_order_acquire);
+            for (uint64_t i = 0; i < PAGES_PER_CHUNK; i++) {
+                if (!(chunk[i].load(std::memory_order_relaxed) >> PAGE_PENDING_SHIFT)) {
+                    continue;
+                }
+                // Taking the bits makes each write reported once, whoever else reports
+                uint32_t old =
+                    chunk[i].fetch_and(~(0xFFu << PAGE_PENDING_SHIFT), std::memory_order_acq_rel);
+                uint32_t pending = old >> PAGE_PENDING_SHIFT;
+                notifyWatchers(pending, first_page + i);
+                if (pending & (old >> PAGE_WATCH_SHIFT) & 0xFF) {
+                    // Re-armed since the fault, possibly without host protection
+                    releaseWatchedPage(first_page + i);
+                }
+            }
+        }
+    }
+}
+
+void MemoryManager::notifyWatchers(uint32_t watchers, uint64_t page) {
+    uint64_t start = page << GUEST_PAGE_SHIFT;
+    for (int watcher = 0; watchers; watcher++, watchers >>= 1) {
+        if ((watchers & 1) && write_callbacks[watcher]) {
+            write_callbacks[watcher](start, start + GUEST_PAGE_SIZE);
+        }
+    }
+}
+
+int MemoryManager::subscribeWrites(WriteWatchCallback callback) {
+    std::scoped_lock lock{map_mutex};
+    for (int watcher = 0; watcher < MAX_WRITE_WATCHERS; watcher++) {
+        if (!(used_watchers & (1u << watcher))) {
+            used_watchers |= 1u << watcher;
+            write_callbacks[watcher] = std::move(callback);
+            return watcher;
+        }
+    }
+    return -1;
+}
+
+void MemoryManager::unsubscribeWrites(int watcher) {
+    if (watcher < 0 || watcher >= MAX_WRITE_WATCHERS || !page_directory) {
+        return;
+    }
+    std::scoped_lock lock{map_mutex};
+    used_watchers &= ~(1u << watcher);
+    write_callbacks[watcher] = nullptr;
+
+    // Drop the watcher's bits so the next subscriber in its slot starts clean
+    uint32_t bits = (1u << (watcher + PAGE_WATCH_SHIFT)) | (1u << (watcher + PAGE_DIRTY_SHIFT)) |
+                    (1u << (watcher + PAGE_PENDING_SHIFT));
+    for (uint64_t i = 0; i < PAGE_CHUNK_COUNT; i++) {
+        PageEntry* chunk = page_directory[i].load(std::memory_order_acquire);
+        if (!chunk) {
+            continue;
+        }
+        for (uint64_t j = 0; j < PAGES_PER_CHUNK; j++) {
+            uint32_t old = chunk[j].fetch_and(~bits, std::memory_order_acq_rel);
+            uint32_t watchers = (old >> PAGE_WATCH_SHIFT) & 0xFF;
+            if (watchers == (1u << watcher) && (old & PAGE_WRITE)) {
+                uint64_t page = i * PAGES_PER_CHUNK + j;
+                applyHostProtection(page << GUEST_PAGE_SHIFT, GUEST_PAGE_SIZE,
+                                    old & PAGE_FLAGS_MASK);
+            }
+        }
+    }
+}
+
+void MemoryManager::watchWrites(int watcher, uint64_t address, uint64_t size) {
+    if (watcher < 0 || watcher >= MAX_WRITE_WATCHERS || !getHostPointer(address, size, 0)) {
+        return;
+    }
+    uint32_t watch_bit = 1u << (watcher + PAGE_WATCH_SHIFT);
+    uint32_t dirty_bit = 1u << (watcher + PAGE_DIRTY_SHIFT);
+    uint64_t last = (address + size - 1) >> GUEST_PAGE_SHIFT;
+    for (uint64_t page = address >> GUEST_PAGE_SHIFT; page <= last; page++) {
+        PageEntry* entry = getPageEntry(page, false);
+        uint32_t old = entry->load(std::memory_order_acquire);
+        if ((old & (watch_bit | dirty_bit)) == watch_bit) {
+            // Already armed, the common case for code that is decoded again
+            continue;
+        }
+        while (!entry->compare_exchange_weak(old, (old | watch_bit) & ~dirty_bit,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+        }
+        if (!((old >> PAGE_WATCH_SHIFT) & 0xFF) && (old & PAGE_WRITE)) {
+            // Write-protect the host page so fastmem stores to it fault
+            protectWatchedPage(page);
+        }
+    }
+}
+
+bool MemoryManager::isDirty(int watcher, uint64_t address, uint64_t size) const {
+    if (watcher < 0 || watcher >= MAX_WRITE_WATCHERS || size == 0 || !page_directory ||
+        address >= GUEST_ADDRESS_SPACE_SIZE || size > GUEST_ADDRESS_SPACE_SIZE - address) {
+        return false;
+    }
+    uint32_t dirty_bit = 1u << (watcher + PAGE_DIRTY_SHIFT);
+    uint64_t last = (address + size - 1) >> GUEST_PAGE_SHIFT;
+    for (uint64_t page = address >> GUEST_PAGE_SHIFT; page <= last; page++) {
+        PageEntry* chunk = page_directory[page / PAGES_PER_CHUNK].load(std::memory_order_acquire);
+        if (chunk && (chunk[page % PAGES_PER_CHUNK].load(std::memory_order_acquire) & dirty_bit)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MemoryManager::consumeDirty(int watcher, uint64_t address, uint64_t size) {
+    if (watcher < 0 || watcher >= MAX_WRITE_WATCHERS || size == 0 || !page_directory ||
+        address >= GUEST_ADDRESS_SPACE_SIZE || size > GUEST_ADDRESS_SPACE_SIZE - address) {
+        return false;
+    }
+    uint32_t dirty_bit = 1u << (watcher + PAGE_DIRTY_SHIFT);
+    bool dirty = false;
+    uint64_t last = (address + size - 1) >> GUEST_PAGE_SHIFT;
+    for (uint64_t page = address >> GUEST_PAGE_SHIFT; page <= last; page++) {
+        PageEntry* entry = getPageEntry(page, false);
+        if (entry && (entry->fetch_and(~dirty_bit, std::memory_order_acq_rel) & dirty_bit)) {
+            dirty = true;
+        }
+    }
+    return dirty;
 }
 
 void MemoryManager::update() {
     // Update the memory manager
-    // ...
+    reportPendingWrites();
 }
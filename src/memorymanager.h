@@ -1,12 +1,189 @@
 #ifndef MEMORY_MANAGER_H
 #define MEMORY_MANAGER_H
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "guestheap.h"
+#ifndef _WIN32
+#include <csetjmp>
+#endif
+
+// Size of the reserved guest virtual address space (covers the PS4 user area)
+constexpr uint64_t GUEST_ADDRESS_SPACE_SIZE = 0x10000000000;
+constexpr uint64_t GUEST_PAGE_SHIFT = 12;
+constexpr uint64_t GUEST_PAGE_SIZE = 1ull << GUEST_PAGE_SHIFT;
+// Each page table chunk covers 16 MiB of guest address space
+constexpr uint64_t PAGE_CHUNK_SHIFT = 24;
+constexpr uint64_t PAGES_PER_CHUNK = 1ull << (PAGE_CHUNK_SHIFT - GUEST_PAGE_SHIFT);
+constexpr uint64_t PAGE_CHUNK_COUNT = GUEST_ADDRESS_SPACE_SIZE >> PAGE_CHUNK_SHIFT;
+// Inaccessible host pages after the reservation so fastmem accesses cannot run past it
+constexpr uint64_t FASTMEM_GUARD_SIZE = 0x10000;
+
+// Guest region mapped at boot for code and data
+constexpr uint64_t GUEST_MEMORY_BASE = 0x10000000;
+constexpr uint64_t GUEST_MEMORY_SIZE = 0x10000000;
+
+// Per-page flags stored in the page table
+enum PageFlags : uint8_t {
+    PAGE_READ = 1 << 0,
+    PAGE_WRITE = 1 << 1,
+    PAGE_EXECUTE = 1 << 2,
+    PAGE_MAPPED = 1 << 3,
+    // Accesses go to a registered MMIO handler, host mapping is inaccessible
+    PAGE_MMIO = 1 << 4,
+};
+
+// Caches that can watch guest pages for writes at the same time
+constexpr int MAX_WRITE_WATCHERS = 8;
+
+// Called with the guest page range [start, end) when a watched page is first written.
+// Runs on the thread that wrote, or for fastmem stores that faulted on a core thread at
+// its next block boundary; never from the fault handler itself.
+typedef std::function<void(uint64_t start, uint64_t end)> WriteWatchCallback;
+// MMIO handlers receive the offset into their region
+typedef std::function<void(uint64_t offset, void* data, uint64_t size)> MmioReadHandler;
+typedef std::function<void(uint64_t offset, const void* data, uint64_t size)> MmioWriteHandler;
+
+// Where a core thread resumes when a fastmem access cannot be fixed up in place
+struct FastmemRecovery {
+#ifndef _WIN32
+    sigjmp_buf env;
+#endif
+    uint64_t fault_address;
+};
+
 class MemoryManager {
 public:
+    ~MemoryManager();
     void init();
+    // Allocate from the guest heap, returns the host view of the allocation
     uint8_t* allocateMemory(uint32_t size);
+    void freeMemory(uint8_t* ptr);
+    // Same as above, in guest addresses
+    uint64_t allocateGuestMemory(uint64_t size);
+    void freeGuestMemory(uint64_t address);
+    // Map a guest range; host memory is committed lazily on first touch
+    bool mapMemory(uint64_t address, uint64_t size, uint8_t protection);
+    bool unmapMemory(uint64_t address, uint64_t size);
+    bool protectMemory(uint64_t address, uint64_t size, uint8_t protection);
+    // Map a guest range whose accesses are routed to handlers
+    bool mapMmio(uint64_t address, uint64_t size, MmioReadHandler read, MmioWriteHandler write);
+    uint8_t getPageFlags(uint64_t address) const;
+    // Translate a guest range to host memory, nullptr if any page lacks the access
+    uint8_t* getHostPointer(uint64_t address, uint64_t size, uint8_t access = PAGE_READ) {
+        if (size == 0 || address >= GUEST_ADDRESS_SPACE_SIZE ||
+            size > GUEST_ADDRESS_SPACE_SIZE - address) {
+            return nullptr;
+        }
+        uint64_t last = (address + size - 1) >> GUEST_PAGE_SHIFT;
+        for (uint64_t page = address >> GUEST_PAGE_SHIFT; page <= last; page++) {
+            uint8_t flags = loadPageFlags(page);
+            if ((flags & (access | PAGE_MAPPED)) != (access | PAGE_MAPPED) ||
+                (flags & PAGE_MMIO)) {
+                return nullptr;
+            }
+        }
+        return host_base + address;
+    }
+
+    // Host view of a guest range that host code (file reads, DMA) is about to write.
+    // Watched pages are unprotected until finishHostWrite, so the range can be filled by
+    // anything including the host kernel. nullptr if any page is not writable or is MMIO.
+    uint8_t* prepareHostWrite(uint64_t address, uint64_t size);
+    // Report a range obtained from prepareHostWrite to watchers once it holds the data
+    void finishHostWrite(uint64_t address, uint64_t size);
+
+    // Host address of guest address 0
+    uint8_t* getHostBase() const;
+    // Base for direct host_base + guest_address accesses, nullptr if fastmem is unavailable
+    uint8_t* getFastmemBase() const;
+    // Slow path: checked accesses with MMIO dispatch and write watch notification
+    bool readMemory(uint64_t address, void* data, uint64_t size);
+    bool writeMemory(uint64_t address, const void* data, uint64_t size);
+    // Resolve a host fault in place, returns false if the access must take the slow path
+    bool handleFault(void* host_address);
+    bool isFastmemAddress(const void* host_address) const;
+    // Register the calling thread's recovery point for faults handleFault cannot fix
+    static void setFastmemRecovery(FastmemRecovery* recovery);
+    static FastmemRecovery* getFastmemRecovery();
+
+    // Register a cache that derives state from guest memory, returns its watcher id
+    // or -1 when every slot is taken. Subscribe before the cores start.
+    int subscribeWrites(WriteWatchCallback callback);
+    void unsubscribeWrites(int watcher);
+    // Arm the pages of a guest range: the next write to each of them marks it dirty for
+    // this watcher and reports it once. Re-arming a page clears its dirty bit.
+    void watchWrites(int watcher, uint64_t address, uint64_t size);
+    // Check whether any page of a range was written since this watcher armed it
+    bool isDirty(int watcher, uint64_t address, uint64_t size) const;
+    // Same, and clear the dirty bits of the range
+    bool consumeDirty(int watcher, uint64_t address, uint64_t size);
+    // Notify watchers of the writes the fault handler recorded, which may not call them.
+    // Core threads check this at block boundaries, update() does from the main loop.
+    void reportPendingWrites() {
+        if (pending_writes.load(std::memory_order_acquire)) {
+            reportPendingWritesSlow();
+        }
+    }
     void update();
 private:
-    uint8_t* memory;
+    // PageFlags in bits 0-7, one watch bit per watcher in bits 8-15, one dirty bit per
+    // watcher in bits 16-23 and one not-yet-notified bit per watcher in bits 24-31.
+    // Watched writable pages are write-protected on the host.
+    typedef std::atomic<uint32_t> PageEntry;
+    static constexpr uint32_t PAGE_FLAGS_MASK = 0xFF;
+    static constexpr uint32_t PAGE_WATCH_SHIFT = 8;
+    static constexpr uint32_t PAGE_DIRTY_SHIFT = 16;
+    static constexpr uint32_t PAGE_PENDING_SHIFT = 24;
+
+    struct MmioRegion {
+        uint64_t size;
+        MmioReadHandler read;
+        MmioWriteHandler write;
+    };
+
+    uint8_t loadPageFlags(uint64_t page) const {
+        PageEntry* chunk = page_directory[page / PAGES_PER_CHUNK].load(std::memory_order_acquire);
+        return chunk ? chunk[page % PAGES_PER_CHUNK].load(std::memory_order_relaxed) &
+                           PAGE_FLAGS_MASK
+                     : 0;
+    }
+    PageEntry* getPageEntry(uint64_t page, bool create);
+    bool applyHostProtection(uint64_t address, uint64_t size, uint8_t protection,
+                             bool write_watched = false);
+    // Replace a page entry, reporting the page to whoever still watched it
+    void replacePageEntry(uint64_t page, uint32_t value);
+    // Disarm every watcher of a page, mark it dirty for them and notify them. Deferred,
+    // as in the fault handler, the page is only marked pending for reportPendingWrites.
+    void releaseWatchedPage(uint64_t page, bool deferred = false);
+    // Write-protect a page if it is still watched and not being written by the host
+    void protectWatchedPage(uint64_t page);
+    void notifyWatchers(uint32_t watchers, uint64_t page);
+    void reportPendingWritesSlow();
+    MmioRegion* findMmio(uint64_t address, uint64_t size, uint64_t* offset);
+    void installFaultHandler();
+
+    // Start of the host reservation, guest address N lives at host_base + N
+    uint8_t* host_base = nullptr;
+    bool fastmem_enabled = false;
+    std::unique_ptr<std::atomic<PageEntry*>[]> page_directory;
+    // One bit per page table chunk holding pending pages, set from the fault handler
+    std::unique_ptr<std::atomic<uint64_t>[]> pending_chunks;
+    std::atomic<bool> pending_writes{false};
+    std::mutex map_mutex;
+    // Orders write-protecting watched pages against host writes, which must not fault
+    std::mutex protect_mutex;
+    // Pages with host writes in flight, and how many
+    std::map<uint64_t, uint32_t> host_write_pages;
+    // Registered before the cores start, looked up without locking
+    std::map<uint64_t, MmioRegion> mmio_regions;
+    // Also written before the cores start, read without locking by the notifiers
+    WriteWatchCallback write_callbacks[MAX_WRITE_WATCHERS];
+    uint32_t used_watchers = 0;
+    GuestHeap heap;
 };
 
 #endif  // MEMORY_MANAGER_H
@@ -0,0 +1,272 @@
+#include <cstring>
+#include <filesystem>
+#include "shadercache.h"
+
+// Layout of a cache file, followed by the SPIR-V words and the metadata bytes
+struct ShaderFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t stage;
+    uint32_t reserved;
+    uint64_t key_low;
+    uint64_t key_high;
+    uint64_t spirv_words;
+    uint64_t metadata_size;
+};
+
+// Layout of a recorded shader, followed by the guest code
+struct ShaderRecordHeader {
+    uint32_t stage;
+    uint32_t reserved;
+    uint64_t size;
+};
+
+static const uint32_t SHADER_FILE_MAGIC = 0x4348534C;  // "LSHC"
+static const char* SHADER_FILE_EXTENSION = ".bin";
+
+static inline uint64_t rotateLeft(uint64_t value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+static inline uint64_t finalizeHash(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+ShaderCache::~ShaderCache() {
+    waitForPreload();
+    stopRecording();
+}
+
+void ShaderCache::init(const std::string& cache_directory) {
+    waitForPreload();
+    directory = cache_directory;
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+}
+
+void ShaderCache::startPreload() {
+    if (preloading.exchange(true)) {
+        return;
+    }
+    waitForPreload();
+    preload_thread = std::thread(&ShaderCache::preloadThread, this);
+}
+
+void ShaderCache::waitForPreload() {
+    if (preload_thread.joinable()) {
+        preload_thread.join();
+    }
+}
+
+ShaderKey ShaderCache::computeKey(const uint8_t* code, uint64_t size, ShaderStage stage) const {
+    // Two independent 64-bit lanes over the code, 8 bytes at a time
+    uint64_t low = 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(stage);
+    uint64_t high = 0xC2B2AE3D27D4EB4Full + size;
+    uint64_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, code + offset, sizeof(word));
+        low = rotateLeft(low ^ (word * 0x87C37B91114253D5ull), 31) * 0x4CF5AD432745937Full;
+        high = rotateLeft(high + word, 27) * 0x52DCE729ull + low;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, code + offset, size - offset);
+    low ^= tail;
+    high ^= rotateLeft(tail, 17);
+    return ShaderKey{finalizeHash(low + high), finalizeHash(high ^ (low >> 1))};
+}
+
+const ShaderEntry* ShaderCache::getShader(const uint8_t* code, uint64_t size, ShaderStage stage,
+                                          const ShaderTranslator& translator) {
+    ShaderKey key = computeKey(code, size, stage);
+    recordShader(key, code, size, stage);
+    if (const ShaderEntry* entry = lookup(key)) {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return entry;
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    ShaderEntry entry;
+    entry.stage = stage;
+    if (!translator || !translator(code, size, stage, &entry)) {
+        return nullptr;
+    }
+    storeEntry(key, entry);
+    return insert(key, std::move(entry));
+}
+
+const ShaderEntry* ShaderCache::lookup(const ShaderKey& key) {
+    {
+        std::shared_lock lock{entries_mutex};
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            return &it->second;
+        }
+    }
+    if (!preloading.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    // The preload has not reached this shader yet, load it now instead of translating
+    ShaderKey stored_key;
+    ShaderEntry entry;
+    if (!loadEntry(getEntryPath(key), &stored_key, &entry) || !(stored_key == key)) {
+        return nullptr;
+    }
+    return insert(key, std::move(entry));
+}
+
+const ShaderEntry* ShaderCache::insert(const ShaderKey& key, ShaderEntry entry) {
+    std::unique_lock lock{entries_mutex};
+    // Keep the first entry if another thread got there before us
+    return &entries.try_emplace(key, std::move(entry)).first->second;
+}
+
+std::string ShaderCache::getEntryPath(const ShaderKey& key) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx%016llx%s", (unsigned long long)key.high,
+                  (unsigned long long)key.low, SHADER_FILE_EXTENSION);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+bool ShaderCache::loadEntry(const std::string& path, ShaderKey* key, ShaderEntry* entry) const {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    ShaderFileHeader header;
+    bool valid = std::fread(&header, sizeof(header), 1, file) == 1 &&
+                 header.magic == SHADER_FILE_MAGIC && header.version == SHADER_CACHE_VERSION &&
+                 header.spirv_words < (1ull << 28) && header.metadata_size < (1ull << 28);
+    if (valid) {
+        key->low = header.key_low;
+        key->high = header.key_high;
+        entry->stage = static_cast<ShaderStage>(header.stage);
+        entry->spirv.resize(header.spirv_words);
+        entry->metadata.resize(header.metadata_size);
+        valid = std::fread(entry->spirv.data(), sizeof(uint32_t), entry->spirv.size(), file) ==
+                    entry->spirv.size() &&
+                std::fread(entry->metadata.data(), 1, entry->metadata.size(), file) ==
+                    entry->metadata.size();
+    }
+    std::fclose(file);
+    return valid;
+}
+
+bool ShaderCache::storeEntry(const ShaderKey& key, const ShaderEntry& entry) const {
+    if (directory.empty()) {
+        return false;
+    }
+    // Write a temporary file and rename it, so readers never see a partial entry
+    std::string path = getEntryPath(key);
+    std::string temp_path = path + ".tmp";
+    std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    ShaderFileHeader header{SHADER_FILE_MAGIC,     SHADER_CACHE_VERSION,
+                            uint32_t(entry.stage), 0,
+                            key.low,               key.high,
+                            entry.spirv.size(),    entry.metadata.size()};
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   std::fwrite(entry.spirv.data(), sizeof(uint32_t), entry.spirv.size(), file) ==
+                       entry.spirv.size() &&
+                   std::fwrite(entry.metadata.data(), 1, entry.metadata.size(), file) ==
+                       entry.metadata.size();
+    written = std::fclose(file) == 0 && written;
+    std::error_code error;
+    if (written) {
+        std::filesystem::rename(temp_path, path, error);
+    }
+    if (!written || error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+void ShaderCache::preloadThread() {
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(directory, error)) {
+        if (!file.is_regular_file(error) || file.path().extension() != SHADER_FILE_EXTENSION) {
+            continue;
+        }
+        ShaderKey key;
+        ShaderEntry entry;
+        if (loadEntry(file.path().string(), &key, &entry)) {
+            insert(key, std::move(entry));
+        }
+    }
+    preloading.store(false, std::memory_order_release);
+}
+
+bool ShaderCache::startRecording(const std::string& path) {
+    std::scoped_lock lock{recording_mutex};
+    if (recording) {
+        std::fclose(recording);
+    }
+    recording = std::fopen(path.c_str(), "ab");
+    recorded_keys.clear();
+    return recording != nullptr;
+}
+
+void ShaderCache::stopRecording() {
+    std::scoped_lock lock{recording_mutex};
+    if (recording) {
+        std::fclose(recording);
+        recording = nullptr;
+    }
+}
+
+void ShaderCache::recordShader(const ShaderKey& key, const uint8_t* code, uint64_t size,
+                               ShaderStage stage) {
+    std::scoped_lock lock{recording_mutex};
+    if (!recording || !recorded_keys.insert(key).second) {
+        return;
+    }
+    ShaderRecordHeader header{static_cast<uint32_t>(stage), 0, size};
+    std::fwrite(&header, sizeof(header), 1, recording);
+    std::fwrite(code, 1, size, recording);
+}
+
+uint32_t ShaderCache::warmFromRecording(const std::string& path,
+                                        const ShaderTranslator& translator) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return 0;
+    }
+    uint32_t added = 0;
+    ShaderRecordHeader header;
+    std::vector<uint8_t> code;
+    while (std::fread(&header, sizeof(header), 1, file) == 1 && header.size < (1ull << 28)) {
+        code.resize(header.size);
+        if (std::fread(code.data(), 1, code.size(), file) != code.size()) {
+            break;
+        }
+        ShaderStage stage = static_cast<ShaderStage>(header.stage);
+        ShaderKey key = computeKey(code.data(), code.size(), stage);
+        if (lookup(key)) {
+            continue;
+        }
+        ShaderEntry entry;
+        entry.stage = stage;
+        if (translator && translator(code.data(), code.size(), stage, &entry)) {
+            storeEntry(key, entry);
+            insert(key, std::move(entry));
+            added++;
+        }
+    }
+    std::fclose(file);
+    return added;
+}
+
+uint64_t ShaderCache::getHitCount() const {
+    return hits.load(std::memory_order_relaxed);
+}
+
+uint64_t ShaderCache::getMissCount() const {
+    return misses.load(std::memory_order_relaxed);
+}
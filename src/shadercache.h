@@ -0,0 +1,102 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Bump whenever the translator output or the file layout changes
+constexpr uint32_t SHADER_CACHE_VERSION = 1;
+constexpr const char* SHADER_CACHE_DIRECTORY = "shader_cache";
+
+enum class ShaderStage : uint32_t {
+    Vertex,
+    Pixel,
+    Compute,
+    Geometry,
+    Hull,
+    Domain,
+};
+
+// Content hash of a guest shader binary and its stage
+struct ShaderKey {
+    uint64_t low;
+    uint64_t high;
+
+    bool operator==(const ShaderKey& other) const {
+        return low == other.low && high == other.high;
+    }
+};
+
+struct ShaderKeyHash {
+    size_t operator()(const ShaderKey& key) const {
+        return static_cast<size_t>(key.low);
+    }
+};
+
+// Translated shader and what the renderer needs to build pipelines from it
+struct ShaderEntry {
+    ShaderStage stage;
+    std::vector<uint32_t> spirv;
+    // Renderer-defined pipeline metadata (resource bindings, user data layout, ...)
+    std::vector<uint8_t> metadata;
+};
+
+// Translate guest code into an entry, false if the shader is unsupported
+typedef std::function<bool(const uint8_t* code, uint64_t size, ShaderStage stage,
+                           ShaderEntry* entry)>
+    ShaderTranslator;
+
+// Translated shaders keyed by content, persisted to disk one file per shader
+class ShaderCache {
+public:
+    ~ShaderCache();
+    void init(const std::string& cache_directory);
+    // Load every stored shader on a background thread
+    void startPreload();
+    void waitForPreload();
+    ShaderKey computeKey(const uint8_t* code, uint64_t size, ShaderStage stage) const;
+    // Cached entry, translated and stored on a miss; nullptr if translation fails.
+    // Entries are never evicted, so the pointer stays valid until shutdown.
+    const ShaderEntry* getShader(const uint8_t* code, uint64_t size, ShaderStage stage,
+                                 const ShaderTranslator& translator);
+    const ShaderEntry* lookup(const ShaderKey& key);
+    // Append every guest shader seen from now on to a session recording
+    bool startRecording(const std::string& path);
+    void stopRecording();
+    // Translate every shader of a recorded session that is not cached yet,
+    // returns the number of shaders added
+    uint32_t warmFromRecording(const std::string& path, const ShaderTranslator& translator);
+    uint64_t getHitCount() const;
+    uint64_t getMissCount() const;
+private:
+    const ShaderEntry* insert(const ShaderKey& key, ShaderEntry entry);
+    std::string getEntryPath(const ShaderKey& key) const;
+    bool loadEntry(const std::string& path, ShaderKey* key, ShaderEntry* entry) const;
+    bool storeEntry(const ShaderKey& key, const ShaderEntry& entry) const;
+    void recordShader(const ShaderKey& key, const uint8_t* code, uint64_t size,
+                      ShaderStage stage);
+    void preloadThread();
+
+    std::string directory;
+    std::shared_mutex entries_mutex;
+    // Node-based so entry addresses stay stable across inserts
+    std::unordered_map<ShaderKey, ShaderEntry, ShaderKeyHash> entries;
+    std::thread preload_thread;
+    std::atomic<bool> preloading{false};
+    std::mutex recording_mutex;
+    std::FILE* recording = nullptr;
+    // Shaders already written to the current recording
+    std::unordered_set<ShaderKey, ShaderKeyHash> recorded_keys;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+};
+
+#endif  // SHADER_CACHE_H